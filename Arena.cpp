@@ -0,0 +1,213 @@
+#include "Arena.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ARENA_MMAP 1
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	//the smallest block handed out, so that tiny tensors share a size
+	constexpr size_t MinBytes = 64;
+
+	std::atomic<bool> huge_pages_enabled = false;
+
+	std::atomic<size_t> in_use = 0;
+	std::atomic<size_t> high_water_mark = 0;
+	std::atomic<size_t> huge_pages = 0;
+	std::atomic<size_t> reused = 0;
+	std::atomic<size_t> allocated = 0;
+
+	//the blocks asked to be in huge pages, so that releasing them counts them off. Only large blocks are in it,
+	//which are few, so a lock does not matter
+	std::mutex huge_blocks_mutex;
+	std::unordered_set<void*> huge_blocks;
+
+	//what a block of the given size takes: a power of two below a huge page, whole huge pages from there on
+	size_t rounded(const size_t bytes)
+	{
+		if (bytes >= Arena::HugePageBytes)
+		{
+			return (bytes + Arena::HugePageBytes - 1) / Arena::HugePageBytes * Arena::HugePageBytes;
+		}
+		return std::bit_ceil(std::max(bytes, MinBytes));
+	}
+
+	bool mapped(const size_t size)
+	{
+#ifdef ARENA_MMAP
+		return size >= Arena::HugePageBytes;
+#else
+		return false;
+#endif
+	}
+
+	void* system_allocate(const size_t size)
+	{
+#ifdef ARENA_MMAP
+		if (mapped(size))
+		{
+			const bool huge = huge_pages_enabled.load(std::memory_order_relaxed);
+			void* memory = MAP_FAILED;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB)
+			if (huge)
+			{
+				//reserved huge pages, which there are none of unless the administrator set some aside
+				memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+			}
+#endif
+			if (memory == MAP_FAILED)
+			{
+				memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (memory == MAP_FAILED)
+				{
+					throw std::bad_alloc();
+				}
+#ifdef MADV_HUGEPAGE
+				if (huge)
+				{
+					::madvise(memory, size, MADV_HUGEPAGE);
+				}
+#endif
+			}
+			if (huge)
+			{
+				const std::lock_guard lock(huge_blocks_mutex);
+				huge_blocks.insert(memory);
+				huge_pages += size;
+			}
+			return memory;
+		}
+#endif
+		return ::operator new(size);
+	}
+
+	void system_release(void* const memory, const size_t size) noexcept
+	{
+#ifdef ARENA_MMAP
+		if (mapped(size))
+		{
+			{
+				const std::lock_guard lock(huge_blocks_mutex);
+				if (huge_blocks.erase(memory) != 0)
+				{
+					huge_pages -= size;
+				}
+			}
+			::munmap(memory, size);
+			return;
+		}
+#endif
+		::operator delete(memory);
+	}
+
+	//the blocks one thread freed, by size. Set once the thread's cache is gone, for tensors destroyed after it,
+	//e.g. those of objects with static storage, which then go straight back to the system
+	thread_local bool cache_gone = false;
+
+	struct Cache
+	{
+		std::unordered_map<size_t, std::vector<void*>> blocks;
+		size_t bytes = 0;
+
+		~Cache()
+		{
+			for (const auto& [size, freed] : blocks)
+			{
+				for (void* const memory : freed)
+				{
+					system_release(memory, size);
+				}
+			}
+			cache_gone = true;
+		}
+	};
+
+	thread_local Cache cache;
+}
+
+namespace Arena
+{
+	void* allocate(const size_t bytes)
+	{
+		const size_t size = rounded(bytes);
+		void* memory = nullptr;
+		if (!cache_gone)
+		{
+			const auto it = cache.blocks.find(size);
+			if (it != cache.blocks.end() && !it->second.empty())
+			{
+				memory = it->second.back();
+				it->second.pop_back();
+				cache.bytes -= size;
+				reused.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		if (memory == nullptr)
+		{
+			memory = system_allocate(size);
+			allocated.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		const size_t now = in_use.fetch_add(size, std::memory_order_relaxed) + size;
+		size_t peak = high_water_mark.load(std::memory_order_relaxed);
+		while (now > peak && !high_water_mark.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+		{
+		}
+		return memory;
+	}
+
+	void release(void* const memory, const size_t bytes) noexcept
+	{
+		if (memory == nullptr)
+		{
+			return;
+		}
+		const size_t size = rounded(bytes);
+		in_use.fetch_sub(size, std::memory_order_relaxed);
+		if (!cache_gone && cache.bytes + size <= MaxCachedBytes)
+		{
+			try
+			{
+				cache.blocks[size].push_back(memory);
+				cache.bytes += size;
+				return;
+			}
+			catch (const std::bad_alloc&)
+			{
+				//there is no room to keep it, so it goes back
+			}
+		}
+		system_release(memory, size);
+	}
+
+	bool useHugePages(const bool enabled)
+	{
+		huge_pages_enabled = enabled;
+#if defined(ARENA_MMAP) && (defined(MADV_HUGEPAGE) || defined(MAP_HUGETLB))
+		return true;
+#else
+		return !enabled;
+#endif
+	}
+
+	Usage usage()
+	{
+		return Usage
+		{
+			.in_use = in_use.load(std::memory_order_relaxed),
+			.high_water_mark = high_water_mark.load(std::memory_order_relaxed),
+			.huge_pages = huge_pages.load(std::memory_order_relaxed),
+			.reused = reused.load(std::memory_order_relaxed),
+			.allocated = allocated.load(std::memory_order_relaxed)
+		};
+	}
+}
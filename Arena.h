@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+
+//the memory tensors keep their cells in. Blocks which are freed are kept by size for the next one asking for as much,
+//on the thread which freed them, so that programs which keep clearing and refilling tensors do not go back to the
+//system allocator each time. Blocks of a huge page and up are mapped on their own, in huge pages if asked for
+namespace Arena
+{
+	//the size of a huge page on x86-64 and ARM64 Linux, which large blocks are rounded up to
+	constexpr size_t HugePageBytes = size_t{ 2 } << 20;
+
+	//how much is kept on each thread for reuse at most, anything freed beyond it goes back to the system
+	constexpr size_t MaxCachedBytes = size_t{ 64 } << 20;
+
+	//memory for at least the given number of bytes, aligned for any type. Never nullptr, throws std::bad_alloc
+	void* allocate(size_t bytes);
+
+	//gives back memory allocate() gave for the same number of bytes
+	void release(void* memory, size_t bytes) noexcept;
+
+	//backs the blocks allocated from now on which span a huge page or more with huge pages, where the system has
+	//them: reserved ones if there are any free, transparent ones otherwise. Returns whether it can
+	bool useHugePages(bool enabled);
+
+	struct Usage
+	{
+		//bytes in blocks tensors hold now, and the most they held at once
+		size_t in_use;
+		size_t high_water_mark;
+		//bytes mapped to be in huge pages, held by tensors or kept for reuse
+		size_t huge_pages;
+		//blocks which came from those kept for reuse, and ones which had to be allocated
+		size_t reused;
+		size_t allocated;
+	};
+
+	//counted over all threads
+	Usage usage();
+}
@@ -1,70 +1,257 @@
-#include "ArgumentParser.h"
-#include <tuple>
-#include <algorithm>
-#include "Dependencies/Logger/Logger.h"
-
-namespace
-{
-	std::optional<std::string> findString(std::span<const char *> args, const std::string_view marker)
-	{
-		for (size_t i = 0; i < args.size(); i++) 
-		{
-			if (std::string_view(args[i]) == marker) 
-			{
-				const size_t string_index = i + 1;
-				if (string_index < args.size()) 
-				{
-					return args[string_index];
-				}
-			}
-		}
-		return std::nullopt;
-	}
-
-	bool findMarker(std::span<const char *> args, const std::string_view marker)
-	{
-		return std::find_if(args.begin(), args.end(), [marker](const char* currentArg) 
-		{
-			return std::string_view(currentArg) == marker;
-		}) != args.end();
-	}
-
-	void outputHelp()
-	{
-		Logger::LogMessage("-i: required, the path of the input file");
-		Logger::LogMessage("-o: optional, the path of the output file. If not supplied, output will be to stdout");
-		Logger::LogMessage("-w: optional, the path of the words file, which maps instructions to words.");
-	}
-}
-namespace Arguments 
-{
-	std::optional<ParseResult> parse(std::span<const char *> args)
-	{
-		if (const bool help = findMarker(args, "-h")) 
-		{
-			outputHelp();
-			return std::nullopt;
-		}
-
-
-		const auto inputPath = findString(args, "-i");
-		const auto outputPath = findString(args, "-o");
-		const auto wordsPath = findString(args, "-w");
-		if (inputPath.has_value())
-		{
-			const ParseResult result
-			{
-				.inputPath = inputPath.value(),
-				.outputPath = outputPath.value_or(""),
-				.wordsPath = wordsPath.value_or("")
-			};
-
-			return result;
-		}
-		else
-		{
-			Logger::LogError("Please specify an input path using -i. Use -h for help");
-			return std::nullopt;
-		}
-	}
-}
+#include "ArgumentParser.h"
+#include <tuple>
+#include <algorithm>
+#include <charconv>
+#include "Dependencies/Logger/Logger.h"
+
+namespace
+{
+	std::optional<std::string> findString(std::span<const char *> args, const std::string_view marker)
+	{
+		for (size_t i = 0; i < args.size(); i++) 
+		{
+			if (std::string_view(args[i]) == marker) 
+			{
+				const size_t string_index = i + 1;
+				if (string_index < args.size()) 
+				{
+					return args[string_index];
+				}
+			}
+		}
+		return std::nullopt;
+	}
+
+	//parses the whole text as an unsigned number, or logs that it is an invalid one of the given name
+	std::optional<unsigned> parseUnsigned(const std::string& text, const std::string_view name)
+	{
+		unsigned value = 0;
+		const auto [last, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+		if (error != std::errc() || last != text.data() + text.size())
+		{
+			const std::string message = "Invalid " + std::string(name) + " " + text + ". Use -h for help";
+			Logger::LogError(message.c_str());
+			return std::nullopt;
+		}
+		return value;
+	}
+
+	bool findMarker(std::span<const char *> args, const std::string_view marker)
+	{
+		return std::find_if(args.begin(), args.end(), [marker](const char* currentArg) 
+		{
+			return std::string_view(currentArg) == marker;
+		}) != args.end();
+	}
+
+	void outputHelp()
+	{
+		Logger::LogMessage("-i: required, the path of the input file");
+		Logger::LogMessage("-o: optional, the path of the output file. If not supplied, output will be to stdout");
+		Logger::LogMessage("-f: optional, the format of the output: text (the default) or int32, which writes little-endian ints");
+		Logger::LogMessage("-in: optional, the path of the file instruction 6 reads from. If not supplied, it reads from stdin");
+		Logger::LogMessage("-if: optional, the format of what instruction 6 reads: text (the default) or int32, which reads little-endian ints. Numbers below -2147483646, the lowest a cell holds, are read as -2147483646");
+		Logger::LogMessage("-w: optional, the path of the words file, which maps instructions to words.");
+		Logger::LogMessage("-e: optional, the engine to run with: decode (the default) or bytecode");
+		Logger::LogMessage("-j: optional, compiles hot loops of the decode engine to native code, on x86-64 Linux");
+		Logger::LogMessage("--checkpoint: optional, the path to take checkpoints of the run to, on SIGUSR1 and every 600 seconds");
+		Logger::LogMessage("--checkpoint-every: optional, the seconds between checkpoints, or 0 to only take them on SIGUSR1");
+		Logger::LogMessage("--resume: optional, the checkpoint to resume a run from, instead of -i. Give it the same user input and output path as the run it was taken from");
+		Logger::LogMessage("--batch: optional, the path of a manifest of jobs to run instead of -i, one per line as the paths of the program, its user input and its output. Programs are parsed once, jobs run on as many threads as the hardware runs at once");
+		Logger::LogMessage("--threads: optional, the threads to run batch jobs on instead");
+		Logger::LogMessage("--lockstep: optional, runs batch jobs of the same program in groups of 8 which share the instruction cursor, decoding every tick once for the whole group. Only with the decode engine, without -j");
+		Logger::LogMessage("--serve: optional, the path of a Unix domain socket to serve runs at instead of -i, on --threads threads. Programs stay parsed between runs. A client sends \"run <tick budget> <input size> <program path>\" and a newline, then the user input, and gets \"output <size>\" lines each followed by that much output, then an \"end\" line with how the run ended and how long it took. \"stats\" gets the totals of all runs");
+		Logger::LogMessage("--profile: optional, the path to write a profile of the run to: where the decode engine spent its time by instruction, by instruction cell and in pairing parens. Heatmaps of the instruction tensors are written next to it as PGM images");
+		Logger::LogMessage("--huge-pages: optional, backs tensors of 2 MiB and up with huge pages, on Linux. The profile reports how much memory tensors took at most");
+		Logger::LogMessage("-c: optional, the path to compile the program to. The image is written instead of running the program, and can be run with -i like a program's text, without a words file");
+		Logger::LogMessage("--emit-cpp: optional, the path to write the program to as C++ instead of running it, for programs which never write to their instruction tensors. Build it with the sources of the interpreter but Source.cpp; it takes -o, -f, -in and -if");
+	}
+
+	std::optional<Arguments::Engine> parseEngine(const std::string_view name)
+	{
+		if (name == "decode")
+		{
+			return Arguments::Engine::Decoding;
+		}
+		if (name == "bytecode")
+		{
+			return Arguments::Engine::Bytecode;
+		}
+		return std::nullopt;
+	}
+
+	std::optional<Input::Format> parseInputFormat(const std::string_view name)
+	{
+		if (name == "text")
+		{
+			return Input::Format::Text;
+		}
+		if (name == "int32")
+		{
+			return Input::Format::Int32;
+		}
+		return std::nullopt;
+	}
+
+	std::optional<Output::Format> parseFormat(const std::string_view name)
+	{
+		if (name == "text")
+		{
+			return Output::Format::Text;
+		}
+		if (name == "int32")
+		{
+			return Output::Format::Int32;
+		}
+		return std::nullopt;
+	}
+}
+namespace Arguments 
+{
+	std::optional<ParseResult> parse(std::span<const char *> args)
+	{
+		if (const bool help = findMarker(args, "-h")) 
+		{
+			outputHelp();
+			return std::nullopt;
+		}
+
+
+		const auto inputPath = findString(args, "-i");
+		const auto wordsPath = findString(args, "-w");
+		const auto engineName = findString(args, "-e");
+		const auto engine = parseEngine(engineName.value_or("decode"));
+		if (!engine.has_value())
+		{
+			const std::string error = "Unknown engine " + engineName.value() + ". Use -h for help";
+			Logger::LogError(error.c_str());
+			return std::nullopt;
+		}
+
+		const auto streams = parseStreams(args);
+		if (!streams.has_value())
+		{
+			return std::nullopt;
+		}
+
+		const auto compilePath = findString(args, "-c");
+		const auto emitCppPath = findString(args, "--emit-cpp");
+		if (emitCppPath.has_value() && !inputPath.has_value())
+		{
+			Logger::LogError("--emit-cpp needs the program given with -i. Use -h for help");
+			return std::nullopt;
+		}
+		const auto checkpointPath = findString(args, "--checkpoint");
+		const auto resumePath = findString(args, "--resume");
+		const auto checkpointSecondsText = findString(args, "--checkpoint-every");
+		unsigned checkpointSeconds = 600;
+		if (checkpointSecondsText.has_value())
+		{
+			const auto parsedSeconds = parseUnsigned(checkpointSecondsText.value(), "checkpoint interval");
+			if (!parsedSeconds.has_value())
+			{
+				return std::nullopt;
+			}
+			checkpointSeconds = parsedSeconds.value();
+		}
+		const auto batchPath = findString(args, "--batch");
+		const auto threadsText = findString(args, "--threads");
+		unsigned threads = 0;
+		if (threadsText.has_value())
+		{
+			const auto parsedThreads = parseUnsigned(threadsText.value(), "thread count");
+			if (!parsedThreads.has_value())
+			{
+				return std::nullopt;
+			}
+			threads = parsedThreads.value();
+		}
+		const bool jit = findMarker(args, "-j");
+		if (jit && engine.value() != Engine::Decoding)
+		{
+			Logger::LogError("-j only works with the decode engine. Use -h for help");
+			return std::nullopt;
+		}
+		const bool lockstep = findMarker(args, "--lockstep");
+		if (lockstep && (!batchPath.has_value() || jit || engine.value() != Engine::Decoding))
+		{
+			Logger::LogError("--lockstep only works with --batch and the decode engine, without -j. Use -h for help");
+			return std::nullopt;
+		}
+		const auto servePath = findString(args, "--serve");
+		if (servePath.has_value() && (jit || engine.value() != Engine::Decoding || batchPath.has_value()))
+		{
+			Logger::LogError("--serve only works with the decode engine, without -j and --batch. Use -h for help");
+			return std::nullopt;
+		}
+		const auto profilePath = findString(args, "--profile");
+		if (profilePath.has_value() && (jit || engine.value() != Engine::Decoding || batchPath.has_value() || servePath.has_value()))
+		{
+			Logger::LogError("--profile only works with the decode engine, without -j, --batch and --serve. Use -h for help");
+			return std::nullopt;
+		}
+
+		const bool hugePages = findMarker(args, "--huge-pages");
+
+		if (inputPath.has_value() || resumePath.has_value() || batchPath.has_value() || servePath.has_value())
+		{
+			const ParseResult result
+			{
+				.inputPath = inputPath.value_or(""),
+				.outputPath = streams->outputPath,
+				.wordsPath = wordsPath.value_or(""),
+				.userInputPath = streams->userInputPath,
+				.compilePath = compilePath.value_or(""),
+				.emitCppPath = emitCppPath.value_or(""),
+				.checkpointPath = checkpointPath.value_or(""),
+				.checkpointSeconds = checkpointSeconds,
+				.resumePath = resumePath.value_or(""),
+				.batchPath = batchPath.value_or(""),
+				.threads = threads,
+				.lockstep = lockstep,
+				.servePath = servePath.value_or(""),
+				.profilePath = profilePath.value_or(""),
+				.hugePages = hugePages,
+				.userInputFormat = streams->userInputFormat,
+				.engine = engine.value(),
+				.jit = jit,
+				.outputFormat = streams->outputFormat
+			};
+
+			return result;
+		}
+		else
+		{
+			Logger::LogError("Please specify an input path using -i, a checkpoint to resume from using --resume, a manifest using --batch or a socket to serve at using --serve. Use -h for help");
+			return std::nullopt;
+		}
+	}
+
+	std::optional<ParseResult> parseStreams(std::span<const char*> args)
+	{
+		const auto formatName = findString(args, "-f");
+		const auto outputFormat = parseFormat(formatName.value_or("text"));
+		if (!outputFormat.has_value())
+		{
+			const std::string error = "Unknown output format " + formatName.value() + ". Use -h for help";
+			Logger::LogError(error.c_str());
+			return std::nullopt;
+		}
+
+		const auto userInputFormatName = findString(args, "-if");
+		const auto userInputFormat = parseInputFormat(userInputFormatName.value_or("text"));
+		if (!userInputFormat.has_value())
+		{
+			const std::string error = "Unknown input format " + userInputFormatName.value() + ". Use -h for help";
+			Logger::LogError(error.c_str());
+			return std::nullopt;
+		}
+
+		ParseResult result;
+		result.outputPath = findString(args, "-o").value_or("");
+		result.userInputPath = findString(args, "-in").value_or("");
+		result.userInputFormat = userInputFormat.value();
+		result.outputFormat = outputFormat.value();
+		return result;
+	}
+}
@@ -1,17 +1,55 @@
-#pragma once
-#include <optional>
-#include <string>
-#include <span>
-
-namespace Arguments
-{
-	struct ParseResult
-	{
-		std::string inputPath;
-		std::string outputPath;
-		std::string wordsPath;
-	};
-
-	std::optional<ParseResult> parse(std::span<const char*> args);
-}
-
+#pragma once
+#include <optional>
+#include <string>
+#include <span>
+#include "Input.h"
+#include "Output.h"
+
+namespace Arguments
+{
+	//how the instruction tensor gets executed
+	enum class Engine
+	{
+		Decoding,
+		Bytecode
+	};
+
+	struct ParseResult
+	{
+		std::string inputPath;
+		std::string outputPath;
+		std::string wordsPath;
+		std::string userInputPath;
+		//where to write the compiled program image to, instead of running the program, if set
+		std::string compilePath;
+		//where to write the program to as C++, instead of running it, if set
+		std::string emitCppPath;
+		//where to take checkpoints to while running, if set, and how often besides on SIGUSR1
+		std::string checkpointPath;
+		unsigned checkpointSeconds = 600;
+		//the checkpoint to resume a run from instead of starting the program, if set
+		std::string resumePath;
+		//the manifest of jobs to run instead of a single program, if set, and the threads to run them on,
+		//0 for as many as the hardware runs at once
+		std::string batchPath;
+		unsigned threads = 0;
+		//whether batch jobs running the same program run it in lockstep, several to a thread
+		bool lockstep = false;
+		//the Unix domain socket to serve runs at instead of running a single program, if set
+		std::string servePath;
+		//where to write the report of a profiled run to, if set
+		std::string profilePath;
+		//whether large tensors get huge pages, where the system has them
+		bool hugePages = false;
+		Input::Format userInputFormat = Input::Format::Text;
+		Engine engine = Engine::Decoding;
+		bool jit = false;
+		Output::Format outputFormat = Output::Format::Text;
+	};
+
+	std::optional<ParseResult> parse(std::span<const char*> args);
+
+	//only where user input comes from and output goes to (-o, -f, -in and -if), as programs written by --emit-cpp take them
+	std::optional<ParseResult> parseStreams(std::span<const char*> args);
+}
+
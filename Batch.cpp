@@ -0,0 +1,381 @@
+#include "Batch.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "Interpreter.h"
+#include "Bytecode.h"
+#include "Jit.h"
+#include "Lockstep.h"
+#include "InputFileParser.h"
+#include "Dependencies/Files.h"
+#include "Dependencies/Logger/Logger.h"
+
+namespace
+{
+	struct Job
+	{
+		std::string program;
+		std::string input;
+		std::string output;
+		//of the manifest, from 1, to tell the user which job failed
+		size_t line;
+	};
+
+	bool is_space(const char character)
+	{
+		return character == ' ' || (character >= '\t' && character <= '\r');
+	}
+
+	//the jobs in the manifest, skipping blank lines. Logs the first line which does not hold a job
+	std::optional<std::vector<Job>> read_manifest(const std::string& path)
+	{
+		const MappedFile manifest(path);
+		if (!manifest.isOpen())
+		{
+			Logger::LogError("Could not open the batch manifest");
+			return std::nullopt;
+		}
+
+		std::vector<Job> jobs;
+		std::string_view rest = manifest.text();
+		for (size_t line = 1; !rest.empty(); line++)
+		{
+			const size_t line_end = std::min(rest.find('\n'), rest.size());
+			std::string_view text = rest.substr(0, line_end);
+			rest.remove_prefix(std::min(line_end + 1, rest.size()));
+
+			std::vector<std::string> fields;
+			while (true)
+			{
+				const auto first = std::find_if_not(text.begin(), text.end(), is_space);
+				if (first == text.end())
+				{
+					break;
+				}
+				const auto last = std::find_if(first, text.end(), is_space);
+				fields.emplace_back(first, last);
+				text.remove_prefix(static_cast<size_t>(last - text.begin()));
+			}
+
+			if (fields.empty())
+			{
+				continue;
+			}
+			if (fields.size() != 3)
+			{
+				const std::string error = "Line " + std::to_string(line) + " of the batch manifest does not hold the paths of a program, its user input and its output";
+				Logger::LogError(error.c_str());
+				return std::nullopt;
+			}
+			jobs.push_back(Job{ std::move(fields[0]), std::move(fields[1]), std::move(fields[2]), line });
+		}
+		return jobs;
+	}
+
+	//the programs of the batch by their paths. The first job to ask for a program loads it, and jobs asking for it
+	//meanwhile wait for that rather than loading it again. Programs are never written to, jobs share their cells
+	class ProgramCache
+	{
+	public:
+		using Program = std::shared_ptr<const Tensor<Cell>>;
+
+		explicit ProgramCache(std::string given_words_path) : words_path(std::move(given_words_path)) {}
+
+		//the program at the path, or nullptr if it could not be loaded
+		Program get(const std::string& path)
+		{
+			std::promise<Program> loading;
+			std::shared_future<Program> program;
+			bool loads = false;
+			{
+				std::lock_guard lock(mutex);
+				auto [entry, inserted] = programs.try_emplace(path);
+				if (inserted)
+				{
+					entry->second = loading.get_future().share();
+					loads = true;
+				}
+				program = entry->second;
+			}
+
+			if (loads)
+			{
+				std::optional<Tensor<Cell>> loaded = InputFile::load(path, words_path);
+				loading.set_value(loaded.has_value() ? std::make_shared<const Tensor<Cell>>(std::move(loaded).value()) : nullptr);
+			}
+			return program.get();
+		}
+
+	private:
+		std::string words_path;
+		std::mutex mutex;
+		std::map<std::string, std::shared_future<Program>> programs;
+	};
+
+	//runs tasks on a fixed set of threads. Every thread takes the tasks of a queue of its own from the back, and once
+	//that is empty steals from the front of the others', so that threads which got short jobs help out those which got
+	//long ones. Tasks are all queued before the threads start and queue no more, so a thread which finds every queue
+	//empty is done
+	class WorkStealingPool
+	{
+	public:
+		explicit WorkStealingPool(const size_t threads) : queues(threads) {}
+
+		void push(std::function<void()> task)
+		{
+			queues[pushed++ % queues.size()].tasks.push_back(std::move(task));
+		}
+
+		//runs every task, on the calling thread and the others, and returns once they are done
+		void run()
+		{
+			std::vector<std::thread> threads;
+			for (size_t i = 1; i < queues.size(); i++)
+			{
+				threads.emplace_back([this, i] { work(i); });
+			}
+			work(0);
+			for (std::thread& thread : threads)
+			{
+				thread.join();
+			}
+		}
+
+	private:
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		void work(const size_t own)
+		{
+			std::function<void()> task;
+			while (take(own, task))
+			{
+				task();
+			}
+		}
+
+		bool take(const size_t own, std::function<void()>& task)
+		{
+			{
+				Queue& queue = queues[own];
+				std::lock_guard lock(queue.mutex);
+				if (!queue.tasks.empty())
+				{
+					task = std::move(queue.tasks.back());
+					queue.tasks.pop_back();
+					return true;
+				}
+			}
+			for (size_t i = 1; i < queues.size(); i++)
+			{
+				Queue& victim = queues[(own + i) % queues.size()];
+				std::lock_guard lock(victim.mutex);
+				if (!victim.tasks.empty())
+				{
+					task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		std::vector<Queue> queues;
+		size_t pushed = 0;
+	};
+
+	//jobs fail on threads of their own, and a line is logged for each
+	void report(const Job& job, const char* reason)
+	{
+		static std::mutex mutex;
+		const std::string error = "Batch job on line " + std::to_string(job.line) + " (" + job.program + "): " + reason;
+		std::lock_guard lock(mutex);
+		Logger::LogError(error.c_str());
+	}
+
+	bool run_job(const Job& job, ProgramCache& programs, const Arguments::ParseResult& arguments)
+	{
+		const ProgramCache::Program program = programs.get(job.program);
+		if (program == nullptr)
+		{
+			report(job, "the program could not be loaded");
+			return false;
+		}
+
+		Interpreter interpreter(Tensor<Cell>::sharing(program));
+		interpreter.output = Output::Writer::open(job.output, arguments.outputFormat);
+		if (interpreter.output == nullptr)
+		{
+			report(job, "could not open the output file");
+			return false;
+		}
+		interpreter.input = Input::Reader::open(job.input, arguments.userInputFormat, interpreter.output.get());
+		if (interpreter.input == nullptr)
+		{
+			report(job, "could not open the file to read user input from");
+			return false;
+		}
+
+		TickOutcome outcome = TickOutcome::Continue;
+		if (arguments.engine == Arguments::Engine::Bytecode)
+		{
+			outcome = Bytecode::run(interpreter);
+		}
+		else if (arguments.jit)
+		{
+			outcome = Jit::run(interpreter);
+		}
+		else
+		{
+			outcome = interpreter.run();
+		}
+
+		interpreter.output->close();
+		if (outcome != TickOutcome::Halted)
+		{
+			report(job, "the program failed");
+			return false;
+		}
+		return true;
+	}
+
+	//runs jobs of the same program in lockstep, one lane each, and reports those which failed. Gives how many did
+	size_t run_lockstep(std::span<const Job* const> jobs, ProgramCache& programs, const Arguments::ParseResult& arguments)
+	{
+		const ProgramCache::Program program = programs.get(jobs.front()->program);
+		if (program == nullptr)
+		{
+			for (const Job* job : jobs)
+			{
+				report(*job, "the program could not be loaded");
+			}
+			return jobs.size();
+		}
+
+		size_t failed = 0;
+		std::vector<const Job*> running;
+		std::vector<Lockstep::Lane> lanes;
+		for (const Job* job : jobs)
+		{
+			Lockstep::Lane lane;
+			lane.output = Output::Writer::open(job->output, arguments.outputFormat);
+			if (lane.output == nullptr)
+			{
+				report(*job, "could not open the output file");
+				failed++;
+				continue;
+			}
+			lane.input = Input::Reader::open(job->input, arguments.userInputFormat, lane.output.get());
+			if (lane.input == nullptr)
+			{
+				report(*job, "could not open the file to read user input from");
+				failed++;
+				continue;
+			}
+			running.push_back(job);
+			lanes.push_back(std::move(lane));
+		}
+		if (lanes.empty())
+		{
+			return failed;
+		}
+
+		Tensor<Cell> shared = Tensor<Cell>::sharing(program);
+		const std::vector<TickOutcome> outcomes = Lockstep::run(shared, lanes);
+		for (size_t i = 0; i < lanes.size(); i++)
+		{
+			lanes[i].output->close();
+			if (outcomes[i] != TickOutcome::Halted)
+			{
+				report(*running[i], "the program failed");
+				failed++;
+			}
+		}
+		return failed;
+	}
+}
+
+namespace Batch
+{
+	bool run(const Arguments::ParseResult& arguments)
+	{
+		const std::optional<std::vector<Job>> jobs = read_manifest(arguments.batchPath);
+		if (!jobs.has_value())
+		{
+			return false;
+		}
+		if (arguments.jit && !Jit::supported())
+		{
+			Logger::LogMessage("-j: native code can not be generated here, so the programs are only interpreted");
+		}
+
+		const size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+		const size_t threads = std::clamp<size_t>(arguments.threads != 0 ? arguments.threads : hardware_threads, 1, std::max<size_t>(jobs->size(), 1));
+
+		ProgramCache programs(arguments.wordsPath);
+		std::atomic<size_t> failed = 0;
+		WorkStealingPool pool(threads);
+		//jobs running in lockstep go in groups of the same program, in the order of the manifest
+		std::map<std::string, std::vector<const Job*>> by_program;
+		std::vector<std::vector<const Job*>> groups;
+		for (const Job& job : jobs.value())
+		{
+			if (!arguments.lockstep)
+			{
+				pool.push([&job, &programs, &arguments, &failed]
+				{
+					if (!run_job(job, programs, arguments))
+					{
+						failed.fetch_add(1, std::memory_order_relaxed);
+					}
+				});
+				continue;
+			}
+
+			std::vector<const Job*>& group = by_program[job.program];
+			group.push_back(&job);
+			if (group.size() == Lockstep::Width)
+			{
+				groups.push_back(std::move(group));
+				group.clear();
+			}
+		}
+		for (auto& [path, group] : by_program)
+		{
+			if (!group.empty())
+			{
+				groups.push_back(std::move(group));
+			}
+		}
+		for (const std::vector<const Job*>& group : groups)
+		{
+			pool.push([&group, &programs, &arguments, &failed]
+			{
+				failed.fetch_add(run_lockstep(group, programs, arguments), std::memory_order_relaxed);
+			});
+		}
+		pool.run();
+
+		if (failed != 0)
+		{
+			const std::string error = std::to_string(failed.load()) + " of " + std::to_string(jobs->size()) + " batch jobs failed";
+			Logger::LogError(error.c_str());
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "ArgumentParser.h"
+
+//runs many programs at once: a manifest lists jobs, each of them a program with a user input and an output file of its
+//own, which run on a pool of threads. Every program file is loaded once, however many jobs run it, and the jobs read
+//its cells where they lie until they write to them. With --lockstep, the jobs of a program run in groups of up to
+//Lockstep::Width instead, one group to a task. Batch jobs do not take checkpoints
+namespace Batch
+{
+	//runs the jobs in the manifest at the arguments' batch path, with the words, formats and engine the arguments give.
+	//Every line of the manifest holds the paths of a job's program, user input and output, separated by whitespace.
+	//Returns whether the manifest could be read and every job's program halted
+	bool run(const Arguments::ParseResult& arguments);
+}
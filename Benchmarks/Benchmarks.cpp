@@ -0,0 +1,662 @@
+//the benchmark suite: micro-benchmarks of the interpreter's building blocks, and macro-benchmarks which run the
+//programs in Benchmarks/Programs on every engine. Prints a table, writes the results as JSON with --json, and
+//compares them with an earlier JSON given with --baseline, failing if anything got slower than --tolerance allows.
+//It also fails if ticks allocate once a program runs in a steady state.
+//It is built by Benchmarks.vcxproj, or from the repository's root with:
+//g++ -std=c++20 -O2 -pthread -o benchmarks Benchmarks/Benchmarks.cpp Arena.cpp Bytecode.cpp Checkpoint.cpp Input.cpp InputFileParser.cpp
+//	Interpreter.cpp Jit.cpp Lockstep.cpp LoopIdiom.cpp Output.cpp ParensScan.cpp Profiler.cpp ProgramImage.cpp Dependencies/Logger/Logger.cpp
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../Interpreter.h"
+#include "../Bytecode.h"
+#include "../Jit.h"
+#include "../Lockstep.h"
+#include "../InputFileParser.h"
+#include "../Dependencies/Logger/Logger.h"
+
+#if defined(__GNUC__) && !defined(__clang__)
+//GCC takes the free() in the replaced operator delete for a mismatch once it inlines it where operator new was called
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace
+{
+	//every allocation through operator new, counted by the replacements below
+	std::atomic<uint64_t> allocation_count = 0;
+	std::atomic<uint64_t> allocated_bytes = 0;
+}
+
+void* operator new(const size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* memory = std::malloc(size != 0 ? size : 1))
+	{
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](const size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	operator delete(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	operator delete(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	operator delete(memory);
+}
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+#ifdef _WIN32
+	constexpr const char* NullDevice = "NUL";
+#else
+	constexpr const char* NullDevice = "/dev/null";
+#endif
+
+	struct Result
+	{
+		std::string name;
+		//micro-benchmarks count operations, macro-benchmarks count ticks
+		bool macro = false;
+		uint64_t operations = 0;
+		double seconds = 0;
+		uint64_t allocations = 0;
+		uint64_t allocated_bytes = 0;
+		//the most memory resident while the benchmark ran, where the platform can tell
+		std::optional<uint64_t> peak_rss_kb;
+
+		double nanosecondsPerOperation() const
+		{
+			return operations != 0 ? seconds * 1e9 / static_cast<double>(operations) : 0;
+		}
+	};
+
+	//results are kept from being optimized away by adding them up here
+	volatile uint64_t sink = 0;
+
+#ifdef __linux__
+	//makes the peak reported next start from what is resident now
+	void reset_peak_rss()
+	{
+		std::ofstream("/proc/self/clear_refs") << "5";
+	}
+
+	std::optional<uint64_t> peak_rss_kb()
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line))
+		{
+			if (line.starts_with("VmHWM:"))
+			{
+				return std::strtoull(line.c_str() + 6, nullptr, 10);
+			}
+		}
+		return std::nullopt;
+	}
+#else
+	void reset_peak_rss() {}
+
+	std::optional<uint64_t> peak_rss_kb()
+	{
+		return std::nullopt;
+	}
+#endif
+
+	//what a benchmark allocated and how much memory it needed, from when it is made until finish()
+	class Usage
+	{
+	public:
+		Usage()
+		{
+			reset_peak_rss();
+			allocations = allocation_count.load();
+			bytes = allocated_bytes.load();
+		}
+
+		void finish(Result& result) const
+		{
+			result.allocations = allocation_count.load() - allocations;
+			result.allocated_bytes = allocated_bytes.load() - bytes;
+			result.peak_rss_kb = peak_rss_kb();
+		}
+
+	private:
+		uint64_t allocations = 0;
+		uint64_t bytes = 0;
+	};
+
+	//only the benchmarks whose names contain this are run
+	std::string filter;
+
+	bool selected(const std::string& name)
+	{
+		return name.find(filter) != std::string::npos;
+	}
+
+	//runs the operation often enough to take about the given time, three times over, and adds the fastest time to the results
+	template<typename Operation_t>
+	void measure(std::vector<Result>& results, std::string name, Operation_t&& operation, const double target_seconds = 0.2)
+	{
+		if (!selected(name))
+		{
+			return;
+		}
+
+		auto time = [&operation](const uint64_t iterations)
+		{
+			const Clock::time_point start = Clock::now();
+			for (uint64_t i = 0; i < iterations; i++)
+			{
+				sink = sink + operation(i);
+			}
+			return std::chrono::duration<double>(Clock::now() - start).count();
+		};
+
+		uint64_t iterations = 1;
+		double seconds = time(iterations);
+		while (seconds < target_seconds / 8)
+		{
+			iterations *= 2;
+			seconds = time(iterations);
+		}
+		iterations = std::max<uint64_t>(1, static_cast<uint64_t>(static_cast<double>(iterations) * target_seconds / seconds));
+
+		Result result;
+		result.name = std::move(name);
+		result.operations = iterations;
+		Usage usage;
+		result.seconds = time(iterations);
+		for (int repeat = 1; repeat < 3; repeat++)
+		{
+			result.seconds = std::min(result.seconds, time(iterations));
+		}
+		usage.finish(result);
+		results.push_back(std::move(result));
+	}
+
+	std::vector<Result> run_micro_benchmarks()
+	{
+		std::vector<Result> results;
+		std::mt19937 random(12);
+
+		//the cells of a dense 2-D tensor at random coordinates, which is what looking cells up comes down to
+		Tensor<Cell> tensor;
+		tensor.reserve(std::vector<int>{ 512, 512 }, 512 * 512);
+		for (int y = 0; y < 512; y++)
+		{
+			for (int x = 0; x < 512; x++)
+			{
+				tensor.set(Coordinates(x, y), Cell(x ^ y));
+			}
+		}
+		std::vector<Coordinates> coordinates;
+		for (int i = 0; i < 4096; i++)
+		{
+			coordinates.push_back(Coordinates(static_cast<int>(random() % 512), static_cast<int>(random() % 512)));
+		}
+		measure(results, "tensor_read", [&](const uint64_t i)
+		{
+			return static_cast<uint64_t>(tensor.read(coordinates[i % coordinates.size()]).bits());
+		});
+		TensorHandle<Cell> handle = tensor.handleAtCoordinates(Coordinates(7, 9));
+		measure(results, "tensor_write_handle", [&](const uint64_t i)
+		{
+			tensor.set(handle, Cell(static_cast<int>(i & 0xffff) + 1));
+			return uint64_t{ 1 };
+		});
+
+		//a tensor used as a buffer which instruction 11 clears: filled with a 64 by 64 block, then shrunk
+		Tensor<Cell> buffer;
+		measure(results, "tensor_shrink_refill", [&](const uint64_t i)
+		{
+			for (int y = 0; y < 64; y++)
+			{
+				for (int x = 0; x < 64; x++)
+				{
+					buffer.set(Coordinates(x, y), Cell(static_cast<int>(i) + x + 1));
+				}
+			}
+			const size_t filled = buffer.size();
+			buffer.shrink();
+			return static_cast<uint64_t>(filled);
+		});
+
+		Coordinates moving(0, 0);
+		const Coordinates diagonal(1, 1);
+		const std::vector<int> dimensions = { 256, 255 };
+		measure(results, "coordinates_increment", [&](uint64_t)
+		{
+			return static_cast<uint64_t>(moving.increment(diagonal, dimensions)[0]);
+		});
+		const CoordinatesStepper stepper(diagonal, dimensions);
+		measure(results, "coordinates_step", [&](uint64_t)
+		{
+			return static_cast<uint64_t>(stepper.step(moving)[0]);
+		});
+
+		//equality ignores trailing zeros, so the pairs differ in rank
+		const std::vector<std::pair<Coordinates, Coordinates>> pairs =
+		{
+			{ Coordinates(3, 4), Coordinates(std::vector<int>{ 3, 4, 0 }) },
+			{ Coordinates(std::vector<int>{ 3, 4, 0, 0 }), Coordinates(3, 4) },
+			{ Coordinates(3, 4), Coordinates(3, 5) },
+			{ Coordinates(0), Coordinates() }
+		};
+		measure(results, "coordinates_equal", [&](const uint64_t i)
+		{
+			const auto& [lhs, rhs] = pairs[i % pairs.size()];
+			return static_cast<uint64_t>(Coordinates::equal(lhs, rhs));
+		});
+
+		//a long parens group, paired from the cache, and scanned anew after a write to the instruction tensor
+		std::string parens_program = "1 (";
+		for (int i = 0; i < 2000; i++)
+		{
+			parens_program += " " + std::to_string(i % 7);
+		}
+		parens_program += " ) 5 ( )";
+		Interpreter interpreter(InputFile::parse(parens_program, {}, 1).value());
+		const Coordinates opening({ 1 });
+		measure(results, "pair_parens_cached", [&](uint64_t)
+		{
+			return static_cast<uint64_t>(interpreter.pairParens(opening).numbers.size());
+		});
+		const Coordinates written({ 2 });
+		measure(results, "pair_parens_scan", [&](const uint64_t i)
+		{
+			interpreter.instructionTensor().set(written, Cell(static_cast<int>(i % 7)));
+			return static_cast<uint64_t>(interpreter.pairParens(opening).numbers.size());
+		});
+
+		//a program of about a megabyte, parsed on one thread and on as many as the parser picks
+		std::string text;
+		for (int row = 0; row < 400; row++)
+		{
+			for (int column = 0; column < 400; column++)
+			{
+				text += column % 9 == 0 ? "( " : column % 9 == 8 ? ") " : std::to_string((row * column) % 12) + " ";
+			}
+			text += '\n';
+		}
+		measure(results, "input_file_parse", [&](uint64_t)
+		{
+			return static_cast<uint64_t>(InputFile::parse(text, {}, 1)->size());
+		}, 0.5);
+		measure(results, "input_file_parse_threaded", [&](uint64_t)
+		{
+			return static_cast<uint64_t>(InputFile::parse(text, {})->size());
+		}, 0.5);
+		return results;
+	}
+
+	enum class Engine
+	{
+		Decoding,
+		Bytecode,
+		Jit,
+		Lockstep
+	};
+
+	//runs the program on the engine, with its user input read from the file at the path if it is set.
+	//Counts ticks on the decoding path, which the other engines take just as many of. Returns nullopt if the
+	//program does not halt
+	std::optional<Result> run_program(const std::string& name, const Tensor<Cell>& program, const std::string& input_path, const Engine engine, uint64_t& ticks)
+	{
+		Interpreter interpreter{ Tensor<Cell>(program) };
+		interpreter.output = Output::Writer::open(NullDevice, Output::Format::Text);
+		if (!input_path.empty())
+		{
+			interpreter.input = Input::Reader::open(input_path, Input::Format::Text, interpreter.output.get());
+		}
+
+		Result result;
+		result.name = name;
+		result.macro = true;
+		Usage usage;
+		const Clock::time_point start = Clock::now();
+		TickOutcome outcome = TickOutcome::Continue;
+		switch (engine)
+		{
+		case Engine::Decoding:
+			ticks = 0;
+			while (outcome == TickOutcome::Continue)
+			{
+				outcome = interpreter.tick();
+				ticks++;
+			}
+			break;
+		case Engine::Bytecode:
+			outcome = Bytecode::run(interpreter);
+			break;
+		case Engine::Jit:
+			outcome = Jit::run(interpreter);
+			break;
+		case Engine::Lockstep:
+		{
+			std::vector<Lockstep::Lane> lanes(Lockstep::Width);
+			for (Lockstep::Lane& lane : lanes)
+			{
+				lane.output = Output::Writer::open(NullDevice, Output::Format::Text);
+				if (!input_path.empty())
+				{
+					lane.input = Input::Reader::open(input_path, Input::Format::Text, lane.output.get());
+				}
+			}
+			Tensor<Cell> lane_program(program);
+			const std::vector<TickOutcome> outcomes = Lockstep::run(lane_program, lanes);
+			outcome = std::all_of(outcomes.begin(), outcomes.end(), [](const TickOutcome lane) { return lane == TickOutcome::Halted; })
+				? TickOutcome::Halted : TickOutcome::Failed;
+			for (Lockstep::Lane& lane : lanes)
+			{
+				lane.output->close();
+			}
+		}
+		break;
+		}
+		interpreter.output->close();
+		result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		usage.finish(result);
+		//every lane takes the ticks, so lockstep is timed per tick of one lane
+		result.operations = engine == Engine::Lockstep ? ticks * Lockstep::Width : ticks;
+
+		if (outcome != TickOutcome::Halted)
+		{
+			return std::nullopt;
+		}
+		return result;
+	}
+
+	//every program in the corpus, on every engine. A program reads its user input from the file of its name
+	//ending in .in, if there is one
+	std::optional<std::vector<Result>> run_macro_benchmarks(const std::filesystem::path& corpus)
+	{
+		std::vector<std::filesystem::path> programs;
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(corpus, error))
+		{
+			if (entry.path().extension() == ".txt")
+			{
+				programs.push_back(entry.path());
+			}
+		}
+		if (error || programs.empty())
+		{
+			Logger::LogError("Could not find the benchmark programs. Give their directory with --corpus");
+			return std::nullopt;
+		}
+		std::sort(programs.begin(), programs.end());
+
+		std::vector<Result> results;
+		for (const std::filesystem::path& path : programs)
+		{
+			const std::optional<Tensor<Cell>> program = InputFile::load(path.string(), "");
+			if (!program.has_value())
+			{
+				return std::nullopt;
+			}
+			std::filesystem::path input = path;
+			input.replace_extension(".in");
+			const std::string input_path = std::filesystem::exists(input) ? input.string() : std::string();
+
+			//the decoding path counts the ticks for the other engines, so it runs whenever any of them does
+			const std::string program_name = path.stem().string();
+			constexpr std::array<std::pair<Engine, const char*>, 4> Engines = { { { Engine::Decoding, "decode" }, { Engine::Bytecode, "bytecode" }, { Engine::Jit, "jit" },
+				{ Engine::Lockstep, "lockstep" } } };
+			if (std::none_of(Engines.begin(), Engines.end(), [&program_name](const auto& engine) { return selected(program_name + "/" + engine.second); }))
+			{
+				continue;
+			}
+
+			uint64_t ticks = 0;
+			for (const auto& [engine, engine_name] : Engines)
+			{
+				const std::string name = program_name + "/" + engine_name;
+				if (engine != Engine::Decoding && !selected(name))
+				{
+					continue;
+				}
+				std::optional<Result> result = run_program(name, program.value(), input_path, engine, ticks);
+				if (!result.has_value())
+				{
+					Logger::LogErrorFormatted("The benchmark program %s did not halt", path.string().c_str());
+					return std::nullopt;
+				}
+				if (selected(name))
+				{
+					results.push_back(std::move(result).value());
+				}
+			}
+		}
+		return results;
+	}
+
+	//runs tight_loop on the decoding path for some ticks and for ten times as many, which allocate just as often if
+	//ticks do not allocate once the program's tensors have grown. Returns false if they did, or the program is missing.
+	//Ticks which write to the instruction tensor are exempt: the write invalidates the tensor's parens pairings, which
+	//are cached anew in allocated entries, so self_modifying allocates on every pass and is not checked
+	bool check_tick_allocations(const std::filesystem::path& corpus)
+	{
+		const std::filesystem::path path = corpus / "tight_loop.txt";
+		const std::optional<Tensor<Cell>> program = InputFile::load(path.string(), "");
+		if (!program.has_value())
+		{
+			return false;
+		}
+		std::filesystem::path input = path;
+		input.replace_extension(".in");
+
+		constexpr uint64_t Ticks = 100000;
+		//the first run also makes what the process sets up once, so it is only counted for comparing with
+		std::array<uint64_t, 3> allocations{};
+		for (size_t run = 0; run < allocations.size(); run++)
+		{
+			const uint64_t before = allocation_count.load();
+			Interpreter interpreter{ Tensor<Cell>(program.value()) };
+			interpreter.output = Output::Writer::open(NullDevice, Output::Format::Text);
+			interpreter.input = Input::Reader::open(input.string(), Input::Format::Text, interpreter.output.get());
+			TickOutcome outcome = TickOutcome::Continue;
+			for (uint64_t tick = 0; outcome == TickOutcome::Continue && tick < (run == 2 ? Ticks * 10 : Ticks); tick++)
+			{
+				outcome = interpreter.tick();
+			}
+			if (outcome != TickOutcome::Continue)
+			{
+				Logger::LogErrorFormatted("The benchmark program %s ended before the allocations were counted", path.string().c_str());
+				return false;
+			}
+			allocations[run] = allocation_count.load() - before;
+		}
+
+		std::printf("%-32s %llu allocations in %llu ticks, %llu in %llu\n", "tick_allocations", static_cast<unsigned long long>(allocations[1]),
+			static_cast<unsigned long long>(Ticks), static_cast<unsigned long long>(allocations[2]), static_cast<unsigned long long>(Ticks * 10));
+		if (allocations[1] != allocations[2])
+		{
+			Logger::LogError("Ticks allocate in a steady state");
+			return false;
+		}
+		return true;
+	}
+
+	//the results as JSON, one result to a line so that read_baseline can pick them out again
+	void write_json(std::ostream& stream, const std::vector<Result>& results)
+	{
+		stream << "{\n\t\"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Result& result = results[i];
+			stream << "\t\t{ \"name\": \"" << result.name << "\", \"kind\": \"" << (result.macro ? "macro" : "micro") << "\""
+				<< ", \"" << (result.macro ? "ticks" : "operations") << "\": " << result.operations
+				<< ", \"seconds\": " << result.seconds
+				<< ", \"" << (result.macro ? "ns_per_tick" : "ns_per_op") << "\": " << result.nanosecondsPerOperation();
+			if (result.macro)
+			{
+				stream << ", \"ticks_per_second\": " << (result.seconds > 0 ? static_cast<double>(result.operations) / result.seconds : 0);
+			}
+			stream << ", \"peak_rss_kb\": ";
+			if (result.peak_rss_kb.has_value())
+			{
+				stream << result.peak_rss_kb.value();
+			}
+			else
+			{
+				stream << "null";
+			}
+			stream << ", \"allocations\": " << result.allocations << ", \"allocated_bytes\": " << result.allocated_bytes
+				<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		stream << "\t]\n}\n";
+	}
+
+	//the time per operation or tick of every result in JSON written by write_json, by name
+	std::optional<std::vector<std::pair<std::string, double>>> read_baseline(const std::string& path)
+	{
+		std::ifstream stream(path);
+		if (!stream.is_open())
+		{
+			Logger::LogError("Could not open the baseline");
+			return std::nullopt;
+		}
+
+		std::vector<std::pair<std::string, double>> baseline;
+		std::string line;
+		while (std::getline(stream, line))
+		{
+			constexpr std::string_view NameKey = "\"name\": \"";
+			const size_t name = line.find(NameKey);
+			size_t time = line.find("\"ns_per_op\": ");
+			if (time == std::string::npos)
+			{
+				time = line.find("\"ns_per_tick\": ");
+			}
+			if (name == std::string::npos || time == std::string::npos)
+			{
+				continue;
+			}
+			const size_t name_start = name + NameKey.size();
+			const size_t name_end = line.find('"', name_start);
+			baseline.emplace_back(line.substr(name_start, name_end - name_start), std::strtod(line.c_str() + line.find(' ', time) + 1, nullptr));
+		}
+		return baseline;
+	}
+
+	std::optional<std::string> find_option(const std::span<const char*> args, const std::string_view option)
+	{
+		for (size_t i = 0; i + 1 < args.size(); i++)
+		{
+			if (args[i] == option)
+			{
+				return args[i + 1];
+			}
+		}
+		return std::nullopt;
+	}
+}
+
+int main(const int argc, const char** argv)
+{
+	const std::span<const char*> args(argv, argc);
+	if (std::find_if(args.begin(), args.end(), [](const char* arg) { return std::string_view(arg) == "-h"; }) != args.end())
+	{
+		Logger::LogMessage("--corpus: optional, the directory of the programs to run, Benchmarks/Programs by default");
+		Logger::LogMessage("--filter: optional, only runs the benchmarks whose names contain the given text");
+		Logger::LogMessage("--json: optional, the path to write the results to as JSON");
+		Logger::LogMessage("--baseline: optional, JSON written by an earlier run to compare the results with");
+		Logger::LogMessage("--tolerance: optional, how much slower than the baseline a result may be, as a fraction. 0.1 by default");
+		return 0;
+	}
+	const std::string corpus = find_option(args, "--corpus").value_or("Benchmarks/Programs");
+	filter = find_option(args, "--filter").value_or("");
+	const double tolerance = std::strtod(find_option(args, "--tolerance").value_or("0.1").c_str(), nullptr);
+
+	std::vector<Result> results = run_micro_benchmarks();
+	std::optional<std::vector<Result>> macro_results = run_macro_benchmarks(corpus);
+	if (!macro_results.has_value())
+	{
+		return 1;
+	}
+	results.insert(results.end(), macro_results->begin(), macro_results->end());
+
+	std::optional<std::vector<std::pair<std::string, double>>> baseline;
+	if (const auto baseline_path = find_option(args, "--baseline"))
+	{
+		baseline = read_baseline(baseline_path.value());
+		if (!baseline.has_value())
+		{
+			return 1;
+		}
+	}
+
+	bool regressed = false;
+	std::printf("%-32s %14s %14s %12s %12s %14s %10s\n", "benchmark", "ns/op", "ticks/s", "peak RSS kB", "allocations", "allocated B", "baseline");
+	for (const Result& result : results)
+	{
+		std::printf("%-32s %14.2f ", result.name.c_str(), result.nanosecondsPerOperation());
+		if (result.macro)
+		{
+			std::printf("%14.4g ", static_cast<double>(result.operations) / result.seconds);
+		}
+		else
+		{
+			std::printf("%14s ", "-");
+		}
+		std::printf("%12s %12llu %14llu ", result.peak_rss_kb.has_value() ? std::to_string(result.peak_rss_kb.value()).c_str() : "-",
+			static_cast<unsigned long long>(result.allocations), static_cast<unsigned long long>(result.allocated_bytes));
+
+		const auto compared = baseline.has_value()
+			? std::find_if(baseline->begin(), baseline->end(), [&result](const auto& entry) { return entry.first == result.name; })
+			: std::vector<std::pair<std::string, double>>::iterator();
+		if (baseline.has_value() && compared != baseline->end() && compared->second > 0)
+		{
+			const double change = result.nanosecondsPerOperation() / compared->second - 1;
+			const bool slower = change > tolerance;
+			regressed = regressed || slower;
+			std::printf("%+9.1f%%%s", change * 100, slower ? " REGRESSION" : "");
+		}
+		std::printf("\n");
+	}
+
+	if (const auto json_path = find_option(args, "--json"))
+	{
+		std::ofstream json(json_path.value());
+		write_json(json, results);
+		if (!json)
+		{
+			Logger::LogError("Could not write the results");
+			return 1;
+		}
+	}
+	const bool allocating = selected("tick_allocations") && !check_tick_allocations(corpus);
+	return regressed || allocating ? 1 : 0;
+}
@@ -0,0 +1,598 @@
+#include "Bytecode.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <unordered_map>
+#include "InstructionKey.h"
+#include "Checkpoint.h"
+
+//labels as values let every decoded instruction jump straight to the next one's handler.
+//Other compilers dispatch through a switch instead
+#if defined(__GNUC__)
+#define DODECAMORPH_THREADED_DISPATCH 1
+#else
+#define DODECAMORPH_THREADED_DISPATCH 0
+#endif
+
+namespace
+{
+	enum class Opcode : unsigned char
+	{
+		Output,
+		MoveDataCursor,
+		SetDataTensor,
+		Increment,
+		Decrement,
+		Input,
+		InterpretIfZero,
+		SetOpeningParens,
+		SetClosingParens,
+		Interpret,
+		Jump,
+		Exit,
+		Halt,
+		//superinstructions the lowered runs are fused into
+		FusedAdd,
+		FusedMove
+	};
+
+	struct Op
+	{
+		Opcode opcode = Opcode::Halt;
+		//the cell of the instruction, or where execution goes on for Exit
+		Coordinates position;
+		//the paired numbers of MoveDataCursor and SetDataTensor, and their sum for FusedMove
+		Coordinates operand;
+		//the index of the op Jump continues at
+		size_t target = 0;
+		//what FusedAdd adds to an int, and to the 0 that parens become at its first increment or decrement
+		int delta = 0;
+		int delta_after_reset = 0;
+		//the moves FusedMove is made of, and 1 or -1 if none of them has a negative or positive number
+		std::vector<Coordinates> steps;
+		int sign = 0;
+		const void* handler = nullptr;
+
+		static Op at(const Opcode opcode, const Coordinates& position)
+		{
+			Op op;
+			op.opcode = opcode;
+			op.position = position;
+			return op;
+		}
+	};
+
+	struct Run
+	{
+		TensorVersion version;
+		std::vector<Op> ops;
+		bool linked = false;
+	};
+
+	class Engine
+	{
+	public:
+		explicit Engine(Interpreter& given_interpreter) : interpreter(given_interpreter) {}
+
+		TickOutcome run()
+		{
+			TickOutcome outcome = TickOutcome::Continue;
+			while (outcome == TickOutcome::Continue)
+			{
+				Checkpoint::poll(interpreter);
+				outcome = fallback_ticks > 0 ? interpretTick() : executeRun();
+			}
+			return outcome;
+		}
+
+	private:
+		//runs longer than this are cut, and go on in another run
+		static constexpr size_t MaxRunLength = 1024;
+		//after the program writes to its instruction tensor, lowering is put off until it has
+		//left the tensor alone for this many ticks, so that self-modifying loops do not lower every iteration
+		static constexpr size_t FallbackTicks = 256;
+
+		TickOutcome interpretTick()
+		{
+			const Coordinates tensor_index = interpreter.instruction_cursor.tensor_index;
+			const TensorVersion version = interpreter.instructionTensor().version();
+			const TickOutcome outcome = interpreter.tick();
+
+			const bool rewritten = Coordinates::equal(tensor_index, interpreter.instruction_cursor.tensor_index)
+				&& interpreter.instructionTensor().version() != version;
+			fallback_ticks = rewritten ? FallbackTicks : fallback_ticks - 1;
+			return outcome;
+		}
+
+		TickOutcome executeRun()
+		{
+			const Coordinates movement = interpreter.currentMovement();
+			Run& run = runs.entryFor(interpreter.instruction_cursor.tensor_index, interpreter.instruction_cursor.cell_index, movement);
+			if (run.ops.empty() || run.version != interpreter.instructionTensor().version())
+			{
+				lower(run, movement);
+				fuse(run);
+			}
+			return execute(run);
+		}
+
+		//follows the instruction cursor from its cell, the way ticking would, until an instruction that
+		//changes the direction or the instruction tensor, a cell the run already went through, or a halt
+		void lower(Run& run, const Coordinates& movement)
+		{
+			run.ops.clear();
+			run.linked = false;
+
+			Tensor<Cell>& instruction_tensor = interpreter.instructionTensor();
+			std::unordered_map<Coordinates, size_t, CoordinatesHash, CoordinatesEqual> lowered_at;
+			Coordinates position = interpreter.instruction_cursor.cell_index;
+
+			auto emit = [&run](const Opcode opcode, const Coordinates& at) -> Op&
+			{
+				run.ops.push_back(Op::at(opcode, at));
+				return run.ops.back();
+			};
+
+			auto next_after = [&](Coordinates index)
+			{
+				return index.increment(movement, instruction_tensor.getDimensions());
+			};
+
+			auto paired_numbers = [&](const Coordinates& at)
+			{
+				const PairedParens& paired_parens = interpreter.pairParens(next_after(at));
+				return paired_parens.closing_parens_index.has_value() ? paired_parens.numbers : Coordinates();
+			};
+
+			while (true)
+			{
+				if (const auto it = lowered_at.find(position); it != lowered_at.end())
+				{
+					emit(Opcode::Jump, position).target = it->second;
+					break;
+				}
+				if (run.ops.size() >= MaxRunLength)
+				{
+					emit(Opcode::Exit, position);
+					break;
+				}
+				lowered_at.emplace(position.canonical(), run.ops.size());
+
+				//pairing may read cells the tensor does not cover yet, so the cell is copied out first
+				const Cell cell = instruction_tensor.read(position);
+				//where the cursor is once the tick is over
+				Coordinates next = next_after(position);
+				bool lowered = true;
+
+				if (holds_alternative<int>(cell))
+				{
+					switch (static_cast<Instruction>(get<0>(cell) % Instruction::InstructionCount))
+					{
+					case OutputCurrentData: emit(Opcode::Output, position); break;
+					case IncrementDataCursorCellIndex: emit(Opcode::MoveDataCursor, position).operand = paired_numbers(position); break;
+					case SetDataCursorTensorIndex: emit(Opcode::SetDataTensor, position).operand = paired_numbers(position); break;
+					case IncrementDataCell: emit(Opcode::Increment, position); break;
+					case DecrementDataCell: emit(Opcode::Decrement, position); break;
+					case SetDataCellUserInput: emit(Opcode::Input, position); break;
+					case ConditionalSetInstructionCursorCellIndex:
+						//only the jump is left to the decoding path, but the pairing reads the same cells either way
+						paired_numbers(position);
+						emit(Opcode::InterpretIfZero, position);
+						break;
+					case SetDataCellOpeningParens: emit(Opcode::SetOpeningParens, position); break;
+					case SetDataCellClosingParens: emit(Opcode::SetClosingParens, position); break;
+					case SetInstructionCursorDirection:
+					case SetInstructionCursorTensorIndex:
+					case ShrinkTensor:
+						lowered = false;
+						break;
+					default:
+						//negative numbers are not instructions
+						break;
+					}
+				}
+				else if (holds_alternative<OpeningParens>(cell))
+				{
+					//executing opening parens skips to their closing parens, which is where the tick moves on from
+					const std::optional<Coordinates> closing_parens_index = interpreter.pairParens(position).closing_parens_index;
+					if (closing_parens_index.has_value())
+					{
+						next = next_after(closing_parens_index.value());
+					}
+					else
+					{
+						lowered = false;
+					}
+				}
+
+				if (!lowered)
+				{
+					emit(Opcode::Interpret, position);
+					break;
+				}
+				if (Coordinates::equal(next, position))
+				{
+					emit(Opcode::Halt, position);
+					break;
+				}
+				position = next;
+			}
+
+			//pairing may have grown the dimensions, which does not change the run
+			run.version = instruction_tensor.version();
+		}
+
+		//fuses runs of increments and decrements of the data cell into one FusedAdd, and runs of data cursor moves
+		//into one FusedMove. Ops a Jump continues at start a new run, so that every jump still lands on an op
+		void fuse(Run& run)
+		{
+			std::vector<bool> jumped_to(run.ops.size(), false);
+			for (const Op& op : run.ops)
+			{
+				if (op.opcode == Opcode::Jump)
+				{
+					jumped_to[op.target] = true;
+				}
+			}
+
+			auto adds = [](const Op& op)
+			{
+				return op.opcode == Opcode::Increment || op.opcode == Opcode::Decrement;
+			};
+
+			std::vector<Op> fused;
+			std::vector<size_t> fused_index(run.ops.size());
+			for (size_t i = 0; i < run.ops.size(); )
+			{
+				fused_index[i] = fused.size();
+				size_t end = i + 1;
+				if (adds(run.ops[i]))
+				{
+					while (end < run.ops.size() && adds(run.ops[end]) && !jumped_to[end])
+					{
+						end++;
+					}
+				}
+				else if (run.ops[i].opcode == Opcode::MoveDataCursor)
+				{
+					while (end < run.ops.size() && run.ops[end].opcode == Opcode::MoveDataCursor && !jumped_to[end] && summable(run.ops.begin() + i, run.ops.begin() + end + 1))
+					{
+						end++;
+					}
+				}
+
+				if (end - i == 1)
+				{
+					fused.push_back(std::move(run.ops[i]));
+				}
+				else if (adds(run.ops[i]))
+				{
+					Op& add = fused.emplace_back(Op::at(Opcode::FusedAdd, run.ops[i].position));
+					for (size_t j = i; j < end; j++)
+					{
+						const int delta = run.ops[j].opcode == Opcode::Increment ? 1 : -1;
+						add.delta = wrapping_add(add.delta, delta);
+						add.delta_after_reset = j == i ? 0 : wrapping_add(add.delta_after_reset, delta);
+					}
+				}
+				else
+				{
+					Op& move = fused.emplace_back(Op::at(Opcode::FusedMove, run.ops[i].position));
+					move.sign = signOf(run.ops.begin() + i, run.ops.begin() + end);
+					for (size_t j = i; j < end; j++)
+					{
+						Coordinates& step = move.steps.emplace_back(std::move(run.ops[j].operand));
+						move.operand.resize(std::max(move.operand.size(), step.size()));
+						for (size_t k = 0; k < step.size(); k++)
+						{
+							move.operand[k] += step[k];
+						}
+					}
+				}
+				i = end;
+			}
+
+			for (Op& op : fused)
+			{
+				if (op.opcode == Opcode::Jump)
+				{
+					op.target = fused_index[op.target];
+				}
+			}
+			run.ops = std::move(fused);
+		}
+
+		//1 if no move in the range has a negative number, -1 if none has a positive one, and 0 otherwise
+		template<typename Iterator_t>
+		static int signOf(Iterator_t begin, Iterator_t end)
+		{
+			bool negative = false;
+			bool positive = false;
+			for (Iterator_t it = begin; it != end; ++it)
+			{
+				for (const int number : it->operand)
+				{
+					negative |= number < 0;
+					positive |= number > 0;
+				}
+			}
+			return negative ? (positive ? 0 : -1) : 1;
+		}
+
+		//whether every coordinate of the index is on the given side of 0, or 0
+		static bool onSide(const Coordinates& index, const int sign)
+		{
+			for (const int coordinate : index)
+			{
+				if (sign > 0 ? coordinate < 0 : coordinate > 0)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		//moves the index by the sum of fused moves the way Coordinates::increment would, but adding in 64 bits: an
+		//index near the end of its dimension plus the sum may overflow an int where each move, wrapped in between, does not
+		static void moveBySum(Coordinates& index, const Coordinates& sum, const std::vector<int>& dimensions)
+		{
+			index.resize(std::max(index.size(), sum.size()));
+			for (size_t i = 0; i < index.size(); i++)
+			{
+				const int dimension = i < dimensions.size() ? dimensions[i] : 1;
+				const int64_t addend = i < sum.size() ? sum[i] : 0;
+				index[i] = static_cast<int>((int64_t{ index[i] } + addend) % dimension);
+			}
+		}
+
+		//whether the moves in the range can be fused: moving by their sum, for indices on the side of 0 they move to,
+		//is only the same as moving by each of them if none of them wraps around the other way, and the sum fits
+		template<typename Iterator_t>
+		static bool summable(Iterator_t begin, Iterator_t end)
+		{
+			if (signOf(begin, end) == 0)
+			{
+				return false;
+			}
+			std::vector<long long> sum;
+			for (Iterator_t it = begin; it != end; ++it)
+			{
+				sum.resize(std::max(sum.size(), it->operand.size()), 0);
+				for (size_t k = 0; k < it->operand.size(); k++)
+				{
+					sum[k] += it->operand[k];
+					if (sum[k] > INT_MAX || sum[k] < INT_MIN)
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		//finishes the tick of an instruction which wrote to the instruction tensor. The rest of the run may be
+		//stale now, so the instruction cursor moves on from the instruction's cell and the decoding path takes over
+		TickOutcome leaveAfter(const Op& op)
+		{
+			fallback_ticks = FallbackTicks;
+			interpreter.instruction_cursor.cell_index = op.position;
+			interpreter.advanceIndex(interpreter.instruction_cursor.cell_index);
+			return Coordinates::equal(op.position, interpreter.instruction_cursor.cell_index) ? TickOutcome::Halted : TickOutcome::Continue;
+		}
+
+		TickOutcome interpretAt(const Op& op)
+		{
+			interpreter.instruction_cursor.cell_index = op.position;
+			return interpreter.tick();
+		}
+
+		TickOutcome execute(Run& run)
+		{
+#if DODECAMORPH_THREADED_DISPATCH
+			//in the order of Opcode
+			static const void* const handlers[] =
+			{
+				&&Output, &&MoveDataCursor, &&SetDataTensor, &&Increment, &&Decrement, &&Input, &&InterpretIfZero,
+				&&SetOpeningParens, &&SetClosingParens, &&Interpret, &&Jump, &&Exit, &&Halt,
+				&&FusedAdd, &&FusedMove
+			};
+			if (!run.linked)
+			{
+				for (Op& op : run.ops)
+				{
+					op.handler = handlers[static_cast<size_t>(op.opcode)];
+				}
+				run.linked = true;
+			}
+#define OPCODE(name) name:
+#define DISPATCH() goto *op->handler
+#else
+#define OPCODE(name) case Opcode::name:
+#define DISPATCH() continue
+#endif
+#define NEXT() ++op; DISPATCH()
+
+			Cursor& instruction_cursor = interpreter.instruction_cursor;
+			Cursor& data_cursor = interpreter.data_cursor;
+			const Op* op = run.ops.data();
+			//only data instructions on the instruction tensor itself can make the run stale
+			bool on_instruction_tensor = Coordinates::equal(data_cursor.tensor_index, instruction_cursor.tensor_index);
+			auto rewrote = [&](const Tensor<Cell>& data_tensor)
+			{
+				return on_instruction_tensor && data_tensor.version() != run.version;
+			};
+
+#if DODECAMORPH_THREADED_DISPATCH
+			DISPATCH();
+#else
+			while (true)
+			{
+				switch (op->opcode)
+				{
+#endif
+				OPCODE(Output)
+				{
+					Tensor<Cell>& data_tensor = interpreter.dataTensor();
+					interpreter.outputCell(data_tensor.read(interpreter.cellHandleOf(data_cursor)));
+					if (rewrote(data_tensor))
+					{
+						return leaveAfter(*op);
+					}
+					NEXT();
+				}
+				OPCODE(MoveDataCursor)
+				{
+					data_cursor.cell_index.increment(op->operand, interpreter.dataTensor().getDimensions());
+					NEXT();
+				}
+				OPCODE(SetDataTensor)
+				{
+					data_cursor.tensor_index = op->operand;
+					on_instruction_tensor = Coordinates::equal(data_cursor.tensor_index, instruction_cursor.tensor_index);
+					NEXT();
+				}
+				OPCODE(Increment)
+				{
+					Tensor<Cell>& data_tensor = interpreter.dataTensor();
+					data_tensor.set(interpreter.cellHandleOf(data_cursor), incremented_cell(data_tensor.read(interpreter.cellHandleOf(data_cursor))));
+					if (rewrote(data_tensor))
+					{
+						return leaveAfter(*op);
+					}
+					NEXT();
+				}
+				OPCODE(Decrement)
+				{
+					Tensor<Cell>& data_tensor = interpreter.dataTensor();
+					data_tensor.set(interpreter.cellHandleOf(data_cursor), decremented_cell(data_tensor.read(interpreter.cellHandleOf(data_cursor))));
+					if (rewrote(data_tensor))
+					{
+						return leaveAfter(*op);
+					}
+					NEXT();
+				}
+				OPCODE(Input)
+				{
+					const int user_input = interpreter.readUserInput();
+					Tensor<Cell>& data_tensor = interpreter.dataTensor();
+					data_tensor.set(interpreter.cellHandleOf(data_cursor), user_input);
+					if (rewrote(data_tensor))
+					{
+						return leaveAfter(*op);
+					}
+					NEXT();
+				}
+				OPCODE(InterpretIfZero)
+				{
+					Tensor<Cell>& data_tensor = interpreter.dataTensor();
+					const Cell& data_cell = data_tensor.read(interpreter.cellHandleOf(data_cursor));
+					if (holds_alternative<int>(data_cell) && get<0>(data_cell) == 0)
+					{
+						return interpretAt(*op);
+					}
+					if (rewrote(data_tensor))
+					{
+						return leaveAfter(*op);
+					}
+					NEXT();
+				}
+				OPCODE(SetOpeningParens)
+				{
+					Tensor<Cell>& data_tensor = interpreter.dataTensor();
+					data_tensor.set(interpreter.cellHandleOf(data_cursor), OpeningParens{});
+					if (rewrote(data_tensor))
+					{
+						return leaveAfter(*op);
+					}
+					NEXT();
+				}
+				OPCODE(SetClosingParens)
+				{
+					Tensor<Cell>& data_tensor = interpreter.dataTensor();
+					data_tensor.set(interpreter.cellHandleOf(data_cursor), ClosingParens{});
+					if (rewrote(data_tensor))
+					{
+						return leaveAfter(*op);
+					}
+					NEXT();
+				}
+				OPCODE(Interpret)
+				{
+					return interpretAt(*op);
+				}
+				OPCODE(Jump)
+				{
+					op = run.ops.data() + op->target;
+					//every loop of a run goes through a jump, where the run is left for a due checkpoint
+					if (Checkpoint::requested.load(std::memory_order_relaxed))
+					{
+						instruction_cursor.cell_index = op->position;
+						return TickOutcome::Continue;
+					}
+					DISPATCH();
+				}
+				OPCODE(Exit)
+				{
+					instruction_cursor.cell_index = op->position;
+					return TickOutcome::Continue;
+				}
+				OPCODE(Halt)
+				{
+					return TickOutcome::Halted;
+				}
+				OPCODE(FusedAdd)
+				{
+					//each of the fused instructions may rewrite the ones after it, so they are left to the decoding path
+					if (on_instruction_tensor)
+					{
+						return interpretAt(*op);
+					}
+					Tensor<Cell>& data_tensor = interpreter.dataTensor();
+					const Cell& data_cell = data_tensor.read(interpreter.cellHandleOf(data_cursor));
+					const int value = holds_alternative<int>(data_cell) ? wrapping_add(get<0>(data_cell), op->delta) : op->delta_after_reset;
+					data_tensor.set(interpreter.cellHandleOf(data_cursor), value);
+					NEXT();
+				}
+				OPCODE(FusedMove)
+				{
+					Coordinates& index = data_cursor.cell_index;
+					const std::vector<int>& dimensions = interpreter.dataTensor().getDimensions();
+					if (onSide(index, op->sign))
+					{
+						moveBySum(index, op->operand, dimensions);
+					}
+					else
+					{
+						for (const Coordinates& step : op->steps)
+						{
+							index.increment(step, dimensions);
+						}
+					}
+					NEXT();
+				}
+#if !DODECAMORPH_THREADED_DISPATCH
+				}
+			}
+#endif
+
+#undef NEXT
+#undef DISPATCH
+#undef OPCODE
+		}
+
+		//like parens pairings, a run is only valid for the version of the instruction tensor it was lowered from,
+		//and stale runs are lowered again in place
+		Interpreter& interpreter;
+		InstructionKeyMap<Run> runs;
+		size_t fallback_ticks = 0;
+	};
+}
+
+namespace Bytecode
+{
+	TickOutcome run(Interpreter& interpreter)
+	{
+		Engine engine(interpreter);
+		return engine.run();
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "Interpreter.h"
+
+//an engine which lowers each straight run of the instruction tensor, along the current direction, into a stream
+//of decoded instructions with their operands already paired, and only falls back to the decoding path for
+//instructions whose effect on the run can not be known up front
+namespace Bytecode
+{
+	//runs the interpreter's program until it halts or fails, with the same effects as repeating Interpreter::tick
+	TickOutcome run(Interpreter& interpreter);
+}
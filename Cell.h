@@ -1,23 +1,103 @@
-#pragma once
-
-struct OpeningParens {};
-struct ClosingParens {};
-
-enum Instruction : int
-{
-	OutputCurrentData = 0,
-	IncrementDataCursorCellIndex = 1,
-	SetDataCursorTensorIndex = 2,
-	IncrementDataCell = 3,
-	DecrementDataCell = 4,
-	SetInstructionCursorDirection = 5,
-	SetDataCellUserInput = 6,
-	ConditionalSetInstructionCursorCellIndex = 7,
-	SetDataCellOpeningParens = 8,
-	SetDataCellClosingParens = 9,
-	SetInstructionCursorTensorIndex = 10,
-	ShrinkTensor = 11,
-	InstructionCount
-};
-
-using Cell = std::variant<int, OpeningParens, ClosingParens>;
\ No newline at end of file
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+struct OpeningParens 
+{
+	bool operator==(const OpeningParens&) const = default;
+};
+
+struct ClosingParens 
+{
+	bool operator==(const ClosingParens&) const = default;
+};
+
+enum Instruction : int
+{
+	OutputCurrentData = 0,
+	IncrementDataCursorCellIndex = 1,
+	SetDataCursorTensorIndex = 2,
+	IncrementDataCell = 3,
+	DecrementDataCell = 4,
+	SetInstructionCursorDirection = 5,
+	SetDataCellUserInput = 6,
+	ConditionalSetInstructionCursorCellIndex = 7,
+	SetDataCellOpeningParens = 8,
+	SetDataCellClosingParens = 9,
+	SetInstructionCursorTensorIndex = 10,
+	ShrinkTensor = 11,
+	InstructionCount
+};
+
+//either an int or one of the parens, packed into 32 bits. The two lowest ints encode the parens,
+//so the ints a cell holds run from MinInt to MaxInt
+class Cell
+{
+public:
+	static constexpr int OpeningWord = INT_MIN;
+	static constexpr int ClosingWord = INT_MIN + 1;
+	static constexpr int MinInt = INT_MIN + 2;
+	static constexpr int MaxInt = INT_MAX;
+	//the number of ints a cell holds, which is where arithmetic on cells wraps around
+	static constexpr int64_t IntCount = int64_t{ MaxInt } - MinInt + 1;
+
+	constexpr Cell() = default;
+	//ints below MinInt can not be told apart from parens, so they become MinInt
+	constexpr Cell(const int value) : word(std::max(value, MinInt)) {}
+	constexpr Cell(OpeningParens) : word(OpeningWord) {}
+	constexpr Cell(ClosingParens) : word(ClosingWord) {}
+
+	constexpr bool isInt() const { return word >= MinInt; }
+	constexpr bool isOpening() const { return word == OpeningWord; }
+	constexpr bool isClosing() const { return word == ClosingWord; }
+
+	//the int, if the cell holds one
+	constexpr int value() const { return word; }
+
+	//the encoding: the int itself, OpeningWord or ClosingWord
+	constexpr int bits() const { return word; }
+
+	//the cell with the given encoding, as bits() gives it
+	static constexpr Cell fromBits(const int bits)
+	{
+		Cell cell;
+		cell.word = bits;
+		return cell;
+	}
+
+	constexpr bool operator==(const Cell&) const = default;
+
+private:
+	int word = 0;
+};
+
+static_assert(sizeof(Cell) == sizeof(int32_t) && std::is_trivially_copyable_v<Cell>);
+
+//access in the style of std::variant<int, OpeningParens, ClosingParens>, which cells used to be
+template<typename T>
+constexpr bool holds_alternative(const Cell& cell)
+{
+	if constexpr (std::is_same_v<T, int>)
+	{
+		return cell.isInt();
+	}
+	else if constexpr (std::is_same_v<T, OpeningParens>)
+	{
+		return cell.isOpening();
+	}
+	else
+	{
+		static_assert(std::is_same_v<T, ClosingParens>, "a cell holds an int, OpeningParens or ClosingParens");
+		return cell.isClosing();
+	}
+}
+
+template<size_t Index>
+constexpr int get(const Cell& cell)
+{
+	static_assert(Index == 0, "only the int of a cell can be read");
+	return cell.value();
+}
\ No newline at end of file
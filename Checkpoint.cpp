@@ -0,0 +1,462 @@
+#include "Checkpoint.h"
+#include <array>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include "Interpreter.h"
+#include "ProgramImage.h"
+#include "Checksum.h"
+#include "Dependencies/Files.h"
+#include "Dependencies/Logger/Logger.h"
+
+namespace
+{
+	constexpr std::array<char, 8> Magic = { '\x89', 'D', 'C', 'C', 'K', '\r', '\n', '\x1a' };
+	constexpr uint32_t Version = 1;
+
+	enum class Kind : uint32_t
+	{
+		//holds every tensor
+		Full,
+		//only holds the tensors written to since the checkpoint before
+		Incremental
+	};
+
+	//every snapshot starts with this, followed by its body. The checksum tells a whole body
+	//from one the run was killed in the middle of writing
+	struct RecordHeader
+	{
+		std::array<char, 8> magic;
+		uint32_t version;
+		Kind kind;
+		uint64_t body_size;
+		uint64_t body_checksum;
+	};
+
+	//tensors of the meta tensor are keyed by their canonical coordinates
+	using Key = std::vector<int>;
+
+	Key key_of(const Coordinates& coordinates)
+	{
+		return Key(coordinates.begin(), coordinates.begin() + coordinates.rank());
+	}
+
+	//the body is a sequence of 64-bit counts, int lists and tensor images, each padded to 8 bytes
+	class BodyWriter
+	{
+	public:
+		void count(const uint64_t value)
+		{
+			append(&value, sizeof(value));
+		}
+
+		void ints(const std::span<const int> values)
+		{
+			count(values.size());
+			append(values.data(), values.size_bytes());
+		}
+
+		void image(const std::vector<char>& image)
+		{
+			count(image.size());
+			append(image.data(), image.size());
+		}
+
+		std::vector<char> bytes;
+
+	private:
+		void append(const void* data, const size_t size)
+		{
+			const char* first = static_cast<const char*>(data);
+			bytes.insert(bytes.end(), first, first + size);
+			bytes.resize((bytes.size() + 7) / 8 * 8);
+		}
+	};
+
+	//reads a body back. Reading past its end gives empty values and marks the body as damaged
+	class BodyReader
+	{
+	public:
+		explicit BodyReader(const std::span<const char> given_bytes) : bytes(given_bytes) {}
+
+		uint64_t count()
+		{
+			uint64_t value = 0;
+			if (const std::span<const char> taken = take(sizeof(value)); !taken.empty())
+			{
+				std::memcpy(&value, taken.data(), sizeof(value));
+			}
+			return value;
+		}
+
+		std::vector<int> ints()
+		{
+			const uint64_t size = count();
+			std::vector<int> values;
+			if (size > bytes.size() / sizeof(int))
+			{
+				damaged = true;
+				return values;
+			}
+			values.resize(size);
+			if (const std::span<const char> taken = take(size * sizeof(int)); !taken.empty())
+			{
+				std::memcpy(values.data(), taken.data(), taken.size());
+			}
+			return values;
+		}
+
+		std::span<const char> image()
+		{
+			const uint64_t size = count();
+			if (size == 0)
+			{
+				damaged = true;
+				return {};
+			}
+			return take(size);
+		}
+
+		bool damaged = false;
+
+	private:
+		std::span<const char> take(const uint64_t size)
+		{
+			const uint64_t padded = (size + 7) / 8 * 8;
+			if (damaged || padded < size || padded > bytes.size() - offset)
+			{
+				damaged = true;
+				return {};
+			}
+			const std::span<const char> taken = bytes.subspan(offset, size);
+			offset += padded;
+			return taken;
+		}
+
+		std::span<const char> bytes;
+		size_t offset = 0;
+	};
+
+	void write_cursor(BodyWriter& body, const Cursor& cursor)
+	{
+		body.ints(std::span<const int>(cursor.cell_index.begin(), cursor.cell_index.size()));
+		body.ints(std::span<const int>(cursor.tensor_index.begin(), cursor.tensor_index.size()));
+	}
+
+	Cursor read_cursor(BodyReader& body)
+	{
+		const Coordinates cell_index = body.ints();
+		const Coordinates tensor_index = body.ints();
+		return Cursor(cell_index, tensor_index);
+	}
+
+	//what a snapshot holds besides the tensors, as read back from the log
+	struct Snapshot
+	{
+		Cursor instruction = Cursor({ 0 }, { 0 });
+		Cursor data = Cursor({ 0 }, { 1 });
+		std::vector<Direction> directions;
+		Checkpoint::Streams streams;
+		std::vector<int> meta_dimensions;
+		//the images of the tensors, in the snapshot they were last written to
+		std::map<Key, std::span<const char>> tensors;
+	};
+
+	//applies the body of a snapshot over the state of those before it. Returns false if the body is damaged,
+	//leaving the snapshot as it was
+	bool read_body(const std::span<const char> bytes, Snapshot& snapshot)
+	{
+		BodyReader body(bytes);
+		Snapshot read;
+		read.streams.input.consumed = body.count();
+		read.streams.input.ended = body.count() != 0;
+		read.streams.output_written = body.count();
+		read.instruction = read_cursor(body);
+		read.data = read_cursor(body);
+		for (const int direction : body.ints())
+		{
+			read.directions.push_back(static_cast<Direction>(direction % Direction::DirectionCount));
+		}
+		read.meta_dimensions = body.ints();
+
+		const uint64_t tensor_count = body.count();
+		for (uint64_t i = 0; i < tensor_count && !body.damaged; i++)
+		{
+			Key key = body.ints();
+			if (body.count() != 0)
+			{
+				read.tensors[std::move(key)] = body.image();
+			}
+			else if (const auto earlier = snapshot.tensors.find(key); earlier != snapshot.tensors.end())
+			{
+				read.tensors[std::move(key)] = earlier->second;
+			}
+			else
+			{
+				//a tensor the snapshots before never held
+				body.damaged = true;
+			}
+		}
+
+		if (body.damaged)
+		{
+			return false;
+		}
+		snapshot = std::move(read);
+		return true;
+	}
+
+	//the state of checkpoints being taken. Only the interpreter's thread touches it, apart from the timer
+	struct Taker
+	{
+		std::string path;
+		//the versions of the tensors as they were in the log, by their keys
+		std::map<Key, TensorVersion> logged;
+		bool has_full = false;
+		uint64_t full_size = 0;
+		uint64_t log_size = 0;
+		//the snapshot being written
+		std::future<bool> writing;
+
+		std::thread timer;
+		std::mutex timer_mutex;
+		std::condition_variable timer_stop;
+		bool stopping = false;
+	};
+
+	std::unique_ptr<Taker> taker;
+
+	void on_checkpoint_signal(int)
+	{
+		Checkpoint::requested.store(true, std::memory_order_relaxed);
+	}
+
+	//a full snapshot replaces the log, by way of a new file so that a run killed meanwhile still has the old one
+	bool store(const std::string& path, const std::vector<char>& record, const Kind kind)
+	{
+		const std::string written_path = kind == Kind::Full ? path + ".new" : path;
+		{
+			FileWriter writer(written_path, kind == Kind::Full ? FileWriter::Mode::Truncate : FileWriter::Mode::Append);
+			if (!writer.isOpen() || !writer.writeVector(record))
+			{
+				return false;
+			}
+			writer.flush();
+		}
+		if (kind == Kind::Full)
+		{
+			std::error_code error;
+			std::filesystem::rename(written_path, path, error);
+			return !error;
+		}
+		return true;
+	}
+}
+
+namespace Checkpoint
+{
+	std::atomic<bool> requested = false;
+
+	void start(const std::string& path, const unsigned interval_seconds)
+	{
+		taker = std::make_unique<Taker>();
+		taker->path = path;
+#ifdef SIGUSR1
+		std::signal(SIGUSR1, on_checkpoint_signal);
+#endif
+		if (interval_seconds != 0)
+		{
+			Taker& started = *taker;
+			started.timer = std::thread([&started, interval_seconds]
+			{
+				std::unique_lock lock(started.timer_mutex);
+				while (!started.timer_stop.wait_for(lock, std::chrono::seconds(interval_seconds), [&started] { return started.stopping; }))
+				{
+					requested.store(true, std::memory_order_relaxed);
+				}
+			});
+		}
+	}
+
+	bool active()
+	{
+		return taker != nullptr;
+	}
+
+	void stop()
+	{
+		if (taker == nullptr)
+		{
+			return;
+		}
+		if (taker->timer.joinable())
+		{
+			{
+				std::lock_guard lock(taker->timer_mutex);
+				taker->stopping = true;
+			}
+			taker->timer_stop.notify_one();
+			taker->timer.join();
+		}
+		if (taker->writing.valid() && !taker->writing.get())
+		{
+			Logger::LogError("Could not write the checkpoint");
+		}
+#ifdef SIGUSR1
+		std::signal(SIGUSR1, SIG_DFL);
+#endif
+		taker.reset();
+	}
+
+	void take(Interpreter& interpreter)
+	{
+		requested.store(false, std::memory_order_relaxed);
+		if (taker == nullptr)
+		{
+			return;
+		}
+
+		//the output file has to hold everything the snapshot says was written, once the snapshot is in the log
+		if (interpreter.output != nullptr)
+		{
+			interpreter.output->flush();
+		}
+		const Kind kind = !taker->has_full || taker->log_size >= taker->full_size * 2 ? Kind::Full : Kind::Incremental;
+
+		BodyWriter body;
+		const Input::Position input = interpreter.input != nullptr ? interpreter.input->position() : Input::Position{};
+		body.count(input.consumed);
+		body.count(input.ended ? 1 : 0);
+		body.count(interpreter.output != nullptr ? interpreter.output->written() : 0);
+		write_cursor(body, interpreter.instruction_cursor);
+		write_cursor(body, interpreter.data_cursor);
+		const std::vector<int> directions(interpreter.instruction_cursor_direction.begin(), interpreter.instruction_cursor_direction.end());
+		body.ints(directions);
+		body.ints(interpreter.meta_tensor.getDimensions());
+
+		std::map<Key, TensorVersion> logged;
+		body.count(interpreter.meta_tensor.size());
+		interpreter.meta_tensor.forEachCell([&](const Coordinates& coordinates, Tensor<Cell>& tensor)
+		{
+			Key key = key_of(coordinates);
+			const TensorVersion version = tensor.version();
+			const auto earlier = taker->logged.find(key);
+			const bool changed = kind == Kind::Full || earlier == taker->logged.end() || earlier->second != version;
+			body.ints(key);
+			body.count(changed ? 1 : 0);
+			if (changed)
+			{
+				body.image(ProgramImage::encode(tensor));
+			}
+			logged.emplace(std::move(key), version);
+		});
+
+		RecordHeader header{};
+		header.magic = Magic;
+		header.version = Version;
+		header.kind = kind;
+		header.body_size = body.bytes.size();
+		header.body_checksum = checksum(body.bytes);
+		std::vector<char> record(sizeof(RecordHeader));
+		std::memcpy(record.data(), &header, sizeof(RecordHeader));
+		record.insert(record.end(), body.bytes.begin(), body.bytes.end());
+
+		//one snapshot is written at a time, and a failed one makes the next one full, so that the log never has a gap
+		if (taker->writing.valid() && !taker->writing.get())
+		{
+			Logger::LogError("Could not write the checkpoint");
+			taker->has_full = false;
+			if (kind == Kind::Incremental)
+			{
+				requested.store(true, std::memory_order_relaxed);
+				return;
+			}
+		}
+
+		taker->logged = std::move(logged);
+		if (kind == Kind::Full)
+		{
+			taker->has_full = true;
+			taker->full_size = record.size();
+			taker->log_size = 0;
+		}
+		taker->log_size += record.size();
+		taker->writing = std::async(std::launch::async, [path = taker->path, record = std::move(record), kind]
+		{
+			return store(path, record, kind);
+		});
+	}
+
+	std::optional<Streams> restore(const std::string& path, Interpreter& interpreter)
+	{
+		const MappedFile file(path);
+		if (!file.isOpen())
+		{
+			Logger::LogError("Could not open the checkpoint file");
+			return std::nullopt;
+		}
+
+		//the snapshots are applied in order, up to the first which was not written whole
+		Snapshot snapshot;
+		bool restored = false;
+		std::span<const char> rest = file.contents();
+		while (rest.size() >= sizeof(RecordHeader))
+		{
+			RecordHeader header;
+			std::memcpy(&header, rest.data(), sizeof(RecordHeader));
+			rest = rest.subspan(sizeof(RecordHeader));
+			if (header.magic != Magic || header.version != Version || header.body_size > rest.size()
+				|| (header.kind != Kind::Full && header.kind != Kind::Incremental) || (header.kind == Kind::Incremental && !restored))
+			{
+				break;
+			}
+			const std::span<const char> body = rest.subspan(0, header.body_size);
+			rest = rest.subspan(header.body_size);
+			if (checksum(body) != header.body_checksum)
+			{
+				break;
+			}
+			if (header.kind == Kind::Full)
+			{
+				snapshot.tensors.clear();
+			}
+			if (!read_body(body, snapshot))
+			{
+				break;
+			}
+			restored = true;
+		}
+
+		if (!restored)
+		{
+			Logger::LogError("The checkpoint file holds no whole checkpoint");
+			return std::nullopt;
+		}
+
+		Tensor<Tensor<Cell>> restored_meta;
+		restored_meta.reserve(snapshot.meta_dimensions, snapshot.tensors.size());
+		for (const auto& [key, image] : snapshot.tensors)
+		{
+			std::optional<Tensor<Cell>> tensor = ProgramImage::decode(image);
+			if (!tensor.has_value())
+			{
+				Logger::LogError("The checkpoint file is damaged");
+				return std::nullopt;
+			}
+			restored_meta.at(Coordinates(key)) = std::move(tensor).value();
+		}
+
+		interpreter.meta_tensor = std::move(restored_meta);
+		interpreter.instruction_cursor = snapshot.instruction;
+		interpreter.data_cursor = snapshot.data;
+		interpreter.instruction_cursor_direction = snapshot.directions;
+		return snapshot.streams;
+	}
+}
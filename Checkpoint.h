@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include "Input.h"
+
+class Interpreter;
+
+//snapshots of the interpreter's state, taken while a program runs so that a run which gets killed can be resumed
+//from the last one. A checkpoint file is a log: a full snapshot, then snapshots which only hold the tensors written
+//to since the one before. Once the log grows to twice its full snapshot, the next checkpoint writes a full one anew.
+//Snapshots are put together between ticks, and written to the file on a thread of their own
+namespace Checkpoint
+{
+	//where the user input and the output were when the restored checkpoint was taken
+	struct Streams
+	{
+		Input::Position input;
+		uint64_t output_written = 0;
+	};
+
+	//starts taking checkpoints to the file at the path: whenever SIGUSR1 arrives, where there is such a signal,
+	//and every given number of seconds, unless it is 0
+	void start(const std::string& path, unsigned interval_seconds);
+
+	//whether checkpoints are being taken
+	bool active();
+
+	//waits until the checkpoint being written, if any, is in the file, and stops taking more
+	void stop();
+
+	//restores the state of the last whole checkpoint in the file into the interpreter. Returns where the streams
+	//were then, or nullopt if the file holds no checkpoint
+	std::optional<Streams> restore(const std::string& path, Interpreter& interpreter);
+
+	//set when a checkpoint is due. Engines which stay in loops of their own for long leave them when it is
+	extern std::atomic<bool> requested;
+
+	void take(Interpreter& interpreter);
+
+	//takes a checkpoint of the interpreter if one is due. The engines call it between ticks, where the state is whole
+	inline void poll(Interpreter& interpreter)
+	{
+		if (requested.load(std::memory_order_relaxed))
+		{
+			take(interpreter);
+		}
+	}
+}
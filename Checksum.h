@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+//a checksum over whole 64-bit words in four independent lanes, so that verifying files written by the interpreter,
+//like program images and checkpoints, runs at the speed of memory. It catches damage, not tampering
+inline uint64_t checksum(const std::span<const char> bytes)
+{
+	constexpr uint64_t Multiplier = 0x9e3779b97f4a7c15ull;
+	const auto mix = [](const uint64_t hash, const uint64_t word)
+	{
+		return std::rotl((hash ^ word) * Multiplier, 29);
+	};
+
+	std::array<uint64_t, 4> lanes = { 0x243f6a8885a308d3ull, 0x13198a2e03707344ull, 0xa4093822299f31d0ull, 0x082efa98ec4e6c89ull };
+	size_t offset = 0;
+	for (; offset + sizeof(lanes) <= bytes.size(); offset += sizeof(lanes))
+	{
+		for (size_t lane = 0; lane < lanes.size(); lane++)
+		{
+			uint64_t word = 0;
+			std::memcpy(&word, bytes.data() + offset + lane * sizeof(word), sizeof(word));
+			lanes[lane] = mix(lanes[lane], word);
+		}
+	}
+	for (; offset < bytes.size(); offset++)
+	{
+		lanes[0] = mix(lanes[0], static_cast<unsigned char>(bytes[offset]));
+	}
+
+	uint64_t result = bytes.size();
+	for (const uint64_t lane : lanes)
+	{
+		result = mix(result, lane);
+	}
+	return result;
+}
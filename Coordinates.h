@@ -0,0 +1,341 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <span>
+#include <functional>
+
+
+//a small vector of ints. Up to InlineCapacity dimensions are stored inline, which covers the ranks
+//programs actually use, so copying and building coordinates while ticking does not allocate
+struct Coordinates 
+{
+	static constexpr size_t InlineCapacity = 6;
+
+	Coordinates(std::span<const int> v) { assign(v); }
+	Coordinates(const std::vector<int>& v) { assign(v); }
+	Coordinates(const int sole) { push_back(sole); }
+	Coordinates(const int first, const int second) { push_back(first); push_back(second); }
+	Coordinates() = default;
+
+	Coordinates(const Coordinates& other) { assign(other); }
+
+	Coordinates(Coordinates&& other) noexcept
+	{
+		if (other.heap != nullptr)
+		{
+			heap = std::exchange(other.heap, nullptr);
+			capacity = std::exchange(other.capacity, InlineCapacity);
+			count = std::exchange(other.count, 0);
+		}
+		else
+		{
+			assign(other);
+		}
+	}
+
+	Coordinates& operator=(const Coordinates& other)
+	{
+		if (this != &other)
+		{
+			assign(other);
+		}
+		return *this;
+	}
+
+	Coordinates& operator=(Coordinates&& other) noexcept
+	{
+		if (this == &other)
+		{
+			return *this;
+		}
+
+		if (other.heap != nullptr)
+		{
+			delete[] heap;
+			heap = std::exchange(other.heap, nullptr);
+			capacity = std::exchange(other.capacity, InlineCapacity);
+			count = std::exchange(other.count, 0);
+		}
+		else
+		{
+			assign(other);
+		}
+		return *this;
+	}
+
+	~Coordinates()
+	{
+		delete[] heap;
+	}
+
+	int& operator[](size_t index) { return data()[index]; }
+	int operator[](size_t index) const { return data()[index]; }
+
+	int* data() { return heap != nullptr ? heap : local; }
+	const int* data() const { return heap != nullptr ? heap : local; }
+
+	int* begin() { return data(); }
+	int* end() { return data() + count; }
+	const int* begin() const { return data(); }
+	const int* end() const { return data() + count; }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	void reserve(const size_t wanted)
+	{
+		if (wanted <= capacity)
+		{
+			return;
+		}
+
+		const size_t new_capacity = std::max(wanted, capacity * 2);
+		int* const grown = new int[new_capacity];
+		std::copy(begin(), end(), grown);
+		delete[] heap;
+		heap = grown;
+		capacity = new_capacity;
+	}
+
+	void push_back(const int coordinate)
+	{
+		reserve(count + 1);
+		data()[count++] = coordinate;
+	}
+
+	void resize(const size_t new_size, const int fill = 0)
+	{
+		reserve(new_size);
+		if (new_size > count)
+		{
+			std::fill(data() + count, data() + new_size, fill);
+		}
+		count = new_size;
+	}
+
+	void clear() { count = 0; }
+
+	void assign(std::span<const int> values)
+	{
+		reserve(values.size());
+		std::copy(values.begin(), values.end(), data());
+		count = values.size();
+	}
+
+	//number of dimensions up to and including the last non-zero one, trailing zeros being implied
+	size_t rank() const
+	{
+		size_t result = size();
+		while (result > 0 && data()[result - 1] == 0)
+		{
+			result--;
+		}
+		return result;
+	}
+
+	//the same coordinates without their trailing zeros, i.e. the form tensors key their cells by
+	Coordinates canonical() const
+	{
+		return Coordinates(std::span<const int>(data(), rank()));
+	}
+
+	static bool equal(const Coordinates& lhs, const Coordinates& rhs)
+	{
+		const size_t lhs_size = lhs.size();
+		const size_t rhs_size = rhs.size();
+		if (lhs_size < rhs_size)
+		{
+			for (size_t i = 0; i < rhs_size; i++)
+			{
+				const int other_coordinate = i >= lhs_size ? 0 : lhs[i];
+				if (rhs[i] != other_coordinate)
+				{
+					return false;
+				}
+			}
+		}
+		else if (lhs_size > rhs_size)
+		{
+			for (size_t i = 0; i < lhs_size; i++)
+			{
+				const int other_coordinate = i >= rhs_size ? 0 : rhs[i];
+				if (lhs[i] != other_coordinate)
+				{
+					return false;
+				}
+			}
+		}
+		else
+		{
+			return std::equal(lhs.begin(), lhs.end(), rhs.begin());
+		}
+
+		return true;
+	}
+
+	Coordinates& increment(const Coordinates& by, const std::span<const int> dimensions)
+	{
+		const size_t coords_size = size();
+		const size_t by_size = by.size();	
+
+		const auto get_dimension_for_index = [&dimensions](size_t index)
+		{
+			return dimensions.size() > index ? dimensions[index] : 1;
+		};
+
+		if (coords_size < by_size)
+		{
+			for (size_t i = 0; i < by_size; i++)
+			{
+				const int dimension = get_dimension_for_index(i);
+				if (coords_size > i)
+				{
+					(*this)[i] = ((*this)[i] + by[i]) % dimension;
+				}
+				else
+				{
+					push_back(by[i] % dimension);
+				}
+			}
+		}
+		else if (coords_size > by_size)
+		{
+			for (size_t i = 0; i < coords_size; i++)
+			{
+				const int by_value = by_size > i ? by[i] : 0;
+				const int dimension = get_dimension_for_index(i);
+				(*this)[i] = ((*this)[i] + by_value) % dimension;
+			}
+		}
+		else 
+		{
+			for (size_t i = 0; i < coords_size; i++)
+			{
+				const int dimension = get_dimension_for_index(i);
+				(*this)[i] = ((*this)[i] + by[i]) % dimension;
+			}
+		}
+
+		return *this;
+	}
+
+private:
+
+	int local[InlineCapacity] = {};
+	int* heap = nullptr;
+	size_t capacity = InlineCapacity;
+	size_t count = 0;
+};
+
+
+//hashes and compares coordinates the way Coordinates::equal does, so (1 2) and (1 2 0) are the same key
+struct CoordinatesHash
+{
+	size_t operator()(const Coordinates& coordinates) const
+	{
+		const size_t rank = coordinates.rank();
+		size_t result = rank;
+		for (size_t i = 0; i < rank; i++)
+		{
+			result ^= std::hash<int>()(coordinates[i]) + 0x9e3779b97f4a7c15ull + (result << 6) + (result >> 2);
+		}
+		return result;
+	}
+};
+
+struct CoordinatesEqual
+{
+	bool operator()(const Coordinates& lhs, const Coordinates& rhs) const
+	{
+		return Coordinates::equal(lhs, rhs);
+	}
+};
+
+
+//steps coordinates by one movement within one set of dimensions, exactly like Coordinates::increment, with what
+//increment works out on every call worked out once, for cursors which take the same step over and over. Coordinates
+//within their dimensions either way, as cursors almost always are, step by an add and a compare against the bounds
+//for each dimension, in kernels unrolled for ranks 1 to 3, as long as the movement only moves by one at a time.
+//Anything else is left to increment
+class CoordinatesStepper
+{
+public:
+	CoordinatesStepper() = default;
+	CoordinatesStepper(const Coordinates& given_movement, const std::span<const int> given_dimensions)
+	{
+		reset(given_movement, given_dimensions);
+	}
+
+	//makes it step by the movement within the dimensions, keeping the memory it has
+	void reset(const Coordinates& given_movement, const std::span<const int> given_dimensions)
+	{
+		movement = given_movement;
+		dimensions.assign(given_dimensions.begin(), given_dimensions.end());
+		bounds.resize(movement.size());
+		unit = true;
+		for (size_t i = 0; i < bounds.size(); i++)
+		{
+			bounds[i] = i < dimensions.size() ? dimensions[i] : 1;
+			unit = unit && movement[i] >= -1 && movement[i] <= 1;
+		}
+	}
+
+	//whether it was made for these dimensions, which reading cells may have grown since
+	bool fits(const std::span<const int> other_dimensions) const
+	{
+		return std::equal(dimensions.begin(), dimensions.end(), other_dimensions.begin(), other_dimensions.end());
+	}
+
+	Coordinates& step(Coordinates& coordinates) const
+	{
+		if (!unit || coordinates.size() != movement.size())
+		{
+			return coordinates.increment(movement, dimensions);
+		}
+		switch (movement.size())
+		{
+		case 1:
+			return stepRank<1>(coordinates);
+		case 2:
+			return stepRank<2>(coordinates);
+		case 3:
+			return stepRank<3>(coordinates);
+		default:
+			return stepRank<0>(coordinates);
+		}
+	}
+
+private:
+	Coordinates movement;
+	std::vector<int> dimensions;
+	//the extent each coordinate wraps around at, 1 where the dimensions do not reach
+	std::vector<int> bounds;
+	bool unit = true;
+
+	//steps coordinates of the movement's rank, which is Rank unless that is 0
+	template<size_t Rank>
+	Coordinates& stepRank(Coordinates& coordinates) const
+	{
+		const size_t rank = Rank != 0 ? Rank : movement.size();
+		int* const values = coordinates.data();
+		//% leaves coordinates in (-bound, bound) as they are, so stepping them by -1, 0 or 1 only wraps at ±bound
+		bool within = true;
+		for (size_t i = 0; i < rank; i++)
+		{
+			const unsigned bound = static_cast<unsigned>(bounds[i]);
+			within = within && static_cast<unsigned>(values[i]) + bound - 1 < 2 * bound - 1;
+		}
+		if (!within)
+		{
+			return coordinates.increment(movement, dimensions);
+		}
+
+		for (size_t i = 0; i < rank; i++)
+		{
+			const int stepped = values[i] + movement[i];
+			values[i] = stepped == bounds[i] || stepped == -bounds[i] ? 0 : stepped;
+		}
+		return coordinates;
+	}
+};
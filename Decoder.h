@@ -0,0 +1,253 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+#include "Cell.h"
+#include "Coordinates.h"
+#include "ParensCache.h"
+#include "ParensScan.h"
+#include "Tensor.h"
+
+enum Direction : unsigned char
+{
+	Neutral = 0,
+	Incremental = 1,
+	Decremental = 2,
+	DirectionCount
+};
+
+//the step the instruction cursor takes every tick in the direction
+inline Coordinates movement_of(const std::vector<Direction>& direction)
+{
+	Coordinates movement_by;
+	movement_by.resize(direction.size());
+
+	for (size_t i = 0; i < direction.size(); i++)
+	{
+		const Direction current_direction = static_cast<Direction>(direction[i] % Direction::DirectionCount);
+		if (current_direction == Direction::Incremental)
+		{
+			movement_by[i] = 1;
+		}
+		else if (current_direction == Direction::Decremental)
+		{
+			movement_by[i] = -1;
+		}
+	}
+
+	return movement_by;
+}
+
+//what instruction 5 makes of the numbers in its parens
+inline void set_direction(std::vector<Direction>& direction, const Coordinates& numbers)
+{
+	direction.resize(numbers.size());
+	for (size_t i = 0; i < numbers.size(); i++)
+	{
+		direction[i] = static_cast<Direction>(numbers[i] % Direction::DirectionCount);
+	}
+}
+
+//the part of the decoding path which only follows the instruction tensor: stepping indices in the instruction cursor's
+//direction, and pairing parens through the parens cache. The interpreter's tensors hold Cells and a lockstep group's
+//hold a cell of every lane, so the cell type is a parameter, and pairing is given a view which picks the instruction
+//cell out of one
+template<typename T>
+class Decoder
+{
+public:
+	//moves the index one step in the direction, in place so that ticking does not allocate
+	Coordinates& advance(Coordinates& index, const std::vector<Direction>& direction, const std::vector<int>& dimensions)
+	{
+		if (stepper_direction != direction || !stepper.fits(dimensions))
+		{
+			stepper.reset(movement_of(direction), dimensions);
+			stepper_direction = direction;
+		}
+		return stepper.step(index);
+	}
+
+	//pairing only depends on the instruction tensor, the start cell and the movement, so it is looked up in the parens
+	//cache first and only scanned for when the instruction tensor was written to since. Sets how many cells the scan
+	//stepped over, nullopt if the pairing was cached. The result stays valid until the next pairing
+	template<typename View_t>
+	const PairedParens& pairParens(Tensor<T>& instruction_tensor, const Coordinates& tensor_index, const std::vector<Direction>& direction,
+		const Coordinates& opening_parens_index, const View_t& view, std::optional<size_t>& scanned)
+	{
+		const Coordinates movement = movement_of(direction);
+		if (const PairedParens* cached = parens_cache.find(tensor_index, instruction_tensor.version(), opening_parens_index, movement))
+		{
+			scanned.reset();
+			return *cached;
+		}
+
+		PairedParens paired;
+		size_t scanned_cells = 0;
+		paired.closing_parens_index = findClosingParensFor(instruction_tensor, direction, movement, opening_parens_index, view, paired.numbers, scanned_cells);
+		scanned = scanned_cells;
+		//reading may have grown the tensor's dimensions, which does not change the pairing
+		return parens_cache.store(tensor_index, instruction_tensor.version(), opening_parens_index, movement, std::move(paired));
+	}
+
+private:
+	//scans the row the way ParensScan::scan does. Rows of other cell types are walked through the view for the first
+	//block, which is where most pairings end, and only copied out a block at a time for the vector kernels after that
+	template<typename View_t>
+	static ParensScan::RowEnd scanRow(const std::span<const T> row, const int depth, const View_t& view, Coordinates& numbers)
+	{
+		if constexpr (std::is_same_v<T, Cell>)
+		{
+			return ParensScan::scan(row, depth, numbers);
+		}
+		else
+		{
+			constexpr size_t BlockSize = 64;
+			ParensScan::RowEnd end{ ParensScan::npos, depth };
+			const size_t walked = std::min(BlockSize, row.size());
+			for (size_t i = 0; i < walked; i++)
+			{
+				const Cell& cell = view(row[i]);
+				if (cell.isClosing())
+				{
+					if (--end.depth == 0)
+					{
+						end.position = i;
+						return end;
+					}
+				}
+				else if (cell.isOpening())
+				{
+					end.depth++;
+				}
+				else if (end.depth == 1)
+				{
+					numbers.push_back(cell.value());
+				}
+			}
+
+			std::array<Cell, BlockSize> block;
+			for (size_t start = walked; start < row.size(); start += BlockSize)
+			{
+				const size_t size = std::min(BlockSize, row.size() - start);
+				for (size_t i = 0; i < size; i++)
+				{
+					block[i] = view(row[start + i]);
+				}
+				end = ParensScan::scan(std::span<const Cell>(block.data(), size), end.depth, numbers);
+				if (end.position != ParensScan::npos)
+				{
+					end.position += start;
+					return end;
+				}
+			}
+			return end;
+		}
+	}
+
+	//when the cursor moves along dimension 0 of a dense instruction tensor, every cell pairing can reach before coming
+	//back to the opening parens lies in one contiguous row, which is scanned in bulk: first from the opening parens
+	//to the row's end, then from the row's start back up to the opening parens. Takes the first step the way
+	//stepping cell by cell does, so that reading grows the tensor just the same. Gives nullopt where the row
+	//can not be scanned as a whole, having touched nothing else
+	template<typename View_t>
+	std::optional<std::optional<Coordinates>> findClosingParensInRow(Tensor<T>& instruction_tensor, const Coordinates& opening_parens_index,
+		const Coordinates& movement, const View_t& view, Coordinates& numbers)
+	{
+		if (movement.rank() != 1 || movement[0] != 1)
+		{
+			return std::nullopt;
+		}
+
+		Coordinates first_index = opening_parens_index;
+		first_index.increment(movement, instruction_tensor.getDimensions());
+		if (Coordinates::equal(first_index, opening_parens_index))
+		{
+			return std::optional<Coordinates>();
+		}
+		instruction_tensor.read(first_index);
+
+		//stepping only changes dimension 0 from here on, and only comes back to the opening parens if they are in the row
+		const int opening_position = opening_parens_index.empty() ? 0 : opening_parens_index[0];
+		Coordinates opening_in_row = first_index;
+		opening_in_row[0] = opening_position;
+		const std::span<const T> row = instruction_tensor.row(first_index);
+		if (row.empty() || opening_position < 0 || static_cast<size_t>(opening_position) >= row.size()
+			|| !Coordinates::equal(opening_in_row, opening_parens_index))
+		{
+			return std::nullopt;
+		}
+
+		const size_t after_opening = static_cast<size_t>(opening_position) + 1;
+		ParensScan::RowEnd end = scanRow(row.subspan(after_opening), 1, view, numbers);
+		if (end.position != ParensScan::npos)
+		{
+			end.position += after_opening;
+		}
+		else
+		{
+			end = scanRow(row.first(after_opening - 1), end.depth, view, numbers);
+		}
+
+		if (end.position == ParensScan::npos)
+		{
+			return std::optional<Coordinates>();
+		}
+		Coordinates closing_parens_index = first_index;
+		closing_parens_index[0] = static_cast<int>(end.position);
+		return std::optional<Coordinates>(std::move(closing_parens_index));
+	}
+
+	//also counts the cells stepped over on the way
+	template<typename View_t>
+	std::optional<Coordinates> findClosingParensFor(Tensor<T>& instruction_tensor, const std::vector<Direction>& direction, const Coordinates& movement,
+		const Coordinates& opening_parens_index, const View_t& view, Coordinates& numbers, size_t& scanned)
+	{
+		//scanning does not execute anything, so neither the instruction tensor nor the movement change on the way
+		if (auto found_in_row = findClosingParensInRow(instruction_tensor, opening_parens_index, movement, view, numbers))
+		{
+			//the row wraps around at the end of dimension 0
+			const size_t row_size = static_cast<size_t>(instruction_tensor.getDimensions()[0]);
+			const size_t opening_position = opening_parens_index.empty() ? 0 : static_cast<size_t>(opening_parens_index[0]);
+			const std::optional<Coordinates>& closing_parens_index = found_in_row.value();
+			scanned = closing_parens_index.has_value() ? (static_cast<size_t>(closing_parens_index.value()[0]) + row_size - opening_position - 1) % row_size + 1 : row_size;
+			return std::move(found_in_row).value();
+		}
+
+		int parens_count = 1;
+		Coordinates current_index = opening_parens_index;
+
+		while (parens_count != 0)
+		{
+			advance(current_index, direction, instruction_tensor.getDimensions());
+			scanned++;
+			if (Coordinates::equal(current_index, opening_parens_index))
+			{
+				return std::nullopt;
+			}
+
+			const Cell& current_cell = view(instruction_tensor.read(current_index));
+			if (holds_alternative<ClosingParens>(current_cell))
+			{
+				parens_count--;
+			}
+			else if (holds_alternative<OpeningParens>(current_cell))
+			{
+				parens_count++;
+			}
+			else if (holds_alternative<int>(current_cell) && parens_count == 1)
+			{
+				numbers.push_back(get<0>(current_cell));
+			}
+		}
+
+		return current_index;
+	}
+
+	ParensCache parens_cache;
+	//steps indices, made anew when the direction or the instruction tensor's dimensions change
+	CoordinatesStepper stepper;
+	std::vector<Direction> stepper_direction;
+};
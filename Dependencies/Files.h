@@ -1,101 +1,234 @@
-#ifndef FILES_H_DEFINED
-#define FILES_H_DEFINED
-#include <fstream>
-#include <string>
-#include <iostream>
-#include <assert.h>
-#include <vector>
-
-namespace details
-{
-	template<typename T>
-	concept Fillable = requires(T a)
-	{
-		a.resize(size_t{});
-		a.data();
-		a.size();
-	};
-
-}
-
-class FileReader {
-public:
-	FileReader(std::string givenPath) : path(givenPath), stream(path, std::ios::binary)
-	{
-		assert(!stream.fail() && stream.is_open());
-	}
-
-	~FileReader()
-	{
-		stream.close();
-	}
-
-	[[nodiscard]]
-	size_t calculateLength()
-	{
-		stream.seekg(0, stream.end);
-		size_t length = stream.tellg();
-		stream.seekg(0, stream.beg);
-		return length;
-	}
-
-	void read(char *dataToFill, size_t size)
-	{
-		assert(dataToFill != nullptr);
-		stream.read(dataToFill, size);
-	}
-
-	template<details::Fillable T>
-	T readInto()
-	{
-		T result{};
-		result.resize(calculateLength());
-		read(result.data(), result.size());
-		return result;
-	}
-
-private:
-	std::string path;
-	std::ifstream stream;
-};
-
-class FileWriter {
-public:
-	FileWriter(std::string givenPath) : path(givenPath), stream(path, std::ios::binary) {}
-
-	~FileWriter()
-	{
-		stream.close();
-	}
-
-	template<typename T>
-	[[nodiscard]]
-	bool write(const T &data)
-	{
-		return writeInternal(reinterpret_cast<const char *>(&data), sizeof(T));
-	}
-
-	template<typename T>
-	[[nodiscard]]
-	bool writeVector(const std::vector<T> &data)
-	{
-		return writeInternal(reinterpret_cast<const char *>(data.data()), sizeof(T) * data.size());
-	}
-
-private:
-
-	bool writeInternal(const char *data, size_t size)
-	{
-		stream.write(data, size);
-#ifndef NDEBUG
-		if (stream.fail()) return false;
-#endif
-		return true;
-	}
-
-	std::string path;
-	std::ofstream stream;
-};
-
-
+#ifndef FILES_H_DEFINED
+#define FILES_H_DEFINED
+#include <fstream>
+#include <string>
+#include <iostream>
+#include <assert.h>
+#include <vector>
+#include <span>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FILES_H_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace details
+{
+	template<typename T>
+	concept Fillable = requires(T a)
+	{
+		a.resize(size_t{});
+		a.data();
+		a.size();
+	};
+
+}
+
+class FileReader {
+public:
+	FileReader(std::string givenPath) : path(givenPath), stream(path, std::ios::binary)
+	{
+		assert(!stream.fail() && stream.is_open());
+	}
+
+	~FileReader()
+	{
+		stream.close();
+	}
+
+	[[nodiscard]]
+	size_t calculateLength()
+	{
+		stream.seekg(0, stream.end);
+		size_t length = stream.tellg();
+		stream.seekg(0, stream.beg);
+		return length;
+	}
+
+	void read(char *dataToFill, size_t size)
+	{
+		assert(dataToFill != nullptr);
+		stream.read(dataToFill, size);
+	}
+
+	template<details::Fillable T>
+	T readInto()
+	{
+		T result{};
+		result.resize(calculateLength());
+		read(result.data(), result.size());
+		return result;
+	}
+
+private:
+	std::string path;
+	std::ifstream stream;
+};
+
+class FileWriter {
+public:
+	enum class Mode
+	{
+		Truncate,
+		Append
+	};
+
+	FileWriter(std::string givenPath, Mode mode = Mode::Truncate)
+		: path(givenPath), stream(path, mode == Mode::Append ? std::ios::binary | std::ios::app : std::ios::binary) {}
+
+	~FileWriter()
+	{
+		stream.close();
+	}
+
+	template<typename T>
+	[[nodiscard]]
+	bool write(const T &data)
+	{
+		return writeInternal(reinterpret_cast<const char *>(&data), sizeof(T));
+	}
+
+	template<typename T>
+	[[nodiscard]]
+	bool writeVector(const std::vector<T> &data)
+	{
+		return writeInternal(reinterpret_cast<const char *>(data.data()), sizeof(T) * data.size());
+	}
+
+	[[nodiscard]]
+	bool writeBytes(const char *data, size_t size)
+	{
+		return writeInternal(data, size);
+	}
+
+	[[nodiscard]]
+	bool isOpen() const
+	{
+		return stream.is_open();
+	}
+
+	void flush()
+	{
+		stream.flush();
+	}
+
+private:
+
+	bool writeInternal(const char *data, size_t size)
+	{
+		stream.write(data, size);
+#ifndef NDEBUG
+		if (stream.fail()) return false;
+#endif
+		return true;
+	}
+
+	std::string path;
+	std::ofstream stream;
+};
+
+//a view of a whole file. Mapped into memory where the platform allows it, read in one go otherwise.
+//A copy-on-write view can be written to, without the writes reaching the file
+class MappedFile {
+public:
+	enum class Access
+	{
+		ReadOnly,
+		CopyOnWrite
+	};
+
+	MappedFile(std::string givenPath, Access givenAccess = Access::ReadOnly) : path(givenPath), access(givenAccess)
+	{
+#ifdef FILES_H_MMAP
+		const int descriptor = ::open(path.c_str(), O_RDONLY);
+		if (descriptor < 0) return;
+		struct stat status{};
+		if (::fstat(descriptor, &status) == 0)
+		{
+			size = static_cast<size_t>(status.st_size);
+			opened = true;
+			if (size > 0)
+			{
+				const int protection = access == Access::CopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+				void *mapped = ::mmap(nullptr, size, protection, MAP_PRIVATE, descriptor, 0);
+				if (mapped != MAP_FAILED)
+				{
+					::madvise(mapped, size, access == Access::CopyOnWrite ? MADV_NORMAL : MADV_SEQUENTIAL);
+					data = static_cast<char *>(mapped);
+				}
+				else
+				{
+					opened = false;
+				}
+			}
+		}
+		::close(descriptor);
+#else
+		std::ifstream stream(path, std::ios::binary);
+		if (!stream.is_open()) return;
+		stream.seekg(0, stream.end);
+		fallback.resize(static_cast<size_t>(stream.tellg()));
+		stream.seekg(0, stream.beg);
+		stream.read(fallback.data(), fallback.size());
+		data = fallback.data();
+		size = fallback.size();
+		opened = true;
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef FILES_H_MMAP
+		if (data != nullptr)
+		{
+			::munmap(data, size);
+		}
+#endif
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	[[nodiscard]]
+	bool isOpen() const
+	{
+		return opened;
+	}
+
+	[[nodiscard]]
+	std::span<const char> contents() const
+	{
+		return { data, size };
+	}
+
+	[[nodiscard]]
+	std::string_view text() const
+	{
+		return { data, size };
+	}
+
+	//the contents to write to, for views opened as copy-on-write
+	[[nodiscard]]
+	std::span<char> writableContents()
+	{
+		assert(access == Access::CopyOnWrite);
+		return { data, size };
+	}
+
+private:
+	std::string path;
+	Access access;
+	char *data = nullptr;
+	size_t size = 0;
+	bool opened = false;
+#ifndef FILES_H_MMAP
+	std::vector<char> fallback;
+#endif
+};
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include "Input.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+	bool is_space(const char character)
+	{
+		return character == ' ' || (character >= '\t' && character <= '\r');
+	}
+
+	bool is_digit(const char character)
+	{
+		return character >= '0' && character <= '9';
+	}
+}
+
+namespace Input
+{
+	std::unique_ptr<Reader> Reader::open(const std::string& path, const Format format, Output::Writer* const prompt)
+	{
+		std::unique_ptr<MappedFile> file;
+		if (!path.empty())
+		{
+			file = std::make_unique<MappedFile>(path);
+			if (!file->isOpen())
+			{
+				return nullptr;
+			}
+		}
+		return std::make_unique<Reader>(std::move(file), format, prompt);
+	}
+
+	std::unique_ptr<Reader> Reader::fromBytes(std::vector<char> bytes, const Format format)
+	{
+		auto reader = std::make_unique<Reader>(nullptr, format, nullptr);
+		reader->buffer = std::move(bytes);
+		reader->current = reader->buffer.data();
+		reader->end = reader->current + reader->buffer.size();
+		reader->stdin_ended = true;
+		reader->stdin_read = reader->buffer.size();
+		return reader;
+	}
+
+	Reader::Reader(std::unique_ptr<MappedFile> given_file, const Format given_format, Output::Writer* const given_prompt)
+		: file(std::move(given_file)), format(given_format), prompt(given_prompt)
+	{
+		if (file != nullptr)
+		{
+			current = file->contents().data();
+			end = current + file->contents().size();
+		}
+		else
+		{
+			buffer.resize(BufferSize);
+			current = buffer.data();
+			end = current;
+		}
+	}
+
+	int Reader::read()
+	{
+		if (ended)
+		{
+			return 0;
+		}
+		return format == Format::Text ? readText() : readInt32();
+	}
+
+	Position Reader::position() const
+	{
+		const uint64_t behind = static_cast<uint64_t>(end - current);
+		return Position{ file != nullptr ? static_cast<uint64_t>(current - file->contents().data()) : stdin_read - behind, ended };
+	}
+
+	void Reader::skipTo(const Position& skipped)
+	{
+		ended = skipped.ended;
+		if (file != nullptr)
+		{
+			current = file->contents().data() + std::min<uint64_t>(skipped.consumed, file->contents().size());
+			return;
+		}
+
+		while (stdin_read < skipped.consumed)
+		{
+			current = end;
+			if (!refill())
+			{
+				return;
+			}
+		}
+		current = end - (stdin_read - skipped.consumed);
+	}
+
+	int Reader::readText()
+	{
+		while (true)
+		{
+			while (current != end && is_space(*current))
+			{
+				current++;
+			}
+			if (current != end)
+			{
+				break;
+			}
+			if (!refill())
+			{
+				ended = true;
+				return 0;
+			}
+		}
+
+		//a value split over two reads of stdin has to be whole before parsing it
+		while (std::find_if(current, end, is_space) == end && refill())
+		{
+		}
+
+		const char* first = current;
+		//std::cin accepted a plus sign, std::from_chars does not
+		if (*first == '+' && first + 1 != end && is_digit(first[1]))
+		{
+			first++;
+		}
+
+		int value = 0;
+		const auto [last, error] = std::from_chars(first, end, value);
+		if (error == std::errc::invalid_argument)
+		{
+			ended = true;
+			return 0;
+		}
+		if (error == std::errc::result_out_of_range)
+		{
+			ended = true;
+			return *first == '-' ? INT_MIN : INT_MAX;
+		}
+		current = last;
+		return value;
+	}
+
+	int Reader::readInt32()
+	{
+		while (end - current < 4 && refill())
+		{
+		}
+		if (end - current < 4)
+		{
+			ended = true;
+			return 0;
+		}
+
+		unsigned char bytes[4];
+		std::memcpy(bytes, current, 4);
+		current += 4;
+		const uint32_t bits = bytes[0] | (bytes[1] << 8) | (bytes[2] << 8 * 2) | (static_cast<uint32_t>(bytes[3]) << 8 * 3);
+		return static_cast<int>(bits);
+	}
+
+	bool Reader::refill()
+	{
+		if (file != nullptr || stdin_ended)
+		{
+			return false;
+		}
+
+		const size_t left = static_cast<size_t>(end - current);
+		std::memmove(buffer.data(), current, left);
+		if (left == buffer.size())
+		{
+			buffer.resize(buffer.size() * 2);
+		}
+
+		//the program may have asked the user for this value
+		if (prompt != nullptr)
+		{
+			prompt->flush();
+		}
+#ifdef _WIN32
+		const auto count = _read(0, buffer.data() + left, static_cast<unsigned int>(buffer.size() - left));
+#else
+		ssize_t count = 0;
+		do
+		{
+			count = ::read(0, buffer.data() + left, buffer.size() - left);
+		} while (count < 0 && errno == EINTR);
+#endif
+		current = buffer.data();
+		end = current + left + (count > 0 ? count : 0);
+		if (count <= 0)
+		{
+			stdin_ended = true;
+			return false;
+		}
+		stdin_read += static_cast<uint64_t>(count);
+		return true;
+	}
+}
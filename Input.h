@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Output.h"
+#include "Dependencies/Files.h"
+
+//where instruction 6 reads its values from. Files are mapped into memory, stdin is read ahead in large blocks,
+//so reading a value usually does not have to go through iostreams or make a system call
+namespace Input
+{
+	enum class Format
+	{
+		//whitespace separated ints, like std::cin >> int reads them
+		Text,
+		//little-endian int32s, back to back
+		Int32
+	};
+
+	//how far the input was read, for a run resumed from a checkpoint to skip
+	struct Position
+	{
+		uint64_t consumed = 0;
+		//whether every read gives 0 from here on
+		bool ended = false;
+	};
+
+	//hands out values from a window onto the input. For a file the window is the whole file,
+	//for stdin it is a buffer which gets refilled whenever a value reaches past its end
+	class Reader
+	{
+	public:
+		//starts reading from the file at the path, or from stdin if the path is empty. Output the program wrote through
+		//the prompt, if given, is flushed before waiting on stdin. Returns nullptr if the file could not be opened
+		static std::unique_ptr<Reader> open(const std::string& path, Format format, Output::Writer* prompt = nullptr);
+		//reads the bytes, which are all of the input there is, like stdin which has ended behind them
+		static std::unique_ptr<Reader> fromBytes(std::vector<char> bytes, Format format);
+
+		Reader(std::unique_ptr<MappedFile> file, Format format, Output::Writer* prompt);
+
+		//the next value. Once the input ends, or stops looking like ints, every read gives 0, the same as std::cin did.
+		//Text out of the range of int gives the closest int first
+		int read();
+
+		Position position() const;
+
+		//skips the input up to the position, which a run given the same input got to.
+		//Stdin is read up to there, so a resumed run has to be given its input again from the start
+		void skipTo(const Position& position);
+
+	private:
+		static constexpr size_t BufferSize = size_t{ 1 } << 16;
+
+		int readText();
+		int readInt32();
+
+		//moves what is left of the buffer to its front and reads more of stdin behind it.
+		//Returns whether anything was read
+		bool refill();
+
+		std::unique_ptr<MappedFile> file;
+		Format format;
+		Output::Writer* prompt;
+
+		std::vector<char> buffer;
+		const char* current = nullptr;
+		const char* end = nullptr;
+
+		bool stdin_ended = false;
+		//everything read from stdin so far, to tell how much of it was consumed
+		uint64_t stdin_read = 0;
+		//no more values will be read, because the input ended or could not be parsed
+		bool ended = false;
+	};
+}
@@ -1,181 +1,504 @@
-#include "InputFileParser.h"
-#include <iostream>
-#include <sstream>
-#include <unordered_map>
-#include <array>
-#include <algorithm>
-#include "Dependencies/Logger/Logger.h"
-
-
-namespace 
-{
-	void remove_crlf(std::string& s)
-	{
-		for (std::string::size_type pos = s.find("\r\n"); pos != std::string::npos; pos = s.find("\r\n"))
-		{
-			s.erase(pos, 1);
-		}
-	}
-
-	using Words = std::array<std::string, 12>;
-
-	bool validate(const Words& words)
-	{
-		for(auto& word : words)
-		{
-			auto contains = [&word](const char* contained)
-			{
-				return word.find(contained) != std::string::npos;
-			};
-
-			if(std::count(words.begin(), words.end(), word) > 1)
-			{
-				Logger::LogErrorFormatted("Word %s is not unique! Please provide unique words", word.c_str());
-				return false;
-			}
-
-			if(contains("("))
-			{
-				Logger::LogErrorFormatted("Word %s contains reserved character \"(\"!", word.c_str());
-				return false;
-			}
-
-			if (contains(")"))
-			{
-				Logger::LogErrorFormatted("Word %s contains reserved character \")\"!", word.c_str());
-				return false;
-			}
-		}
-
-		return true;
-	}
-
-
-	std::optional<Words> parse_words(const std::string words)
-	{
-		if (words.empty())
-		{
-			return std::nullopt;
-		}
-
-		Words result{};
-		std::string line;
-		std::string token;
-
-		std::stringstream stream(words);
-		
-		for(auto& word : result)
-		{
-			if(!(stream >> word))
-			{
-				Logger::LogError("Too few words specified! Please specify all words.");
-				return std::nullopt;
-			}
-		}
-
-		if(!validate(result))
-		{
-			return std::nullopt;
-		}
-		
-		return result;
-	}
-
-	std::optional<int> get_instruction(const std::string& token, const std::optional<Words> maybe_words, int x, int y)
-	{
-		if (maybe_words)
-		{
-			const auto& words = maybe_words.value();
-			auto it = std::find(words.begin(), words.end(), token);
-			if(it != words.end())
-			{
-				return static_cast<int>(std::distance(words.begin(), it));
-			}
-		}
-		
-		try
-		{
-			return std::stoi(token);
-		}
-		catch (...)
-		{
-			Logger::LogErrorFormatted("Initial state parsing: could not parse cell at row %u, column %u. Instead, found '%s'", x, y, token.c_str());
-			return std::nullopt;
-		}
-		
-	}
-}
-
-
-namespace InputFile
-{
-    std::optional<Tensor<Cell>> parse(std::string contents, std::string words)
-	{
-		Tensor<Cell> result;
-
-		remove_crlf(contents);
-		remove_crlf(words);
-
-		auto maybe_words = parse_words(words);
-
-		std::vector<int> coords = { 0 };
-
-		std::string line;
-		std::string token;
-
-		std::stringstream cellsStream(contents);
-		for (int y = 0; std::getline(cellsStream, line, '\n'); y++)
-		{
-			std::stringstream line_stream(line);
-
-			int x = 0;
-			while (line_stream >> token)
-			{
-				if (token.starts_with('/')) //comments
-				{
-					y--;
-					break;
-				}
-
-				coords[0] = x;
-
-				if (y != 0)
-				{
-					if (coords.size() == 1)
-					{
-						coords.push_back(y);
-					}
-					else
-					{
-						coords[1] = y;
-					}
-				}
-
-				//use the words here if it's possible to do so
-				if (token.compare("(") == 0)
-				{
-					result.setAtCoordinates(coords, OpeningParens{});
-				}
-				else if (token.compare(")") == 0)
-				{
-					result.setAtCoordinates(coords, ClosingParens{});
-				}
-				else
-				{
-					if(auto maybe_instruction = get_instruction(token, maybe_words, x, y))
-					{
-						result.setAtCoordinates(coords, maybe_instruction.value());
-					}
-					else
-					{
-						return std::nullopt;
-					}
-				}
-
-				x++;
-			}
-		}
-
-		return result;
-	}
-}
+#include "InputFileParser.h"
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <climits>
+#include <span>
+#include <thread>
+#include "ProgramImage.h"
+#include "Dependencies/Files.h"
+#include "Dependencies/Logger/Logger.h"
+
+
+namespace
+{
+	//the whitespace std::stringstream skipped between tokens, which carriage returns of CRLF line ends are part of
+	bool is_space(const char character)
+	{
+		return character == ' ' || (character >= '\t' && character <= '\r');
+	}
+
+	bool is_digit(const char character)
+	{
+		return character >= '0' && character <= '9';
+	}
+
+	//the next whitespace delimited token of the text, taking it off the front. Empty at the text's end
+	std::string_view next_token(std::string_view& text)
+	{
+		size_t start = 0;
+		while (start < text.size() && is_space(text[start]))
+		{
+			start++;
+		}
+		size_t end = start;
+		while (end < text.size() && !is_space(text[end]))
+		{
+			end++;
+		}
+		const std::string_view token = text.substr(start, end - start);
+		text.remove_prefix(end);
+		return token;
+	}
+
+	//the next line of the text, without its line feed, taking it off the front
+	std::string_view next_line(std::string_view& text)
+	{
+		const size_t line_feed = text.find('\n');
+		const std::string_view line = text.substr(0, line_feed);
+		text.remove_prefix(line_feed == std::string_view::npos ? text.size() : line_feed + 1);
+		return line;
+	}
+
+	using Words = std::array<std::string, 12>;
+
+	bool validate(const Words& words)
+	{
+		for(auto& word : words)
+		{
+			auto contains = [&word](const char* contained)
+			{
+				return word.find(contained) != std::string::npos;
+			};
+
+			if(std::count(words.begin(), words.end(), word) > 1)
+			{
+				Logger::LogErrorFormatted("Word %s is not unique! Please provide unique words", word.c_str());
+				return false;
+			}
+
+			if(contains("("))
+			{
+				Logger::LogErrorFormatted("Word %s contains reserved character \"(\"!", word.c_str());
+				return false;
+			}
+
+			if (contains(")"))
+			{
+				Logger::LogErrorFormatted("Word %s contains reserved character \")\"!", word.c_str());
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+
+	std::optional<Words> parse_words(std::string_view words)
+	{
+		if (words.empty())
+		{
+			return std::nullopt;
+		}
+
+		Words result{};
+		for(auto& word : result)
+		{
+			const std::string_view token = next_token(words);
+			if(token.empty())
+			{
+				Logger::LogError("Too few words specified! Please specify all words.");
+				return std::nullopt;
+			}
+			word = token;
+		}
+
+		if(!validate(result))
+		{
+			return std::nullopt;
+		}
+
+		return result;
+	}
+
+	//finds the instruction a word stands for with one hash and one compare. The hash is seeded anew
+	//until no two words share a slot, which for 12 words in 64 slots takes a few tries on average
+	class WordTable
+	{
+	public:
+		explicit WordTable(Words given_words) : words(std::move(given_words))
+		{
+			for (seed = 0;; seed++)
+			{
+				slots.fill(Empty);
+				const bool collided = std::any_of(words.begin(), words.end(), [this](const std::string& word)
+				{
+					signed char& slot = slots[slotOf(word)];
+					if (slot != Empty)
+					{
+						return true;
+					}
+					slot = static_cast<signed char>(&word - words.data());
+					return false;
+				});
+				if (!collided)
+				{
+					break;
+				}
+			}
+		}
+
+		std::optional<int> find(const std::string_view token) const
+		{
+			const signed char slot = slots[slotOf(token)];
+			if (slot == Empty || words[slot] != token)
+			{
+				return std::nullopt;
+			}
+			return slot;
+		}
+
+	private:
+		static constexpr signed char Empty = -1;
+
+		size_t slotOf(const std::string_view word) const
+		{
+			uint64_t hash = 0xcbf29ce484222325ull ^ (seed * 0x9e3779b97f4a7c15ull);
+			for (const char character : word)
+			{
+				hash = (hash ^ static_cast<unsigned char>(character)) * 0x100000001b3ull;
+			}
+			//FNV-1a hardly reaches the top bits for short words, so they are mixed in before taking the slot from there
+			hash ^= hash >> 33;
+			hash *= 0xff51afd7ed558ccdull;
+			hash ^= hash >> 33;
+			return static_cast<size_t>(hash >> 58);
+		}
+
+		Words words{};
+		std::array<signed char, 64> slots{};
+		uint64_t seed = 0;
+	};
+
+	//what std::stoi made of a token: the int its leading digits spell, after an optional sign
+	std::optional<int> parse_number(const std::string_view token)
+	{
+		const char* first = token.data();
+		const char* const last = token.data() + token.size();
+		if (first != last && *first == '+' && first + 1 != last && is_digit(first[1]))
+		{
+			first++;
+		}
+
+		int value = 0;
+		//the two lowest ints encode the parens, so a cell can not hold them
+		if (std::from_chars(first, last, value).ec != std::errc() || value < Cell::MinInt)
+		{
+			return std::nullopt;
+		}
+		return value;
+	}
+
+	std::optional<int> get_instruction(const std::string_view token, const std::optional<WordTable>& maybe_words)
+	{
+		if (maybe_words)
+		{
+			if (const std::optional<int> instruction = maybe_words->find(token))
+			{
+				return instruction;
+			}
+		}
+		return parse_number(token);
+	}
+
+	//a cell which could not be parsed. Parts of the program are parsed in parallel, so it is only reported once it is
+	//known to be the first one
+	struct ParseFailure
+	{
+		int x;
+		int y;
+		std::string token;
+	};
+
+	void report(const ParseFailure& failure)
+	{
+		Logger::LogErrorFormatted("Initial state parsing: could not parse cell at row %u, column %u. Instead, found '%s'", failure.x, failure.y, failure.token.c_str());
+	}
+
+	//goes through the rows of the text, the first of which is row first_y, passing each row's number and its text up to a
+	//comment, if any, to on_row. Lines with a comment do not take up a row, so the next line starts over on the same row.
+	//Returns the row after the text's last one, or nullopt if on_row stopped
+	template<typename OnRow_t>
+	std::optional<int> for_each_row(std::string_view text, const int first_y, OnRow_t&& on_row)
+	{
+		int y = first_y;
+		for (; !text.empty(); y++)
+		{
+			std::string_view line = next_line(text);
+
+			std::string_view rest = line;
+			bool commented = false;
+			//most lines have no slash at all, and only need to be split into tokens once
+			for (std::string_view token = line.find('/') != std::string_view::npos ? next_token(rest) : std::string_view(); !token.empty(); token = next_token(rest))
+			{
+				if (token.starts_with('/')) //comments
+				{
+					line = line.substr(0, static_cast<size_t>(token.data() - line.data()));
+					commented = true;
+					break;
+				}
+			}
+
+			if (!on_row(y, line))
+			{
+				return std::nullopt;
+			}
+			if (commented)
+			{
+				y--;
+			}
+		}
+		return y;
+	}
+
+	//what measuring a text finds, with rows counted from the text's first one
+	struct Shape
+	{
+		//the rows the text takes up, i.e. its lines less the commented ones
+		int rows = 0;
+		int width = 0;
+		//the last row with any cells, -1 if there is none
+		int last_row = -1;
+		size_t cells = 0;
+	};
+
+	Shape measure(const std::string_view text)
+	{
+		Shape shape;
+		shape.rows = for_each_row(text, 0, [&shape](const int y, std::string_view line)
+		{
+			int x = 0;
+			while (!next_token(line).empty())
+			{
+				x++;
+			}
+			if (x != 0)
+			{
+				shape.width = std::max(shape.width, x);
+				shape.last_row = y;
+				shape.cells += static_cast<size_t>(x);
+			}
+			return true;
+		}).value();
+		return shape;
+	}
+
+	//parses the rows of the text, the first of which is row first_y, passing each row's number and cells to on_row.
+	//Returns the first cell which could not be parsed, if any, without going on after it
+	template<typename OnRow_t>
+	std::optional<ParseFailure> parse_rows(const std::string_view text, const int first_y, const std::optional<WordTable>& maybe_words, OnRow_t&& on_row)
+	{
+		std::optional<ParseFailure> failure;
+		std::vector<Cell> row;
+		for_each_row(text, first_y, [&](const int y, std::string_view line)
+		{
+			row.clear();
+			for (std::string_view token = next_token(line); !token.empty(); token = next_token(line))
+			{
+				if (token == "(")
+				{
+					row.push_back(OpeningParens{});
+				}
+				else if (token == ")")
+				{
+					row.push_back(ClosingParens{});
+				}
+				else if (const std::optional<int> instruction = get_instruction(token, maybe_words))
+				{
+					row.push_back(instruction.value());
+				}
+				else
+				{
+					failure = ParseFailure{ static_cast<int>(row.size()), y, std::string(token) };
+					return false;
+				}
+			}
+
+			on_row(y, std::span<const Cell>(row));
+			return true;
+		});
+		return failure;
+	}
+
+	Coordinates row_start(const int y)
+	{
+		return y == 0 ? Coordinates(0) : Coordinates(0, y);
+	}
+
+	//a run of whole lines of the program, which one thread measures and parses. Its rows are numbered from first_y on,
+	//which is only known once every part before it is measured
+	struct Part
+	{
+		std::string_view text;
+		Shape shape;
+		int first_y = 0;
+
+		//the parsed rows' cells back to back, and every row's number and length
+		std::vector<Cell> cells;
+		std::vector<std::pair<int, size_t>> rows;
+		std::optional<ParseFailure> failure;
+	};
+
+	//parts are made no smaller than this, below which starting a thread costs more than it saves
+	constexpr size_t MinPartSize = size_t{ 1 } << 20;
+
+	//splits the text after line feeds into up to count parts of about the same size
+	std::vector<Part> split(const std::string_view text, const size_t count)
+	{
+		std::vector<Part> parts;
+		size_t begin = 0;
+		for (size_t i = 1; i <= count; i++)
+		{
+			size_t end = text.size();
+			if (i < count)
+			{
+				const size_t line_feed = text.find('\n', std::max(begin, text.size() / count * i));
+				end = line_feed == std::string_view::npos ? text.size() : line_feed + 1;
+			}
+			if (end > begin || parts.empty())
+			{
+				parts.emplace_back().text = text.substr(begin, end - begin);
+			}
+			begin = end;
+		}
+		return parts;
+	}
+
+	//runs the function on every part, the first one on this thread and every other one on a thread of its own
+	template<typename Function_t>
+	void for_each_part_in_parallel(std::vector<Part>& parts, Function_t&& function)
+	{
+		std::vector<std::thread> threads;
+		threads.reserve(parts.size() - 1);
+		for (size_t i = 1; i < parts.size(); i++)
+		{
+			threads.emplace_back([&function, &part = parts[i]] { function(part); });
+		}
+		function(parts.front());
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+}
+
+
+namespace InputFile
+{
+	std::optional<Tensor<Cell>> parse(const std::string_view contents, const std::string_view words, unsigned threads)
+	{
+		std::optional<WordTable> maybe_words;
+		if (std::optional<Words> parsed_words = parse_words(words))
+		{
+			maybe_words.emplace(std::move(parsed_words).value());
+		}
+
+		if (threads == 0)
+		{
+			threads = std::clamp<unsigned>(static_cast<unsigned>(std::min<size_t>(contents.size() / MinPartSize, UINT_MAX)), 1, std::max(1u, std::thread::hardware_concurrency()));
+		}
+		std::vector<Part> parts = split(contents, threads);
+
+		//the first pass only measures the parts. Lines with comments shift the rows of every line after them, so a part's
+		//first row is the sum of the rows of the parts before it. Rows below the first one make the tensor 2-dimensional
+		for_each_part_in_parallel(parts, [](Part& part) { part.shape = measure(part.text); });
+		int width = 1;
+		int height = 0;
+		size_t cell_count = 0;
+		int first_y = 0;
+		for (Part& part : parts)
+		{
+			part.first_y = first_y;
+			first_y += part.shape.rows;
+			width = std::max(width, part.shape.width);
+			if (part.shape.last_row >= 0)
+			{
+				height = std::max(height, part.first_y + part.shape.last_row + 1);
+			}
+			cell_count += part.shape.cells;
+		}
+
+		//with the dimensions known, the tensor is laid out for all of the cells before the second pass parses them
+		Tensor<Cell> result;
+		const std::vector<int> dimensions = height > 1 ? std::vector<int>{ width, height } : std::vector<int>{ width };
+		result.reserve(dimensions, cell_count);
+
+		std::optional<ParseFailure> failure;
+		if (parts.size() == 1)
+		{
+			failure = parse_rows(contents, 0, maybe_words, [&result](const int y, const std::span<const Cell> cells)
+			{
+				result.setRow(row_start(y), cells);
+			});
+		}
+		else
+		{
+			for_each_part_in_parallel(parts, [&maybe_words](Part& part)
+			{
+				part.cells.reserve(part.shape.cells);
+				part.failure = parse_rows(part.text, part.first_y, maybe_words, [&part](const int y, const std::span<const Cell> cells)
+				{
+					part.cells.insert(part.cells.end(), cells.begin(), cells.end());
+					part.rows.emplace_back(y, cells.size());
+				});
+			});
+
+			//merged in order, as the first line of a part overwrites the last row of the part before it if that ended in a comment
+			for (Part& part : parts)
+			{
+				if (part.failure.has_value())
+				{
+					failure = std::move(part.failure);
+					break;
+				}
+				size_t begin = 0;
+				for (const auto& [y, length] : part.rows)
+				{
+					result.setRow(row_start(y), std::span<const Cell>(part.cells).subspan(begin, length));
+					begin += length;
+				}
+				std::vector<Cell>().swap(part.cells);
+			}
+		}
+
+		if (failure.has_value())
+		{
+			report(failure.value());
+			return std::nullopt;
+		}
+		return result;
+	}
+
+	std::optional<Tensor<Cell>> load(const std::string& path, const std::string& words_path)
+	{
+		//the program is parsed straight out of the mapped files, without copying them
+		const MappedFile input(path);
+		if (!input.isOpen())
+		{
+			Logger::LogError("Could not open the input file");
+			return std::nullopt;
+		}
+
+		//compiled programs are used straight from their image, which already has the words resolved
+		if (ProgramImage::isImage(input.text()))
+		{
+			return ProgramImage::load(path);
+		}
+
+		std::optional<MappedFile> words;
+		if (!words_path.empty())
+		{
+			words.emplace(words_path);
+			if (!words->isOpen())
+			{
+				Logger::LogError("Could not open the words file");
+				return std::nullopt;
+			}
+		}
+
+		return parse(input.text(), words.has_value() ? words->text() : std::string_view());
+	}
+}
@@ -1,11 +1,19 @@
-#pragma once
-#include <string>
-#include <optional>
-#include "Tensor.h"
-#include "Cell.h"
-
-namespace InputFile
-{
-	std::optional<Tensor<Cell>> parse(std::string contents, std::string words);
-}
-
+#pragma once
+#include <string>
+#include <string_view>
+#include <optional>
+#include "Tensor.h"
+#include "Cell.h"
+
+namespace InputFile
+{
+	//parses the program and the words for its instructions, if any. Large programs are split into parts which are parsed
+	//on threads of their own, as many as given or, for 0, as the hardware and the program's size call for.
+	//The tensor is the same for any number of threads
+	std::optional<Tensor<Cell>> parse(std::string_view contents, std::string_view words, unsigned threads = 0);
+
+	//the program in the file at the path: the tensor in its image if it was compiled, its text parsed with the words
+	//in the file at words_path, if that is set, otherwise. Logs why if it could not be loaded
+	std::optional<Tensor<Cell>> load(const std::string& path, const std::string& words_path);
+}
+
@@ -0,0 +1,66 @@
+#pragma once
+#include <unordered_map>
+#include "Coordinates.h"
+
+//where the instruction cursor is and which way it moves, which together with the contents of the instruction
+//tensor decide everything the cursor goes on to execute. Engines key what they derive from the tensor by it
+struct InstructionKey
+{
+	Coordinates tensor_index;
+	Coordinates cell_index;
+	Coordinates movement;
+};
+
+//looks keys up without copying the coordinates into an InstructionKey
+struct InstructionKeyView
+{
+	const Coordinates& tensor_index;
+	const Coordinates& cell_index;
+	const Coordinates& movement;
+};
+
+struct InstructionKeyHash
+{
+	using is_transparent = void;
+
+	template<typename Key_t>
+	size_t operator()(const Key_t& key) const
+	{
+		const CoordinatesHash hash;
+		return (hash(key.tensor_index) * 31 + hash(key.cell_index)) * 31 + hash(key.movement);
+	}
+};
+
+struct InstructionKeyEqual
+{
+	using is_transparent = void;
+
+	template<typename Lhs_t, typename Rhs_t>
+	bool operator()(const Lhs_t& lhs, const Rhs_t& rhs) const
+	{
+		return Coordinates::equal(lhs.tensor_index, rhs.tensor_index)
+			&& Coordinates::equal(lhs.cell_index, rhs.cell_index)
+			&& Coordinates::equal(lhs.movement, rhs.movement);
+	}
+};
+
+template<typename Value_t>
+class InstructionKeyMap
+{
+public:
+	//the value for the given key, default constructed if there was none
+	Value_t& entryFor(const Coordinates& tensor_index, const Coordinates& cell_index, const Coordinates& movement)
+	{
+		auto it = values.find(InstructionKeyView{ tensor_index, cell_index, movement });
+		if (it == values.end())
+		{
+			it = values.emplace(InstructionKey{ tensor_index.canonical(), cell_index.canonical(), movement.canonical() }, Value_t{}).first;
+		}
+		return it->second;
+	}
+
+	size_t size() const { return values.size(); }
+
+private:
+	std::unordered_map<InstructionKey, Value_t, InstructionKeyHash, InstructionKeyEqual> values;
+};
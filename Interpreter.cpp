@@ -0,0 +1,328 @@
+#include "Interpreter.h"
+#include <type_traits>
+#include "Checkpoint.h"
+#include "Profiler.h"
+
+Cell incremented_cell(const Cell& cell)
+{
+	if (holds_alternative<int>(cell))
+	{
+		return wrapping_add(get<0>(cell), 1);
+	}
+	return 0;
+}
+
+Cell decremented_cell(const Cell& cell)
+{
+	if (holds_alternative<int>(cell))
+	{
+		return wrapping_add(get<0>(cell), -1);
+	}
+	return 0;
+}
+
+Interpreter::Interpreter(Tensor<Cell>&& program)
+{
+	instructionTensor() = std::move(program);
+}
+
+Tensor<Cell>& Interpreter::tensorUnder(Cursor& cursor)
+{
+	if (!cursor.tensor_handle.pointsAt(cursor.tensor_index))
+	{
+		cursor.tensor_handle.retarget(cursor.tensor_index);
+	}
+	return meta_tensor.at(cursor.tensor_handle);
+}
+
+TensorHandle<Cell>& Interpreter::cellHandleOf(Cursor& cursor)
+{
+	if (!cursor.cell_handle.pointsAt(cursor.cell_index))
+	{
+		cursor.cell_handle.retarget(cursor.cell_index);
+	}
+	return cursor.cell_handle;
+}
+
+Tensor<Cell>& Interpreter::instructionTensor() 
+{
+	return tensorUnder(instruction_cursor);
+}
+
+Tensor<Cell>& Interpreter::dataTensor()
+{
+	return tensorUnder(data_cursor);
+}
+
+const Cell& Interpreter::currentDataCell() 
+{
+	return dataTensor().read(cellHandleOf(data_cursor));
+}
+
+void Interpreter::setCurrentDataCell(const Cell& cell)
+{
+	dataTensor().set(cellHandleOf(data_cursor), cell);
+}
+
+Coordinates Interpreter::currentMovement() const
+{
+	return movement_of(instruction_cursor_direction);
+}
+
+Coordinates& Interpreter::advanceIndex(Coordinates& index) 
+{
+	return decoder.advance(index, instruction_cursor_direction, instructionTensor().getDimensions());
+}
+
+template<bool Profiled>
+const PairedParens& Interpreter::pairParens(const Coordinates& opening_parens_index)
+{
+	[[maybe_unused]] uint64_t start = 0;
+	if constexpr (Profiled)
+	{
+		start = Profiler::now();
+	}
+
+	std::optional<size_t> scanned;
+	const PairedParens& paired = decoder.pairParens(instructionTensor(), instruction_cursor.tensor_index, instruction_cursor_direction, opening_parens_index,
+		[](const Cell& cell) -> const Cell& { return cell; }, scanned);
+	if constexpr (Profiled)
+	{
+		profiler->countPairing(Profiler::now() - start, scanned);
+	}
+	return paired;
+}
+
+
+template<bool Profiled, typename Operation_t>
+bool Interpreter::pairParensAndExecute(const Operation_t& operation) 
+{
+	Coordinates next = instruction_cursor.cell_index;
+	advanceIndex(next);
+	const PairedParens& paired_parens = pairParens<Profiled>(next);
+	const Coordinates no_numbers;
+	const PairParensReturn found_or_implied = paired_parens.closing_parens_index.has_value()
+		? PairParensReturn{ paired_parens.closing_parens_index.value(), paired_parens.numbers }
+		: PairParensReturn{ next, no_numbers };
+
+	if constexpr (std::is_invocable_r<bool, Operation_t, PairParensReturn>())
+	{
+		return operation(found_or_implied);
+	}
+	else
+	{
+		operation(found_or_implied);
+		return true;
+	}
+}
+
+void Interpreter::outputCell(const Cell& cell)
+{
+	if (output == nullptr)
+	{
+		output = Output::Writer::open("", Output::Format::Text);
+	}
+	output->write(cell);
+}
+
+int Interpreter::readUserInput()
+{
+	if (input == nullptr)
+	{
+		input = Input::Reader::open("", Input::Format::Text, output.get());
+	}
+	return input->read();
+}
+
+template<bool Profiled>
+bool Interpreter::executeInstruction(const Instruction instruction)
+{
+	bool succeeded = true;
+	
+	switch (instruction) 
+	{
+	case OutputCurrentData:
+	{
+		outputCell(currentDataCell());
+	}
+	break;
+	case IncrementDataCursorCellIndex:
+	{
+		succeeded = pairParensAndExecute<Profiled>([&](const PairParensReturn& paired_parens)
+		{
+			data_cursor.cell_index.increment(paired_parens.numbers, dataTensor().getDimensions());
+		});
+	}
+	break;
+	case SetDataCursorTensorIndex:
+	{
+		succeeded = pairParensAndExecute<Profiled>([&](const PairParensReturn& paired_parens)
+		{
+			data_cursor.tensor_index = paired_parens.numbers;
+		});
+	}
+	break;
+	case IncrementDataCell:
+	{
+		setCurrentDataCell(incremented_cell(currentDataCell()));
+	}
+	break;
+	case DecrementDataCell:
+	{
+		setCurrentDataCell(decremented_cell(currentDataCell()));
+	}
+	break;
+	case SetInstructionCursorDirection:
+	{
+		succeeded = pairParensAndExecute<Profiled>([&](const PairParensReturn& paired_parens)
+		{
+			set_direction(instruction_cursor_direction, paired_parens.numbers);
+		});
+	}
+	break;
+	case SetDataCellUserInput:
+	{
+		setCurrentDataCell(readUserInput());
+	}
+	break;
+	case ConditionalSetInstructionCursorCellIndex:
+	{
+		succeeded = pairParensAndExecute<Profiled>([&](const PairParensReturn& paired_parens)
+		{
+			const Cell& data_cell = currentDataCell();
+			const bool data_cell_is_zero = holds_alternative<int>(data_cell) && get<0>(data_cell) == 0;
+			if (data_cell_is_zero)
+			{
+				jumped = true;
+				instruction_cursor.cell_index = paired_parens.numbers;
+				//the jumped-to instruction failing (e.g. unpaired parens) has never stopped the program
+				executeCurrentInstruction<Profiled>();
+			}
+		});
+	}
+	break;
+	case SetDataCellOpeningParens:
+	{
+		setCurrentDataCell(OpeningParens{});
+	}
+	break;
+	case SetDataCellClosingParens:
+	{
+		setCurrentDataCell(ClosingParens{});
+	}
+	break;
+	case SetInstructionCursorTensorIndex:
+	{
+		succeeded = pairParensAndExecute<Profiled>([&](const PairParensReturn& paired_parens)
+		{
+			instruction_cursor.tensor_index = paired_parens.numbers;
+		});
+	}
+	break;
+	case ShrinkTensor:
+	{
+		succeeded = pairParensAndExecute<Profiled>([&](const PairParensReturn& paired_parens)
+		{
+			meta_tensor.at(paired_parens.numbers).shrink();
+		});
+	}
+	break;
+	}
+
+	return succeeded;
+}
+
+template<bool Profiled>
+bool Interpreter::executeCurrentInstruction()
+{
+	//the instruction cursor moves on every tick, so a handle would rarely be used twice
+	const Cell& current_cell = instructionTensor().read(instruction_cursor.cell_index);
+
+	if (holds_alternative<int>(current_cell))
+	{
+		const Instruction current_instruction = static_cast<Instruction>(get<0>(current_cell) % Instruction::InstructionCount);
+		if (!executeInstruction<Profiled>(current_instruction))
+		{
+			return false;
+		}
+	}
+	else if (holds_alternative<OpeningParens>(current_cell))
+	{
+		std::optional<Coordinates> found_closing_parens = pairParens<Profiled>(instruction_cursor.cell_index).closing_parens_index;
+		if (found_closing_parens.has_value())
+		{
+			instruction_cursor.cell_index = found_closing_parens.value();
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+template<bool Profiled>
+TickOutcome Interpreter::tick()
+{
+	const Coordinates last_cell_index = instruction_cursor.cell_index;
+	const Coordinates last_tensor_index = instruction_cursor.tensor_index;
+	[[maybe_unused]] size_t kind = 0;
+	[[maybe_unused]] uint64_t start = 0;
+	if constexpr (Profiled)
+	{
+		kind = Profiler::kindOf(instructionTensor().read(instruction_cursor.cell_index));
+		start = Profiler::now();
+	}
+
+	const bool executed = executeCurrentInstruction<Profiled>();
+	if constexpr (Profiled)
+	{
+		profiler->countTick(last_tensor_index, last_cell_index, kind, Profiler::now() - start);
+	}
+	if (!executed)
+	{
+		return TickOutcome::Failed;
+	}
+	advanceIndex(instruction_cursor.cell_index);
+
+	const bool moved = !Coordinates::equal(last_cell_index, instruction_cursor.cell_index)
+		|| !Coordinates::equal(last_tensor_index, instruction_cursor.tensor_index);
+	return moved ? TickOutcome::Continue : TickOutcome::Halted;
+}
+
+template<bool Profiled>
+TickOutcome Interpreter::runTicks(const uint64_t max_ticks)
+{
+	TickOutcome outcome = TickOutcome::Continue;
+	jumped = false;
+	for (uint64_t ticks = 0; outcome == TickOutcome::Continue && ticks < max_ticks; ticks++)
+	{
+		Checkpoint::poll(*this);
+		outcome = tick<Profiled>();
+		ticks_run++;
+		if (jumped)
+		{
+			jumped = false;
+			if (outcome == TickOutcome::Continue)
+			{
+				const uint64_t skipped = loop_idioms.fastForward(*this, max_ticks - ticks - 1);
+				ticks += skipped;
+				ticks_run += skipped;
+			}
+		}
+	}
+	return outcome;
+}
+
+TickOutcome Interpreter::run(const uint64_t max_ticks)
+{
+	return profiler != nullptr ? runTicks<true>(max_ticks) : runTicks<false>(max_ticks);
+}
+
+template const PairedParens& Interpreter::pairParens<false>(const Coordinates&);
+template const PairedParens& Interpreter::pairParens<true>(const Coordinates&);
+template bool Interpreter::executeCurrentInstruction<false>();
+template bool Interpreter::executeCurrentInstruction<true>();
+template TickOutcome Interpreter::tick<false>();
+template TickOutcome Interpreter::tick<true>();
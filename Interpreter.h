@@ -0,0 +1,132 @@
+#pragma once
+#include <memory>
+#include <optional>
+#include <vector>
+#include "Tensor.h"
+#include "Cell.h"
+#include "Decoder.h"
+#include "LoopIdiom.h"
+#include "Input.h"
+#include "Output.h"
+
+class Profiler;
+
+//the interpreter's state and the decoding path, shared by every engine so that they agree on what each instruction does.
+//Nothing is shared between interpreters, so that several can run programs on threads of their own
+
+struct Cursor
+{
+	Coordinates cell_index;
+	Coordinates tensor_index;
+
+	//what the indices pointed at when last looked up. They are checked against the indices and the tensors'
+	//layouts on use, so the indices can be changed freely
+	TensorHandle<Tensor<Cell>> tensor_handle;
+	TensorHandle<Cell> cell_handle;
+
+	Cursor(const Coordinates& cell, const Coordinates& tensor) : cell_index(cell), tensor_index(tensor) {}
+};
+
+//how a tick, or a whole run of them, ended
+enum class TickOutcome : unsigned char
+{
+	Continue,
+	Halted,
+	Failed
+};
+
+//adds the way data cells do, wrapping around within the ints a Cell holds
+inline int wrapping_add(const int value, const int delta)
+{
+	const int64_t sum = int64_t{ value } + delta;
+	if (sum > Cell::MaxInt)
+	{
+		return static_cast<int>(sum - Cell::IntCount);
+	}
+	if (sum < Cell::MinInt)
+	{
+		return static_cast<int>(sum + Cell::IntCount);
+	}
+	return static_cast<int>(sum);
+}
+
+//the effects of the data instructions which only depend on the current data cell
+Cell incremented_cell(const Cell& cell);
+Cell decremented_cell(const Cell& cell);
+
+class Interpreter
+{
+public:
+	Tensor<Tensor<Cell>> meta_tensor;
+	Cursor instruction_cursor = Cursor({ 0 }, { 0 });
+	Cursor data_cursor = Cursor({ 0 }, { 1 });
+	std::vector<Direction> instruction_cursor_direction = { Incremental };
+
+	//where instruction 6 reads from and the output instructions write to
+	std::unique_ptr<Input::Reader> input;
+	std::unique_ptr<Output::Writer> output;
+	//counts what every tick executes if set, for --profile
+	Profiler* profiler = nullptr;
+	//the ticks run() took so far, those of fast-forwarded loops included
+	uint64_t ticks_run = 0;
+
+	//an interpreter without a program, e.g. to restore a checkpoint into
+	Interpreter() = default;
+	explicit Interpreter(Tensor<Cell>&& program);
+
+	Interpreter(const Interpreter&) = delete;
+	Interpreter& operator=(const Interpreter&) = delete;
+
+	Tensor<Cell>& instructionTensor();
+	Tensor<Cell>& dataTensor();
+	//the cursor's handle to the cell at its index, made anew if the index changed since it was last used
+	TensorHandle<Cell>& cellHandleOf(Cursor& cursor);
+
+	Coordinates currentMovement() const;
+	Coordinates& advanceIndex(Coordinates& index);
+	//the Profiled instantiations of the decoding path count into the profiler, which must be set for them
+	template<bool Profiled = false>
+	const PairedParens& pairParens(const Coordinates& opening_parens_index);
+
+	void outputCell(const Cell& cell);
+	int readUserInput();
+
+	template<bool Profiled = false>
+	bool executeCurrentInstruction();
+
+	//executes the current instruction and moves the instruction cursor on, the way the decoding path always has
+	template<bool Profiled = false>
+	TickOutcome tick();
+
+	//ticks until the program halts or fails, taking checkpoints between ticks when they are due and fast-forwarding
+	//counted loops. Gives Continue if the program is still running after max_ticks, counting the ticks of fast-forwarded
+	//loops as well. Runs the profiled ticks if the profiler is set
+	TickOutcome run(uint64_t max_ticks = UINT64_MAX);
+
+private:
+	//the result of pairing the parens after an instruction: the closing parens, or the cell after the
+	//instruction if there are none, and the numbers between them
+	struct PairParensReturn
+	{
+		const Coordinates& closing_parens_index;
+		const Coordinates& numbers;
+	};
+
+	Tensor<Cell>& tensorUnder(Cursor& cursor);
+	const Cell& currentDataCell();
+	void setCurrentDataCell(const Cell& cell);
+
+	template<bool Profiled, typename Operation_t>
+	bool pairParensAndExecute(const Operation_t& operation);
+
+	template<bool Profiled>
+	bool executeInstruction(Instruction instruction);
+
+	template<bool Profiled>
+	TickOutcome runTicks(uint64_t max_ticks);
+
+	Decoder<Cell> decoder;
+	LoopIdioms loop_idioms;
+	//set when a conditional jump is taken, which is where run() looks for loops
+	bool jumped = false;
+};
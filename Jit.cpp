@@ -0,0 +1,649 @@
+#include "Jit.h"
+#include "Checkpoint.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define DODECAMORPH_JIT 1
+#else
+#define DODECAMORPH_JIT 0
+#endif
+
+#if DODECAMORPH_JIT
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "InstructionKey.h"
+
+namespace
+{
+	//native code reads and writes cells in place, as the 32-bit words they are
+	static_assert(sizeof(Cell) == sizeof(uint32_t) && std::is_trivially_copyable_v<Cell>);
+
+
+	enum class EffectKind : unsigned char
+	{
+		Output,
+		MoveDataCursor,
+		SetDataTensor,
+		Increment,
+		Decrement,
+		Input,
+		SetOpeningParens,
+		SetClosingParens,
+		//guards of conditional jumps, on the data cell being the int 0 or not
+		ExpectZero,
+		ExpectNonZero
+	};
+
+	struct Effect
+	{
+		EffectKind kind;
+		//the tick the effect belongs to
+		uint32_t tick;
+		//the paired numbers of MoveDataCursor and SetDataTensor
+		Coordinates operand;
+	};
+
+	//native code in pages of its own, which are only made executable once the code is written
+	class ExecutableCode
+	{
+	public:
+		ExecutableCode() = default;
+
+		explicit ExecutableCode(const std::vector<unsigned char>& code)
+		{
+			const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			const size_t mapped_size = (code.size() + page_size - 1) / page_size * page_size;
+			void* mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapped == MAP_FAILED)
+			{
+				return;
+			}
+			std::memcpy(mapped, code.data(), code.size());
+			if (mprotect(mapped, mapped_size, PROT_READ | PROT_EXEC) != 0)
+			{
+				munmap(mapped, mapped_size);
+				return;
+			}
+			memory = mapped;
+			size = mapped_size;
+		}
+
+		ExecutableCode(const ExecutableCode&) = delete;
+		ExecutableCode& operator=(const ExecutableCode&) = delete;
+
+		~ExecutableCode()
+		{
+			if (memory != nullptr)
+			{
+				munmap(memory, size);
+			}
+		}
+
+		const void* entry() const { return memory; }
+
+	private:
+		void* memory = nullptr;
+		size_t size = 0;
+	};
+
+	//a recorded loop, from its header back to it
+	struct Trace
+	{
+		TensorVersion version;
+		//the instruction cursor's cell at the start of each tick, the first one being the header
+		std::vector<Coordinates> ticks;
+		std::vector<Effect> effects;
+		std::unique_ptr<ExecutableCode> code;
+	};
+
+	//the memory native code works with. r12 points to it throughout a trace
+	struct NativeContext
+	{
+		//where the located data cell is left on exit
+		Cell* cell = nullptr;
+		const Trace* trace = nullptr;
+		Interpreter* interpreter = nullptr;
+	};
+
+	//takes a NativeContext and returns the index of the tick the decoding path resumes at
+	using NativeTrace = uint32_t(*)(NativeContext*);
+
+
+	//leaves a cell native code located the way Tensor::set would have, without a stored implicit value
+	void release_data_cell(Interpreter& interpreter, Cell* cell)
+	{
+		if (cell != nullptr && *cell == Cell())
+		{
+			interpreter.dataTensor().erase(interpreter.data_cursor.cell_index);
+		}
+	}
+
+	Cell* native_locate(NativeContext* context)
+	{
+		Interpreter& interpreter = *context->interpreter;
+		return &interpreter.dataTensor().at(interpreter.cellHandleOf(interpreter.data_cursor));
+	}
+
+	void native_output(NativeContext* context, Cell* cell)
+	{
+		context->interpreter->outputCell(*cell);
+	}
+
+	void native_input(NativeContext* context, Cell* cell)
+	{
+		*cell = context->interpreter->readUserInput();
+	}
+
+	void native_move_data_cursor(NativeContext* context, Cell* cell, uint32_t effect)
+	{
+		Interpreter& interpreter = *context->interpreter;
+		release_data_cell(interpreter, cell);
+		interpreter.data_cursor.cell_index.increment(context->trace->effects[effect].operand, interpreter.dataTensor().getDimensions());
+	}
+
+	//whether the data cursor stays off the instruction tensor, which native code never writes to
+	bool native_set_data_tensor(NativeContext* context, Cell* cell, uint32_t effect)
+	{
+		Interpreter& interpreter = *context->interpreter;
+		release_data_cell(interpreter, cell);
+		interpreter.data_cursor.tensor_index = context->trace->effects[effect].operand;
+		return !Coordinates::equal(interpreter.data_cursor.tensor_index, interpreter.instruction_cursor.tensor_index);
+	}
+
+
+	//just enough of an x86-64 assembler for traces
+	class Assembler
+	{
+	public:
+		void emit(std::initializer_list<unsigned char> bytes)
+		{
+			code.insert(code.end(), bytes);
+		}
+
+		void emit32(const uint32_t value)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				code.push_back(static_cast<unsigned char>(value >> (i * 8)));
+			}
+		}
+
+		void emit64(const uint64_t value)
+		{
+			emit32(static_cast<uint32_t>(value));
+			emit32(static_cast<uint32_t>(value >> 32));
+		}
+
+		//emits a jump with a 32 bit displacement to be bound later, and returns where the displacement ends
+		size_t jump(std::initializer_list<unsigned char> opcode)
+		{
+			emit(opcode);
+			emit32(0);
+			return code.size();
+		}
+
+		void bind(const size_t jump_end, const size_t target)
+		{
+			const uint32_t displacement = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(jump_end));
+			for (int i = 0; i < 4; i++)
+			{
+				code[jump_end - 4 + i] = static_cast<unsigned char>(displacement >> (i * 8));
+			}
+		}
+
+		size_t position() const { return code.size(); }
+
+		std::vector<unsigned char> code;
+	};
+
+	//compiles a trace into a loop which keeps the NativeContext in r12 and the located data cell in rbx.
+	//The cell is located lazily, the way the decoding path only reads it for instructions which need it,
+	//since locating it grows the data tensor's dimensions
+	std::vector<unsigned char> compile_trace(const Trace& trace)
+	{
+		enum class Location
+		{
+			Unlocated,
+			Located,
+			Unknown
+		};
+
+		auto moves_data_cursor = [](const EffectKind kind)
+		{
+			return kind == EffectKind::MoveDataCursor || kind == EffectKind::SetDataTensor;
+		};
+
+		Assembler assembler;
+		std::vector<std::pair<size_t, uint32_t>> exits;
+
+		auto call = [&](const void* function)
+		{
+			//mov rax, function; call rax
+			assembler.emit({ 0x48, 0xB8 });
+			assembler.emit64(reinterpret_cast<uint64_t>(function));
+			assembler.emit({ 0xFF, 0xD0 });
+		};
+
+		auto locate = [&](Location& location)
+		{
+			if (location == Location::Located)
+			{
+				return;
+			}
+			size_t located = 0;
+			if (location == Location::Unknown)
+			{
+				//test rbx, rbx; jnz located
+				assembler.emit({ 0x48, 0x85, 0xDB });
+				located = assembler.jump({ 0x0F, 0x85 });
+			}
+			//mov rdi, r12
+			assembler.emit({ 0x4C, 0x89, 0xE7 });
+			call(reinterpret_cast<const void*>(&native_locate));
+			//mov rbx, rax
+			assembler.emit({ 0x48, 0x89, 0xC3 });
+			if (location == Location::Unknown)
+			{
+				assembler.bind(located, assembler.position());
+			}
+			location = Location::Located;
+		};
+
+		auto exit_if = [&](std::initializer_list<unsigned char> condition, const uint32_t tick)
+		{
+			exits.emplace_back(assembler.jump(condition), tick % trace.ticks.size());
+		};
+
+		//the cell is located on the way into the loop's second iteration whenever it is at the end of the first
+		bool located_at_end = false;
+		for (const Effect& effect : trace.effects)
+		{
+			located_at_end = !moves_data_cursor(effect.kind);
+		}
+		Location location = located_at_end ? Location::Unknown : Location::Unlocated;
+
+		//push rbx; push r12; push r13, which also aligns the stack for calls; mov r12, rdi; xor ebx, ebx
+		assembler.emit({ 0x53, 0x41, 0x54, 0x41, 0x55, 0x49, 0x89, 0xFC, 0x31, 0xDB });
+		const size_t loop = assembler.position();
+
+		for (uint32_t i = 0; i < trace.effects.size(); i++)
+		{
+			const Effect& effect = trace.effects[i];
+			switch (effect.kind)
+			{
+			case EffectKind::Output:
+			case EffectKind::Input:
+				locate(location);
+				//mov rdi, r12; mov rsi, rbx
+				assembler.emit({ 0x4C, 0x89, 0xE7, 0x48, 0x89, 0xDE });
+				call(effect.kind == EffectKind::Output ? reinterpret_cast<const void*>(&native_output) : reinterpret_cast<const void*>(&native_input));
+				break;
+			case EffectKind::Increment:
+			case EffectKind::Decrement:
+			{
+				//a run of increments and decrements of the same cell is fused into one add
+				auto delta_of = [&trace](const uint32_t effect)
+				{
+					return trace.effects[effect].kind == EffectKind::Increment ? 1 : -1;
+				};
+				int delta = delta_of(i);
+				int delta_after_reset = 0;
+				while (i + 1 < trace.effects.size() && (trace.effects[i + 1].kind == EffectKind::Increment || trace.effects[i + 1].kind == EffectKind::Decrement))
+				{
+					i++;
+					delta = wrapping_add(delta, delta_of(i));
+					delta_after_reset = wrapping_add(delta_after_reset, delta_of(i));
+				}
+
+				locate(location);
+				//cmp dword [rbx], ClosingWord; jle reset
+				assembler.emit({ 0x81, 0x3B });
+				assembler.emit32(static_cast<uint32_t>(Cell::ClosingWord));
+				const size_t reset = assembler.jump({ 0x0F, 0x8E });
+				//add dword [rbx], delta
+				assembler.emit({ 0x81, 0x03 });
+				assembler.emit32(static_cast<uint32_t>(delta));
+				//the sum wraps around within the ints a cell holds, skipping the two words of the parens
+				size_t done = 0;
+				if (delta >= 0)
+				{
+					//jno done; add dword [rbx], 2
+					done = assembler.jump({ 0x0F, 0x81 });
+					assembler.emit({ 0x83, 0x03, 0x02 });
+				}
+				else
+				{
+					//jo wrap; cmp dword [rbx], ClosingWord; jg done; wrap: sub dword [rbx], 2
+					const size_t wrap = assembler.jump({ 0x0F, 0x80 });
+					assembler.emit({ 0x81, 0x3B });
+					assembler.emit32(static_cast<uint32_t>(Cell::ClosingWord));
+					done = assembler.jump({ 0x0F, 0x8F });
+					assembler.bind(wrap, assembler.position());
+					assembler.emit({ 0x83, 0x2B, 0x02 });
+				}
+				//jmp end
+				const size_t end = assembler.jump({ 0xE9 });
+				//parens become 0 at the first: mov dword [rbx], delta_after_reset
+				assembler.bind(reset, assembler.position());
+				assembler.emit({ 0xC7, 0x03 });
+				assembler.emit32(static_cast<uint32_t>(delta_after_reset));
+				assembler.bind(done, assembler.position());
+				assembler.bind(end, assembler.position());
+			}
+			break;
+			case EffectKind::SetOpeningParens:
+			case EffectKind::SetClosingParens:
+				locate(location);
+				//mov dword [rbx], word
+				assembler.emit({ 0xC7, 0x03 });
+				assembler.emit32(static_cast<uint32_t>(effect.kind == EffectKind::SetOpeningParens ? Cell::OpeningWord : Cell::ClosingWord));
+				break;
+			case EffectKind::ExpectZero:
+				locate(location);
+				//the parens are never the word 0. cmp dword [rbx], 0; jne exit
+				assembler.emit({ 0x83, 0x3B, 0x00 });
+				exit_if({ 0x0F, 0x85 }, effect.tick);
+				break;
+			case EffectKind::ExpectNonZero:
+				locate(location);
+				//cmp dword [rbx], 0; je exit
+				assembler.emit({ 0x83, 0x3B, 0x00 });
+				exit_if({ 0x0F, 0x84 }, effect.tick);
+				break;
+			case EffectKind::MoveDataCursor:
+			case EffectKind::SetDataTensor:
+				//mov rdi, r12; mov rsi, rbx; mov edx, i
+				assembler.emit({ 0x4C, 0x89, 0xE7, 0x48, 0x89, 0xDE, 0xBA });
+				assembler.emit32(i);
+				call(effect.kind == EffectKind::MoveDataCursor ? reinterpret_cast<const void*>(&native_move_data_cursor) : reinterpret_cast<const void*>(&native_set_data_tensor));
+				//xor ebx, ebx
+				assembler.emit({ 0x31, 0xDB });
+				location = Location::Unlocated;
+				if (effect.kind == EffectKind::SetDataTensor)
+				{
+					//the tick is done, so the decoding path goes on from the next one. test al, al; je exit
+					assembler.emit({ 0x84, 0xC0 });
+					exit_if({ 0x0F, 0x84 }, effect.tick + 1);
+				}
+				break;
+			}
+		}
+
+		if (Checkpoint::active())
+		{
+			//the loop is left at its start for a due checkpoint. mov rax, &requested; cmp byte [rax], 0; jne exit
+			assembler.emit({ 0x48, 0xB8 });
+			assembler.emit64(reinterpret_cast<uint64_t>(&Checkpoint::requested));
+			assembler.emit({ 0x80, 0x38, 0x00 });
+			exit_if({ 0x0F, 0x85 }, 0);
+		}
+
+		//jmp loop
+		assembler.bind(assembler.jump({ 0xE9 }), loop);
+
+		std::vector<size_t> epilogue_jumps;
+		for (uint32_t tick = 0; tick < trace.ticks.size(); tick++)
+		{
+			size_t stub = 0;
+			bool used = false;
+			for (const auto& [jump_end, exit_tick] : exits)
+			{
+				if (exit_tick != tick)
+				{
+					continue;
+				}
+				if (!used)
+				{
+					stub = assembler.position();
+					//mov [r12], rbx; mov eax, tick; jmp epilogue
+					assembler.emit({ 0x49, 0x89, 0x1C, 0x24, 0xB8 });
+					assembler.emit32(tick);
+					epilogue_jumps.push_back(assembler.jump({ 0xE9 }));
+					used = true;
+				}
+				assembler.bind(jump_end, stub);
+			}
+		}
+
+		for (const size_t jump_end : epilogue_jumps)
+		{
+			assembler.bind(jump_end, assembler.position());
+		}
+		//pop r13; pop r12; pop rbx; ret
+		assembler.emit({ 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 });
+		return std::move(assembler.code);
+	}
+
+
+	struct Header
+	{
+		size_t heat = 0;
+		size_t failed_recordings = 0;
+		std::unique_ptr<Trace> trace;
+	};
+
+	class Tracer
+	{
+	public:
+		explicit Tracer(Interpreter& given_interpreter) : interpreter(given_interpreter) {}
+
+		TickOutcome run()
+		{
+			TickOutcome outcome = TickOutcome::Continue;
+			while (outcome == TickOutcome::Continue)
+			{
+				Checkpoint::poll(interpreter);
+				outcome = tick();
+			}
+			return outcome;
+		}
+
+	private:
+		//how often a conditional jump has to be reached before the loop around it is recorded
+		static constexpr size_t HotLoopThreshold = 64;
+		static constexpr size_t MaxTraceTicks = 512;
+		//headers whose loops keep leaving the traceable instructions are given up on
+		static constexpr size_t MaxFailedRecordings = 4;
+
+		TickOutcome tick()
+		{
+			//loops are recognized by their conditional jumps, which every loop that ends has to go through
+			const Cell& cell = interpreter.instructionTensor().get(interpreter.instruction_cursor.cell_index);
+			if (!holds_alternative<int>(cell) || get<0>(cell) % Instruction::InstructionCount != ConditionalSetInstructionCursorCellIndex)
+			{
+				return interpreter.tick();
+			}
+
+			Header& header = headers.entryFor(interpreter.instruction_cursor.tensor_index, interpreter.instruction_cursor.cell_index, interpreter.currentMovement());
+			if (header.trace != nullptr)
+			{
+				if (header.trace->version != interpreter.instructionTensor().version())
+				{
+					header.trace.reset();
+				}
+				else if (!Coordinates::equal(interpreter.data_cursor.tensor_index, interpreter.instruction_cursor.tensor_index))
+				{
+					return enter(*header.trace);
+				}
+			}
+
+			if (header.trace == nullptr && header.failed_recordings < MaxFailedRecordings && ++header.heat >= HotLoopThreshold)
+			{
+				header.heat = 0;
+				return record(header);
+			}
+			return interpreter.tick();
+		}
+
+		TickOutcome enter(const Trace& trace)
+		{
+			NativeContext context{ nullptr, &trace, &interpreter };
+			const uint32_t exit_tick = reinterpret_cast<NativeTrace>(const_cast<void*>(trace.code->entry()))(&context);
+			release_data_cell(interpreter, context.cell);
+			interpreter.instruction_cursor.cell_index = trace.ticks[exit_tick];
+
+			//the tick a guard failed at is left to the decoding path, so that the trace is not entered again right away
+			return interpreter.tick();
+		}
+
+		//records the ticks from the header until the instruction cursor is back at it, executing them on the
+		//decoding path on the way. Recording gives up on instructions native code does not handle
+		TickOutcome record(Header& header)
+		{
+			const Coordinates start = interpreter.instruction_cursor.cell_index;
+			const Coordinates tensor_index = interpreter.instruction_cursor.tensor_index;
+			auto trace = std::make_unique<Trace>();
+
+			while (true)
+			{
+				std::optional<Coordinates> expected_next;
+				if (trace->ticks.size() < MaxTraceTicks && !Coordinates::equal(interpreter.data_cursor.tensor_index, tensor_index))
+				{
+					expected_next = recordTick(*trace);
+				}
+
+				const TickOutcome outcome = interpreter.tick();
+				const bool followed = expected_next.has_value()
+					&& outcome == TickOutcome::Continue
+					&& Coordinates::equal(interpreter.instruction_cursor.tensor_index, tensor_index)
+					&& Coordinates::equal(interpreter.instruction_cursor.cell_index, expected_next.value())
+					&& (trace->ticks.size() == 1 || interpreter.instructionTensor().version() == trace->version);
+				if (!followed)
+				{
+					header.failed_recordings++;
+					return outcome;
+				}
+				trace->version = interpreter.instructionTensor().version();
+
+				if (Coordinates::equal(interpreter.instruction_cursor.cell_index, start))
+				{
+					trace->code = std::make_unique<ExecutableCode>(compile_trace(*trace));
+					if (trace->code->entry() == nullptr)
+					{
+						header.failed_recordings = MaxFailedRecordings;
+						return outcome;
+					}
+					header.trace = std::move(trace);
+					return outcome;
+				}
+			}
+		}
+
+		//appends the effects of the tick at the instruction cursor to the trace, and returns where the tick will
+		//leave the instruction cursor if native code can do what it does
+		std::optional<Coordinates> recordTick(Trace& trace)
+		{
+			trace.ticks.push_back(interpreter.instruction_cursor.cell_index);
+			return recordInstruction(trace, interpreter.instruction_cursor.cell_index, true);
+		}
+
+		std::optional<Coordinates> recordInstruction(Trace& trace, const Coordinates& at, const bool may_jump)
+		{
+			Tensor<Cell>& instruction_tensor = interpreter.instructionTensor();
+			const Coordinates movement = interpreter.currentMovement();
+			const uint32_t tick = static_cast<uint32_t>(trace.ticks.size() - 1);
+			auto next_after = [&](Coordinates index)
+			{
+				return index.increment(movement, instruction_tensor.getDimensions());
+			};
+			auto paired_numbers = [&]()
+			{
+				const PairedParens& paired_parens = interpreter.pairParens(next_after(at));
+				return paired_parens.closing_parens_index.has_value() ? paired_parens.numbers : Coordinates();
+			};
+			auto add = [&](const EffectKind kind, Coordinates operand = {})
+			{
+				trace.effects.push_back(Effect{ kind, tick, std::move(operand) });
+				return next_after(at);
+			};
+
+			const Cell cell = instruction_tensor.read(at);
+			if (holds_alternative<OpeningParens>(cell))
+			{
+				const std::optional<Coordinates> closing_parens_index = interpreter.pairParens(at).closing_parens_index;
+				if (!closing_parens_index.has_value())
+				{
+					return std::nullopt;
+				}
+				return next_after(closing_parens_index.value());
+			}
+			if (holds_alternative<ClosingParens>(cell))
+			{
+				return next_after(at);
+			}
+
+			switch (static_cast<Instruction>(get<0>(cell) % Instruction::InstructionCount))
+			{
+			case OutputCurrentData: return add(EffectKind::Output);
+			case IncrementDataCursorCellIndex: return add(EffectKind::MoveDataCursor, paired_numbers());
+			case SetDataCursorTensorIndex: return add(EffectKind::SetDataTensor, paired_numbers());
+			case IncrementDataCell: return add(EffectKind::Increment);
+			case DecrementDataCell: return add(EffectKind::Decrement);
+			case SetDataCellUserInput: return add(EffectKind::Input);
+			case SetDataCellOpeningParens: return add(EffectKind::SetOpeningParens);
+			case SetDataCellClosingParens: return add(EffectKind::SetClosingParens);
+			case ConditionalSetInstructionCursorCellIndex:
+			{
+				//the instruction jumped to runs within the same tick, which is only followed one jump deep
+				if (!may_jump)
+				{
+					return std::nullopt;
+				}
+				const Coordinates target = paired_numbers();
+				const Cell& data_cell = interpreter.dataTensor().get(interpreter.data_cursor.cell_index);
+				if (!holds_alternative<int>(data_cell) || get<0>(data_cell) != 0)
+				{
+					return add(EffectKind::ExpectNonZero);
+				}
+				add(EffectKind::ExpectZero);
+				return recordInstruction(trace, target, false);
+			}
+			case SetInstructionCursorDirection:
+			case SetInstructionCursorTensorIndex:
+			case ShrinkTensor:
+				return std::nullopt;
+			default:
+				//negative numbers are not instructions
+				return next_after(at);
+			}
+		}
+
+		Interpreter& interpreter;
+		InstructionKeyMap<Header> headers;
+	};
+}
+
+namespace Jit
+{
+	bool supported()
+	{
+		return true;
+	}
+
+	TickOutcome run(Interpreter& interpreter)
+	{
+		Tracer tracer(interpreter);
+		return tracer.run();
+	}
+}
+
+#else
+
+namespace Jit
+{
+	bool supported()
+	{
+		return false;
+	}
+
+	TickOutcome run(Interpreter& interpreter)
+	{
+		return interpreter.run();
+	}
+}
+
+#endif
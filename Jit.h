@@ -0,0 +1,14 @@
+#pragma once
+#include "Interpreter.h"
+
+//a tracing JIT on top of the decoding path. Loops which keep coming back to the same conditional jump are
+//recorded tick by tick and compiled to native code, which runs until one of its guards fails and then hands
+//the program back to the decoding path. Native code is only generated on x86-64 Linux
+namespace Jit
+{
+	//whether this build and platform can generate native code
+	bool supported();
+
+	//runs the interpreter's program until it halts or fails, with the same effects as repeating Interpreter::tick
+	TickOutcome run(Interpreter& interpreter);
+}
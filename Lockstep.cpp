@@ -0,0 +1,657 @@
+#include "Lockstep.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace
+{
+	using Lockstep::Width;
+	using LaneMask = uint32_t;
+	static_assert(Width < 32, "lane masks are 32 bits wide");
+
+	//how many ticks parked lanes wait for the others to come their way before they are split out
+	constexpr size_t MaxParkedTicks = 1 << 16;
+	//how many ticks a group runs before the lanes left are split out, as interpreters fast-forward counted loops,
+	//which would otherwise take up to 2^32 ticks here
+	constexpr size_t MaxGroupTicks = 1 << 24;
+
+	//one cell of every lane. Lanes which are masked out of a write keep theirs
+	struct alignas(32) LaneCells
+	{
+		std::array<Cell, Width> cells{};
+
+		bool operator==(const LaneCells&) const = default;
+	};
+
+	//instructions 3 and 4 on the masked lanes, written without branches on the cells so that they get vectorised
+	LaneCells incremented_lanes(const LaneCells& lanes, const LaneMask mask)
+	{
+		LaneCells result;
+		for (size_t lane = 0; lane < Width; lane++)
+		{
+			const int bits = lanes.cells[lane].bits();
+			const int stepped = bits < Cell::MinInt ? 0 : (bits == Cell::MaxInt ? Cell::MinInt : bits + 1);
+			result.cells[lane] = Cell::fromBits(((mask >> lane) & 1) != 0 ? stepped : bits);
+		}
+		return result;
+	}
+
+	LaneCells decremented_lanes(const LaneCells& lanes, const LaneMask mask)
+	{
+		LaneCells result;
+		for (size_t lane = 0; lane < Width; lane++)
+		{
+			const int bits = lanes.cells[lane].bits();
+			const int stepped = bits < Cell::MinInt ? 0 : (bits == Cell::MinInt ? Cell::MaxInt : bits - 1);
+			result.cells[lane] = Cell::fromBits(((mask >> lane) & 1) != 0 ? stepped : bits);
+		}
+		return result;
+	}
+
+	LaneCells filled_lanes(const LaneCells& lanes, const LaneMask mask, const Cell& cell)
+	{
+		LaneCells result;
+		for (size_t lane = 0; lane < Width; lane++)
+		{
+			result.cells[lane] = ((mask >> lane) & 1) != 0 ? cell : lanes.cells[lane];
+		}
+		return result;
+	}
+
+	//the masked lanes whose cell instruction 7 jumps on
+	LaneMask zero_lanes(const LaneCells& lanes, const LaneMask mask)
+	{
+		LaneMask zero = 0;
+		for (size_t lane = 0; lane < Width; lane++)
+		{
+			zero |= LaneMask{ lanes.cells[lane].bits() == 0 } << lane;
+		}
+		return zero & mask;
+	}
+
+	bool is_uniform(const LaneCells& lanes, const LaneMask mask)
+	{
+		const Cell& first = lanes.cells[std::countr_zero(mask | (LaneMask{ 1 } << Width))];
+		for (size_t lane = 0; lane < Width; lane++)
+		{
+			if (((mask >> lane) & 1) != 0 && !(lanes.cells[lane] == first))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template<typename Visitor_t>
+	void for_each_lane(LaneMask mask, Visitor_t&& visitor)
+	{
+		while (mask != 0)
+		{
+			visitor(static_cast<size_t>(std::countr_zero(mask)));
+			mask &= mask - 1;
+		}
+	}
+
+	//dimensions are padded with 1s, so that e.g. {2} and {2, 1} move cursors alike
+	bool same_dimensions(const std::vector<int>& lhs, const std::vector<int>& rhs)
+	{
+		for (size_t i = 0; i < std::max(lhs.size(), rhs.size()); i++)
+		{
+			if ((i < lhs.size() ? lhs[i] : 1) != (i < rhs.size() ? rhs[i] : 1))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//where lanes are, apart from their cells
+	struct Position
+	{
+		Coordinates instruction_tensor;
+		Coordinates instruction_cell;
+		std::vector<Direction> direction;
+		Coordinates data_tensor;
+		Coordinates data_cell;
+	};
+
+	//the dimensions of every tensor, by its index
+	using Shape = std::vector<std::pair<Coordinates, std::vector<int>>>;
+
+	//lanes waiting for the running ones, at the start of a tick
+	struct Parked
+	{
+		LaneMask lanes;
+		Position position;
+		//the tensors' dimensions when they were parked, which they only run on with again
+		Shape shape;
+		//the group's ticks when they were parked
+		size_t since;
+	};
+
+	//the state of the lanes running in lockstep, and the ticks which run them. Stepping and pairing parens are the
+	//interpreter's, and what every instruction does mirrors its decoding path, only on the cells of the running lanes
+	//at once
+	class Group
+	{
+	public:
+		Group(Tensor<Cell>& program, const std::span<Lockstep::Lane> given_lanes, const std::span<TickOutcome> given_outcomes)
+			: lanes(given_lanes), outcomes(given_outcomes)
+		{
+			live = (LaneMask{ 1 } << lanes.size()) - 1;
+			active = live;
+
+			Tensor<LaneCells>& instruction_tensor = instructionTensor();
+			instruction_tensor.reserve(program.getDimensions(), program.size());
+			program.forEachCell([&](const Coordinates& index, const Cell& cell)
+			{
+				LaneCells cells;
+				cells.cells.fill(cell);
+				instruction_tensor.set(index, cells);
+			});
+		}
+
+		Group(const Group&) = delete;
+		Group& operator=(const Group&) = delete;
+
+		void run()
+		{
+			while (live != 0)
+			{
+				if (active == 0)
+				{
+					resume(parked.size() - 1);
+					continue;
+				}
+				if (ticks == MaxGroupTicks || isVarying(instruction_cursor.tensor_index))
+				{
+					splitAll();
+					continue;
+				}
+				if (!parked.empty() && ticks - parked.front().since > MaxParkedTicks)
+				{
+					splitParked(0);
+				}
+
+				staying.reset();
+				const TickOutcome outcome = tick();
+				ticks++;
+				if (outcome != TickOutcome::Continue)
+				{
+					finish(active, outcome);
+					active = 0;
+				}
+				if (staying.has_value())
+				{
+					//the lanes which jumped wait for those which did not. A jump out of a loop is taken by the lanes one
+					//after another, and this way they leave the loop together once the last of them has jumped
+					if (active != 0)
+					{
+						park(active);
+						active = 0;
+					}
+					resume(staying.value());
+				}
+				rejoin();
+			}
+		}
+
+	private:
+		struct LaneCursor
+		{
+			Coordinates cell_index;
+			Coordinates tensor_index;
+			TensorHandle<Tensor<LaneCells>> tensor_handle;
+			TensorHandle<LaneCells> cell_handle;
+
+			LaneCursor(const Coordinates& cell, const Coordinates& tensor) : cell_index(cell), tensor_index(tensor) {}
+		};
+
+		struct PairParensReturn
+		{
+			const Coordinates& closing_parens_index;
+			const Coordinates& numbers;
+		};
+
+		Tensor<LaneCells>& tensorUnder(LaneCursor& cursor)
+		{
+			if (!cursor.tensor_handle.pointsAt(cursor.tensor_index))
+			{
+				cursor.tensor_handle.retarget(cursor.tensor_index);
+			}
+			return meta_tensor.at(cursor.tensor_handle);
+		}
+
+		TensorHandle<LaneCells>& cellHandleOf(LaneCursor& cursor)
+		{
+			if (!cursor.cell_handle.pointsAt(cursor.cell_index))
+			{
+				cursor.cell_handle.retarget(cursor.cell_index);
+			}
+			return cursor.cell_handle;
+		}
+
+		Tensor<LaneCells>& instructionTensor() { return tensorUnder(instruction_cursor); }
+		Tensor<LaneCells>& dataTensor() { return tensorUnder(data_cursor); }
+		const LaneCells& currentDataCells() { return dataTensor().read(cellHandleOf(data_cursor)); }
+
+		//a tensor whose cells differ between lanes can not be run in by all of them
+		void setCurrentDataCells(const LaneCells& cells)
+		{
+			dataTensor().set(cellHandleOf(data_cursor), cells);
+			if (!is_uniform(cells, live) && !isVarying(data_cursor.tensor_index))
+			{
+				varying.push_back(data_cursor.tensor_index.canonical());
+			}
+		}
+
+		bool isVarying(const Coordinates& tensor_index) const
+		{
+			return std::any_of(varying.begin(), varying.end(), [&](const Coordinates& index) { return Coordinates::equal(index, tensor_index); });
+		}
+
+		Coordinates& advanceIndex(Coordinates& index)
+		{
+			return decoder.advance(index, instruction_cursor_direction, instructionTensor().getDimensions());
+		}
+
+		//the instruction tensor's cells are the same in every live lane, so any of them is read for the instructions
+		const Cell& instructionCell(const Coordinates& index)
+		{
+			return instructionTensor().read(index).cells[std::countr_zero(live)];
+		}
+
+		const PairedParens& pairParens(const Coordinates& opening_parens_index)
+		{
+			const auto lane_cell = [lane = std::countr_zero(live)](const LaneCells& cells) -> const Cell& { return cells.cells[lane]; };
+			std::optional<size_t> scanned;
+			return decoder.pairParens(instructionTensor(), instruction_cursor.tensor_index, instruction_cursor_direction, opening_parens_index, lane_cell, scanned);
+		}
+
+		template<typename Operation_t>
+		bool pairParensAndExecute(const Operation_t& operation)
+		{
+			Coordinates next = instruction_cursor.cell_index;
+			advanceIndex(next);
+			const PairedParens& paired_parens = pairParens(next);
+			const Coordinates no_numbers;
+			const PairParensReturn found_or_implied = paired_parens.closing_parens_index.has_value()
+				? PairParensReturn{ paired_parens.closing_parens_index.value(), paired_parens.numbers }
+				: PairParensReturn{ next, no_numbers };
+			operation(found_or_implied);
+			return true;
+		}
+
+		bool executeInstruction(const Instruction instruction)
+		{
+			bool succeeded = true;
+
+			switch (instruction)
+			{
+			case OutputCurrentData:
+			{
+				const LaneCells& cells = currentDataCells();
+				for_each_lane(active, [&](const size_t lane) { lanes[lane].output->write(cells.cells[lane]); });
+			}
+			break;
+			case IncrementDataCursorCellIndex:
+			{
+				succeeded = pairParensAndExecute([&](const PairParensReturn& paired_parens)
+				{
+					data_cursor.cell_index.increment(paired_parens.numbers, dataTensor().getDimensions());
+				});
+			}
+			break;
+			case SetDataCursorTensorIndex:
+			{
+				succeeded = pairParensAndExecute([&](const PairParensReturn& paired_parens)
+				{
+					data_cursor.tensor_index = paired_parens.numbers;
+				});
+			}
+			break;
+			case IncrementDataCell:
+			{
+				setCurrentDataCells(incremented_lanes(currentDataCells(), active));
+			}
+			break;
+			case DecrementDataCell:
+			{
+				setCurrentDataCells(decremented_lanes(currentDataCells(), active));
+			}
+			break;
+			case SetInstructionCursorDirection:
+			{
+				succeeded = pairParensAndExecute([&](const PairParensReturn& paired_parens)
+				{
+					set_direction(instruction_cursor_direction, paired_parens.numbers);
+				});
+			}
+			break;
+			case SetDataCellUserInput:
+			{
+				LaneCells cells = currentDataCells();
+				for_each_lane(active, [&](const size_t lane) { cells.cells[lane] = lanes[lane].input->read(); });
+				setCurrentDataCells(cells);
+			}
+			break;
+			case ConditionalSetInstructionCursorCellIndex:
+			{
+				succeeded = pairParensAndExecute([&](const PairParensReturn& paired_parens)
+				{
+					const LaneMask zero = zero_lanes(currentDataCells(), active);
+					if (zero == 0)
+					{
+						return;
+					}
+					if (zero != active)
+					{
+						diverge(active & ~zero);
+					}
+					instruction_cursor.cell_index = paired_parens.numbers;
+					//the jumped-to instruction failing (e.g. unpaired parens) has never stopped the program
+					executeCurrentInstruction();
+				});
+			}
+			break;
+			case SetDataCellOpeningParens:
+			{
+				setCurrentDataCells(filled_lanes(currentDataCells(), active, OpeningParens{}));
+			}
+			break;
+			case SetDataCellClosingParens:
+			{
+				setCurrentDataCells(filled_lanes(currentDataCells(), active, ClosingParens{}));
+			}
+			break;
+			case SetInstructionCursorTensorIndex:
+			{
+				succeeded = pairParensAndExecute([&](const PairParensReturn& paired_parens)
+				{
+					instruction_cursor.tensor_index = paired_parens.numbers;
+				});
+			}
+			break;
+			case ShrinkTensor:
+			{
+				succeeded = pairParensAndExecute([&](const PairParensReturn& paired_parens)
+				{
+					//shrinking drops the cells of every lane, parked ones too
+					while (!parked.empty())
+					{
+						splitParked(parked.size() - 1);
+					}
+					staying.reset();
+					meta_tensor.at(paired_parens.numbers).shrink();
+					std::erase_if(varying, [&](const Coordinates& index) { return Coordinates::equal(index, paired_parens.numbers); });
+				});
+			}
+			break;
+			case InstructionCount:
+			break;
+			}
+
+			return succeeded;
+		}
+
+		bool executeCurrentInstruction()
+		{
+			const Cell& current_cell = instructionCell(instruction_cursor.cell_index);
+
+			if (holds_alternative<int>(current_cell))
+			{
+				return executeInstruction(static_cast<Instruction>(get<0>(current_cell) % Instruction::InstructionCount));
+			}
+			if (holds_alternative<OpeningParens>(current_cell))
+			{
+				std::optional<Coordinates> found_closing_parens = pairParens(instruction_cursor.cell_index).closing_parens_index;
+				if (!found_closing_parens.has_value())
+				{
+					return false;
+				}
+				instruction_cursor.cell_index = found_closing_parens.value();
+			}
+			return true;
+		}
+
+		TickOutcome tick()
+		{
+			tick_cell_index = instruction_cursor.cell_index;
+			tick_tensor_index = instruction_cursor.tensor_index;
+			if (!executeCurrentInstruction())
+			{
+				return TickOutcome::Failed;
+			}
+			advanceIndex(instruction_cursor.cell_index);
+
+			const bool moved = !Coordinates::equal(tick_cell_index, instruction_cursor.cell_index)
+				|| !Coordinates::equal(tick_tensor_index, instruction_cursor.tensor_index);
+			return moved ? TickOutcome::Continue : TickOutcome::Halted;
+		}
+
+		//the lanes which do not jump are done with the tick, and wait parked where it leaves them
+		void diverge(const LaneMask not_jumped)
+		{
+			active &= ~not_jumped;
+			Position after = position();
+			advanceIndex(after.instruction_cell);
+			if (Coordinates::equal(after.instruction_cell, tick_cell_index) && Coordinates::equal(after.instruction_tensor, tick_tensor_index))
+			{
+				finish(not_jumped, TickOutcome::Halted);
+				return;
+			}
+			staying = park(not_jumped, std::move(after));
+		}
+
+		Position position() const
+		{
+			return Position{ instruction_cursor.tensor_index, instruction_cursor.cell_index, instruction_cursor_direction, data_cursor.tensor_index, data_cursor.cell_index };
+		}
+
+		bool isAt(const Position& other) const
+		{
+			return Coordinates::equal(instruction_cursor.cell_index, other.instruction_cell)
+				&& Coordinates::equal(instruction_cursor.tensor_index, other.instruction_tensor)
+				&& Coordinates::equal(data_cursor.cell_index, other.data_cell)
+				&& Coordinates::equal(data_cursor.tensor_index, other.data_tensor)
+				&& instruction_cursor_direction == other.direction;
+		}
+
+		Shape shape()
+		{
+			Shape dimensions;
+			meta_tensor.forEachCell([&](const Coordinates& index, Tensor<LaneCells>& tensor)
+			{
+				dimensions.emplace_back(index, tensor.getDimensions());
+			});
+			return dimensions;
+		}
+
+		static const std::vector<int>* dimensionsIn(const Shape& shape, const Coordinates& tensor_index)
+		{
+			const auto found = std::find_if(shape.begin(), shape.end(), [&](const auto& entry) { return Coordinates::equal(entry.first, tensor_index); });
+			return found != shape.end() ? &found->second : nullptr;
+		}
+
+		//whether lanes parked with the shape can run on the tensors as they are. Tensors made since have to be as
+		//good as absent to them
+		bool fits(const Shape& parked_shape)
+		{
+			static const std::vector<int> absent = { 1 };
+			bool fitting = true;
+			meta_tensor.forEachCell([&](const Coordinates& index, Tensor<LaneCells>& tensor)
+			{
+				const std::vector<int>* dimensions = dimensionsIn(parked_shape, index);
+				fitting = fitting && same_dimensions(tensor.getDimensions(), dimensions != nullptr ? *dimensions : absent);
+			});
+			return fitting;
+		}
+
+		//parks the lanes at the position, with lanes already waiting there if they can run together. Gives where in
+		//parked they are
+		size_t park(const LaneMask parking, Position&& at)
+		{
+			for (size_t i = 0; i < parked.size(); i++)
+			{
+				if (isPositionOf(parked[i].position, at) && fits(parked[i].shape))
+				{
+					parked[i].lanes |= parking;
+					return i;
+				}
+			}
+			parked.push_back(Parked{ parking, std::move(at), shape(), ticks });
+			return parked.size() - 1;
+		}
+
+		size_t park(const LaneMask parking)
+		{
+			return park(parking, position());
+		}
+
+		static bool isPositionOf(const Position& lhs, const Position& rhs)
+		{
+			return Coordinates::equal(lhs.instruction_cell, rhs.instruction_cell)
+				&& Coordinates::equal(lhs.instruction_tensor, rhs.instruction_tensor)
+				&& Coordinates::equal(lhs.data_cell, rhs.data_cell)
+				&& Coordinates::equal(lhs.data_tensor, rhs.data_tensor)
+				&& lhs.direction == rhs.direction;
+		}
+
+		//runs the parked lanes, once none run. Lanes which can not run on the tensors as they are now are split out
+		void resume(const size_t index)
+		{
+			Parked resumed = std::move(parked[index]);
+			parked.erase(parked.begin() + static_cast<std::ptrdiff_t>(index));
+			if (!fits(resumed.shape))
+			{
+				split(resumed.lanes, resumed.position, &resumed.shape);
+				return;
+			}
+
+			instruction_cursor.tensor_index = resumed.position.instruction_tensor;
+			instruction_cursor.cell_index = resumed.position.instruction_cell;
+			instruction_cursor_direction = resumed.position.direction;
+			data_cursor.tensor_index = resumed.position.data_tensor;
+			data_cursor.cell_index = resumed.position.data_cell;
+			active = resumed.lanes;
+		}
+
+		//the running lanes take along the parked ones they have caught up with
+		void rejoin()
+		{
+			if (active == 0)
+			{
+				return;
+			}
+			for (size_t i = 0; i < parked.size();)
+			{
+				if (isAt(parked[i].position) && fits(parked[i].shape))
+				{
+					active |= parked[i].lanes;
+					parked.erase(parked.begin() + static_cast<std::ptrdiff_t>(i));
+				}
+				else
+				{
+					i++;
+				}
+			}
+		}
+
+		void finish(const LaneMask finished, const TickOutcome outcome)
+		{
+			for_each_lane(finished, [&](const size_t lane) { outcomes[lane] = outcome; });
+			live &= ~finished;
+		}
+
+		void splitParked(const size_t index)
+		{
+			Parked split_out = std::move(parked[index]);
+			parked.erase(parked.begin() + static_cast<std::ptrdiff_t>(index));
+			split(split_out.lanes, split_out.position, &split_out.shape);
+		}
+
+		void splitAll()
+		{
+			split(active, position(), nullptr);
+			active = 0;
+			while (!parked.empty())
+			{
+				splitParked(parked.size() - 1);
+			}
+		}
+
+		//runs each of the lanes to the end in an interpreter of its own, which gets the lane's cells of every tensor
+		//in the shape if given, or of all of them with the dimensions they have
+		void split(const LaneMask splitting, const Position& at, const Shape* split_shape)
+		{
+			for_each_lane(splitting, [&](const size_t lane)
+			{
+				Interpreter interpreter;
+				meta_tensor.forEachCell([&](const Coordinates& index, Tensor<LaneCells>& tensor)
+				{
+					const std::vector<int>* dimensions = split_shape != nullptr ? dimensionsIn(*split_shape, index) : &tensor.getDimensions();
+					if (dimensions == nullptr)
+					{
+						return;
+					}
+					Tensor<Cell>& own = interpreter.meta_tensor.at(index);
+					own.reserve(*dimensions, tensor.size());
+					tensor.forEachCell([&](const Coordinates& cell_index, const LaneCells& cells)
+					{
+						//cells the lane holds lie within its dimensions, those past them were only written by other lanes
+						if (!(cells.cells[lane] == Cell()))
+						{
+							own.set(cell_index, cells.cells[lane]);
+						}
+					});
+				});
+				interpreter.instruction_cursor = Cursor(at.instruction_cell, at.instruction_tensor);
+				interpreter.instruction_cursor_direction = at.direction;
+				interpreter.data_cursor = Cursor(at.data_cell, at.data_tensor);
+				interpreter.input = std::move(lanes[lane].input);
+				interpreter.output = std::move(lanes[lane].output);
+
+				outcomes[lane] = interpreter.run();
+				lanes[lane].input = std::move(interpreter.input);
+				lanes[lane].output = std::move(interpreter.output);
+			});
+			live &= ~splitting;
+		}
+
+		std::span<Lockstep::Lane> lanes;
+		std::span<TickOutcome> outcomes;
+
+		Tensor<Tensor<LaneCells>> meta_tensor;
+		LaneCursor instruction_cursor = LaneCursor({ 0 }, { 0 });
+		LaneCursor data_cursor = LaneCursor({ 0 }, { 1 });
+		std::vector<Direction> instruction_cursor_direction = { Incremental };
+
+		//the lanes which have neither halted, failed nor been split out, and those of them which are running
+		LaneMask live = 0;
+		LaneMask active = 0;
+		std::vector<Parked> parked;
+		//where in parked the lanes are which did not jump at a conditional jump this tick, if only some did
+		std::optional<size_t> staying;
+		//the tensors whose cells some write made differ between the live lanes
+		std::vector<Coordinates> varying;
+		size_t ticks = 0;
+		Coordinates tick_cell_index;
+		Coordinates tick_tensor_index;
+
+		Decoder<LaneCells> decoder;
+	};
+}
+
+namespace Lockstep
+{
+	std::vector<TickOutcome> run(Tensor<Cell>& program, const std::span<Lane> lanes)
+	{
+		std::vector<TickOutcome> outcomes(lanes.size(), TickOutcome::Continue);
+		Group group(program, lanes, outcomes);
+		group.run();
+		return outcomes;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <memory>
+#include <span>
+#include <vector>
+#include "Interpreter.h"
+
+//runs one program for several users at once. The lanes of a group share the instruction cursor, so that every tick is
+//decoded and its parens paired once for all of them, while each lane has cells, user input and output of its own: a
+//cell of a group's tensors holds that cell of every lane side by side, which the data instructions work on together.
+//When only some lanes jump at a conditional jump, those which jumped are parked, masked out of the cells, while the
+//others run on, and they join up again once they are at the same cursors with tensors of the same dimensions. Lanes
+//which stay apart for too long, or which would run in tensors whose cells differ between lanes, are split out into
+//interpreters of their own
+namespace Lockstep
+{
+	//lanes to a group, as many ints as an AVX2 register holds
+	constexpr size_t Width = 8;
+
+	struct Lane
+	{
+		std::unique_ptr<Input::Reader> input;
+		std::unique_ptr<Output::Writer> output;
+	};
+
+	//runs the program for every lane, Width of them at most, until each lane's program halts or fails, and gives how
+	//each of them ended. The lanes' outputs are left open
+	std::vector<TickOutcome> run(Tensor<Cell>& program, std::span<Lane> lanes);
+}
@@ -0,0 +1,361 @@
+#include "LoopIdiom.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <vector>
+#include "Interpreter.h"
+#include "Profiler.h"
+
+namespace
+{
+	//iterations longer than this many ticks are not looked at
+	constexpr size_t MaxIterationTicks = 256;
+	//how many jumps in a row one tick may take, a jump to a jump executing the second one right away
+	constexpr size_t MaxChainedJumps = 16;
+
+	//cells are counted as offsets from Cell::MinInt, so that incrementing and decrementing them is arithmetic modulo this
+	constexpr int64_t Modulus = Cell::IntCount;
+	constexpr int64_t ZeroOffset = -int64_t{ Cell::MinInt };
+
+	int64_t modulo(const int64_t value)
+	{
+		const int64_t remainder = value % Modulus;
+		return remainder < 0 ? remainder + Modulus : remainder;
+	}
+
+	//where an int cell lies among the values it wraps around
+	int64_t offset_of(const Cell& cell)
+	{
+		return int64_t{ cell.value() } - Cell::MinInt;
+	}
+
+	//(lhs * rhs) modulo the modulus, for factors below it, whose product does not fit in an int64_t
+	int64_t multiply(const int64_t lhs, const int64_t rhs, const int64_t modulus)
+	{
+		return static_cast<int64_t>(static_cast<uint64_t>(lhs) * static_cast<uint64_t>(rhs) % static_cast<uint64_t>(modulus));
+	}
+
+	//the smallest k >= 0 with k * step = target modulo Modulus, if there is one, for step and target below Modulus
+	std::optional<int64_t> solve(const int64_t step, const int64_t target)
+	{
+		const int64_t divisor = std::gcd(step, Modulus);
+		if (target % divisor != 0)
+		{
+			return std::nullopt;
+		}
+
+		//step / divisor is invertible modulo the reduced modulus, its inverse found by the extended Euclidean algorithm
+		const int64_t modulus = Modulus / divisor;
+		int64_t remainder = step / divisor % modulus;
+		int64_t next_remainder = modulus;
+		int64_t inverse = 1;
+		int64_t next_inverse = 0;
+		while (next_remainder != 0)
+		{
+			const int64_t quotient = remainder / next_remainder;
+			remainder = std::exchange(next_remainder, remainder - quotient * next_remainder);
+			inverse = std::exchange(next_inverse, inverse - quotient * next_inverse);
+		}
+		inverse = (inverse % modulus + modulus) % modulus;
+		return multiply(target / divisor, inverse, modulus);
+	}
+
+	//whether the coordinates lie within the dimensions, so that reading them would not grow the tensor
+	bool within(const Coordinates& coordinates, const std::vector<int>& dimensions)
+	{
+		for (size_t i = 0; i < coordinates.size(); i++)
+		{
+			const int dimension = i < dimensions.size() ? dimensions[i] : 1;
+			if (coordinates[i] < 0 || coordinates[i] >= dimension)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//a data cell the loop touches, as it was before the iteration, and what the iteration adds to it
+	struct LoopCell
+	{
+		Coordinates tensor_index;
+		Coordinates cell_index;
+		Cell start;
+		int64_t delta = 0;
+	};
+
+	//a conditional jump the iteration went through: the cell it looked at, what the iteration had added to that cell
+	//by then, and whether it jumped
+	struct Guard
+	{
+		size_t cell;
+		int64_t added;
+		bool jumped;
+	};
+
+	//follows one iteration from the instruction cursor the way ticking would, without changing anything but the parens
+	//cache. Gives up on anything which is not part of a counted loop: other instructions, writes to the instruction
+	//tensor, and reads which would grow or create a tensor, as those would make the next iteration differ
+	class Walk
+	{
+	public:
+		explicit Walk(Interpreter& given_interpreter)
+			: data_tensor_index(given_interpreter.data_cursor.tensor_index),
+			data_cell_index(given_interpreter.data_cursor.cell_index),
+			interpreter(given_interpreter),
+			program(given_interpreter.instructionTensor()),
+			movement(given_interpreter.currentMovement()) {}
+
+		//whether the ticks come back to where they started, with the data cursor where it started too
+		bool follow()
+		{
+			const Coordinates& start = interpreter.instruction_cursor.cell_index;
+			Coordinates position = start;
+			for (size_t ticks = 0; ticks < MaxIterationTicks; ticks++)
+			{
+				ticked.push_back(position);
+				std::optional<Coordinates> next = execute(position, 0);
+				if (!next.has_value())
+				{
+					return false;
+				}
+				next->increment(movement, program.getDimensions());
+				//a tick which does not move the instruction cursor halts the program
+				if (Coordinates::equal(next.value(), position))
+				{
+					return false;
+				}
+				position = std::move(next).value();
+
+				if (Coordinates::equal(position, start))
+				{
+					return Coordinates::equal(data_tensor_index, interpreter.data_cursor.tensor_index)
+						&& Coordinates::equal(data_cell_index, interpreter.data_cursor.cell_index);
+				}
+			}
+			return false;
+		}
+
+		std::vector<LoopCell> cells;
+		std::vector<Guard> guards;
+		//the instruction cell of every tick of the iteration, in order
+		std::vector<Coordinates> ticked;
+		//where the iteration leaves the data cursor, which is where it started, but maybe written differently
+		Coordinates data_tensor_index;
+		Coordinates data_cell_index;
+
+	private:
+		Interpreter& interpreter;
+		Tensor<Cell>& program;
+		const Coordinates movement;
+
+		const Tensor<Cell>* dataTensor() const
+		{
+			if (!within(data_tensor_index, interpreter.meta_tensor.getDimensions())
+				|| Coordinates::equal(data_tensor_index, interpreter.instruction_cursor.tensor_index))
+			{
+				return nullptr;
+			}
+			return interpreter.meta_tensor.find(data_tensor_index);
+		}
+
+		//the cell under the data cursor, added to the loop's cells the first time
+		std::optional<size_t> currentCell()
+		{
+			const Tensor<Cell>* tensor = dataTensor();
+			if (tensor == nullptr || !within(data_cell_index, tensor->getDimensions()))
+			{
+				return std::nullopt;
+			}
+
+			const auto found = std::find_if(cells.begin(), cells.end(), [this](const LoopCell& cell)
+			{
+				return Coordinates::equal(cell.tensor_index, data_tensor_index) && Coordinates::equal(cell.cell_index, data_cell_index);
+			});
+			if (found != cells.end())
+			{
+				return static_cast<size_t>(found - cells.begin());
+			}
+			cells.push_back(LoopCell{ data_tensor_index, data_cell_index, tensor->get(data_cell_index) });
+			return cells.size() - 1;
+		}
+
+		//the numbers paired after the instruction at the position, none if there are no closing parens
+		Coordinates pairedNumbers(const Coordinates& position)
+		{
+			Coordinates next = position;
+			next.increment(movement, program.getDimensions());
+			const PairedParens& paired_parens = interpreter.pairParens(next);
+			return paired_parens.closing_parens_index.has_value() ? paired_parens.numbers : Coordinates();
+		}
+
+		bool add(const int64_t delta)
+		{
+			const std::optional<size_t> cell = currentCell();
+			//incrementing parens makes them 0 rather than adding to them
+			if (!cell.has_value() || !cells[cell.value()].start.isInt())
+			{
+				return false;
+			}
+			cells[cell.value()].delta += delta;
+			return true;
+		}
+
+		//executes the cell at the position, and gives where that leaves the instruction cursor before it moves on
+		std::optional<Coordinates> execute(const Coordinates& position, const size_t chained_jumps)
+		{
+			if (!within(position, program.getDimensions()))
+			{
+				return std::nullopt;
+			}
+
+			const Cell& cell = program.get(position);
+			if (cell.isOpening())
+			{
+				return interpreter.pairParens(position).closing_parens_index;
+			}
+			//negative ints execute nothing, except for multiples of the instruction count, which output
+			if (!cell.isInt() || cell.value() % InstructionCount < 0)
+			{
+				return position;
+			}
+
+			switch (cell.value() % InstructionCount)
+			{
+			case IncrementDataCell:
+				return add(1) ? std::optional<Coordinates>(position) : std::nullopt;
+			case DecrementDataCell:
+				return add(-1) ? std::optional<Coordinates>(position) : std::nullopt;
+			case IncrementDataCursorCellIndex:
+			{
+				const Coordinates numbers = pairedNumbers(position);
+				const Tensor<Cell>* tensor = dataTensor();
+				if (tensor == nullptr)
+				{
+					return std::nullopt;
+				}
+				data_cell_index.increment(numbers, tensor->getDimensions());
+				return position;
+			}
+			case SetDataCursorTensorIndex:
+				data_tensor_index = pairedNumbers(position);
+				return position;
+			case ConditionalSetInstructionCursorCellIndex:
+			{
+				const Coordinates numbers = pairedNumbers(position);
+				const std::optional<size_t> cell_index = currentCell();
+				if (!cell_index.has_value())
+				{
+					return std::nullopt;
+				}
+				const LoopCell& data_cell = cells[cell_index.value()];
+				const bool jumped = data_cell.start.isInt() && modulo(offset_of(data_cell.start) + data_cell.delta) == ZeroOffset;
+				guards.push_back(Guard{ cell_index.value(), data_cell.delta, jumped });
+				if (!jumped)
+				{
+					return position;
+				}
+				if (chained_jumps >= MaxChainedJumps)
+				{
+					return std::nullopt;
+				}
+				return execute(numbers, chained_jumps + 1);
+			}
+			default:
+				return std::nullopt;
+			}
+		}
+	};
+
+	//how many iterations go the way the walked one did, before one of the guards decides otherwise. nullopt if
+	//none ever does, i.e. the loop never ends
+	std::optional<int64_t> iterations_before_exit(const Walk& walk)
+	{
+		std::optional<int64_t> iterations;
+		for (const Guard& guard : walk.guards)
+		{
+			const LoopCell& cell = walk.cells[guard.cell];
+			const int64_t step = modulo(cell.delta);
+			//parens are never 0, and cells which stay the same always decide the same
+			if (!cell.start.isInt() || step == 0)
+			{
+				continue;
+			}
+
+			std::optional<int64_t> deciding;
+			if (guard.jumped)
+			{
+				deciding = 1;
+			}
+			else
+			{
+				const int64_t offset = modulo(offset_of(cell.start) + guard.added);
+				deciding = solve(step, modulo(ZeroOffset - offset));
+			}
+			if (deciding.has_value())
+			{
+				iterations = std::min(iterations.value_or(std::numeric_limits<int64_t>::max()), deciding.value());
+			}
+		}
+		return iterations;
+	}
+}
+
+uint64_t LoopIdioms::fastForward(Interpreter& interpreter, const uint64_t max_ticks)
+{
+	const Coordinates movement = interpreter.currentMovement();
+	const InstructionKeyView key{ interpreter.instruction_cursor.tensor_index, interpreter.instruction_cursor.cell_index, movement };
+	if (last == nullptr || !InstructionKeyEqual{}(last_key, key))
+	{
+		last = &attempts.entryFor(key.tensor_index, key.cell_index, key.movement);
+		last_key = InstructionKey{ key.tensor_index, key.cell_index, key.movement };
+	}
+	Attempts& attempt = *last;
+	if (attempt.skipped > 0)
+	{
+		attempt.skipped--;
+		return 0;
+	}
+
+	Walk walk(interpreter);
+	std::optional<int64_t> iterations = walk.follow() ? iterations_before_exit(walk) : std::nullopt;
+	if (!iterations.has_value() || iterations.value() == 0)
+	{
+		attempt.skipped = std::min(MaxBackoff, 1u << std::min(attempt.failures, 12u));
+		attempt.failures++;
+		return 0;
+	}
+	attempt.failures = 0;
+	//fewer iterations leave the loop's guards as they were, so the rest of them simply tick
+	const uint64_t iteration_ticks = walk.ticked.size();
+	iterations = std::min<int64_t>(iterations.value(), static_cast<int64_t>(std::min<uint64_t>(max_ticks / iteration_ticks, INT64_MAX)));
+	if (iterations.value() == 0)
+	{
+		return 0;
+	}
+
+	for (const LoopCell& cell : walk.cells)
+	{
+		const int64_t step = modulo(cell.delta);
+		if (step != 0)
+		{
+			const int64_t offset = modulo(offset_of(cell.start) + multiply(iterations.value() % Modulus, step, Modulus));
+			interpreter.meta_tensor.at(cell.tensor_index).set(cell.cell_index, Cell(static_cast<int>(offset - ZeroOffset)));
+		}
+	}
+	interpreter.data_cursor.tensor_index = walk.data_tensor_index;
+	interpreter.data_cursor.cell_index = walk.data_cell_index;
+
+	//the profile counts the skipped ticks as if they had run, none of them writing to the instruction tensor
+	if (interpreter.profiler != nullptr)
+	{
+		const Tensor<Cell>& program = interpreter.instructionTensor();
+		for (const Coordinates& position : walk.ticked)
+		{
+			interpreter.profiler->countSkippedTicks(interpreter.instruction_cursor.tensor_index, position, Profiler::kindOf(program.get(position)),
+				static_cast<uint64_t>(iterations.value()));
+		}
+	}
+	return static_cast<uint64_t>(iterations.value()) * iteration_ticks;
+}
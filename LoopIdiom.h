@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "InstructionKey.h"
+
+class Interpreter;
+
+//counted loops on the decoding path. A loop whose only effects are incrementing and decrementing data cells the data
+//cursor comes back to every iteration, and which only leaves through conditional jumps on those cells, runs the same
+//ticks every iteration until one of its jumps decides otherwise. How many iterations that takes follows from the
+//cells' values in closed form, so the iterations before it are done at once, by adding to each cell what they would
+//have, wrapping around the way incrementing does. The iteration that leaves the loop is ticked as usual
+class LoopIdioms
+{
+public:
+	//called with the instruction cursor where a conditional jump just took it. If the ticks from there come back to
+	//it as such a loop, skips every iteration but the one which leaves it, or as many as take at most max_ticks.
+	//Returns the ticks skipped
+	uint64_t fastForward(Interpreter& interpreter, uint64_t max_ticks);
+
+private:
+	//loops which do not match are looked at again after twice as many jumps to them each time, up to this many. Every
+	//look follows the instruction tensor as it is then, so one changing in between only delays finding a loop in it
+	static constexpr unsigned MaxBackoff = 4096;
+
+	struct Attempts
+	{
+		unsigned failures = 0;
+		unsigned skipped = 0;
+	};
+
+	InstructionKeyMap<Attempts> attempts;
+	//the loop looked at last, which the next jump mostly goes to again
+	InstructionKey last_key;
+	Attempts* last = nullptr;
+};
@@ -0,0 +1,44 @@
+#include "NativeProgram.h"
+#include "ArgumentParser.h"
+#include "ProgramImage.h"
+#include "Dependencies/Logger/Logger.h"
+
+NativeProgram::NativeProgram(const std::span<const char*> args, const std::span<const char> image)
+{
+	const auto streams = Arguments::parseStreams(args);
+	if (!streams.has_value())
+	{
+		return;
+	}
+
+	if (!image.empty())
+	{
+		auto program = ProgramImage::decode(image);
+		if (!program.has_value())
+		{
+			Logger::LogError("The program's instruction tensor could not be decoded");
+			return;
+		}
+		interpreter.instructionTensor() = std::move(program).value();
+	}
+
+	interpreter.output = Output::Writer::open(streams->outputPath, streams->outputFormat);
+	if (interpreter.output == nullptr)
+	{
+		Logger::LogError("Could not open the output file");
+		return;
+	}
+	interpreter.input = Input::Reader::open(streams->userInputPath, streams->userInputFormat, interpreter.output.get());
+	if (interpreter.input == nullptr)
+	{
+		Logger::LogError("Could not open the file to read user input from");
+		return;
+	}
+	is_ready = true;
+}
+
+int NativeProgram::finish(const bool halted)
+{
+	interpreter.output->close();
+	return halted ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <span>
+#include "Interpreter.h"
+
+//what the C++ written by --emit-cpp runs on. The generated code stands in for the instruction cursor, as gotos between
+//the cells it can reach, and leaves the data cursor and the tensors to an interpreter, so that every data instruction
+//does exactly what it does when interpreted
+class NativeProgram
+{
+public:
+	//opens user input and output the way the interpreter's options (-o, -f, -in and -if) say. The image is the
+	//instruction tensor as ProgramImage encodes it, for programs which read their own instructions as data, or empty
+	NativeProgram(std::span<const char*> args, std::span<const char> image);
+
+	NativeProgram(const NativeProgram&) = delete;
+	NativeProgram& operator=(const NativeProgram&) = delete;
+
+	//whether the streams could be opened and the image decoded, which the program must not run without
+	bool ready() const { return is_ready; }
+
+	void output() { interpreter.outputCell(currentDataCell()); }
+	void moveDataCursor(const Coordinates& by) { interpreter.data_cursor.cell_index.increment(by, interpreter.dataTensor().getDimensions()); }
+	void setDataTensor(const Coordinates& tensor_index) { interpreter.data_cursor.tensor_index = tensor_index; }
+	void increment() { setCurrentDataCell(incremented_cell(currentDataCell())); }
+	void decrement() { setCurrentDataCell(decremented_cell(currentDataCell())); }
+	void input() { setCurrentDataCell(interpreter.readUserInput()); }
+	void setOpeningParens() { setCurrentDataCell(OpeningParens{}); }
+	void setClosingParens() { setCurrentDataCell(ClosingParens{}); }
+	void shrink(const Coordinates& tensor_index) { interpreter.meta_tensor.at(tensor_index).shrink(); }
+
+	//what instruction 7 jumps on
+	bool dataCellIsZero()
+	{
+		const Cell& data_cell = currentDataCell();
+		return holds_alternative<int>(data_cell) && get<0>(data_cell) == 0;
+	}
+
+	//closes the output, and gives the exit code the interpreter gives for a program which halted or failed
+	int finish(bool halted);
+
+private:
+	const Cell& currentDataCell() { return interpreter.dataTensor().read(interpreter.cellHandleOf(interpreter.data_cursor)); }
+	void setCurrentDataCell(const Cell& cell) { interpreter.dataTensor().set(interpreter.cellHandleOf(interpreter.data_cursor), cell); }
+
+	Interpreter interpreter;
+	bool is_ready = false;
+};
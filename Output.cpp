@@ -0,0 +1,206 @@
+#include "Output.h"
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace Output
+{
+	std::unique_ptr<Writer> Writer::open(const std::string& path, const Format format, const uint64_t written)
+	{
+		std::unique_ptr<FileWriter> file;
+		if (!path.empty() && written == 0)
+		{
+			file = std::make_unique<FileWriter>(path);
+			if (!file->isOpen())
+			{
+				return nullptr;
+			}
+		}
+		else if (!path.empty())
+		{
+			//the file may have got further than the checkpoint before the run was stopped, but never less far
+			std::error_code error;
+			const uintmax_t size = std::filesystem::file_size(path, error);
+			if (error || size < written)
+			{
+				return nullptr;
+			}
+			std::filesystem::resize_file(path, written, error);
+			file = std::make_unique<FileWriter>(path, FileWriter::Mode::Append);
+			if (error || !file->isOpen())
+			{
+				return nullptr;
+			}
+		}
+#ifdef _WIN32
+		else if (format == Format::Int32)
+		{
+			//newline translation would corrupt the ints
+			_setmode(_fileno(stdout), _O_BINARY);
+		}
+#endif
+
+		return std::make_unique<Writer>(std::move(file), format, written);
+	}
+
+	std::unique_ptr<Writer> Writer::toSink(Sink sink, const Format format)
+	{
+		return std::make_unique<Writer>(nullptr, format, 0, std::move(sink));
+	}
+
+	Writer::Writer(std::unique_ptr<FileWriter> given_file, const Format given_format, const uint64_t already_written, Sink given_sink)
+		: file(std::move(given_file)), sink(std::move(given_sink)), format(given_format), written_before(already_written)
+	{
+		for (std::vector<char>& buffer : buffers)
+		{
+			buffer.resize(BufferSize);
+		}
+		writer = std::thread([this] { drain(); });
+	}
+
+	Writer::~Writer()
+	{
+		close();
+	}
+
+	void Writer::write(const Cell& cell)
+	{
+		if (BufferSize - used < MaxValueSize)
+		{
+			publish();
+		}
+
+		char* const begin = buffers[filling % BufferCount].data() + used;
+		char* end = begin;
+		if (format == Format::Text)
+		{
+			if (holds_alternative<int>(cell))
+			{
+				end = std::to_chars(begin, begin + MaxValueSize, get<0>(cell)).ptr;
+			}
+			else
+			{
+				*end++ = holds_alternative<OpeningParens>(cell) ? '(' : ')';
+			}
+			*end++ = ' ';
+		}
+		else
+		{
+			//the same encoding as the cell's own
+			const uint32_t bits = static_cast<uint32_t>(cell.bits());
+			for (int i = 0; i < 4; i++)
+			{
+				*end++ = static_cast<char>(bits >> (i * 8));
+			}
+		}
+		used += static_cast<size_t>(end - begin);
+	}
+
+	uint64_t Writer::written() const
+	{
+		return written_before + handed_over + used;
+	}
+
+	void Writer::flush()
+	{
+		publish();
+		size_t written = tail.load(std::memory_order_acquire);
+		while (written != filling)
+		{
+			tail.wait(written, std::memory_order_acquire);
+			written = tail.load(std::memory_order_acquire);
+		}
+	}
+
+	void Writer::close()
+	{
+		if (!writer.joinable())
+		{
+			return;
+		}
+		publish();
+		head.store(filling | StopBit, std::memory_order_release);
+		head.notify_one();
+		writer.join();
+	}
+
+	void Writer::publish()
+	{
+		if (used == 0)
+		{
+			return;
+		}
+		sizes[filling % BufferCount] = used;
+		handed_over += used;
+		used = 0;
+		filling++;
+		head.store(filling, std::memory_order_release);
+		head.notify_one();
+
+		size_t written = tail.load(std::memory_order_acquire);
+		while (filling - written == BufferCount)
+		{
+			tail.wait(written, std::memory_order_acquire);
+			written = tail.load(std::memory_order_acquire);
+		}
+	}
+
+	void Writer::drain()
+	{
+		size_t writing = 0;
+		while (true)
+		{
+			size_t published = head.load(std::memory_order_acquire);
+			while ((published & ~StopBit) == writing)
+			{
+				if ((published & StopBit) != 0)
+				{
+					finish();
+					return;
+				}
+				head.wait(published, std::memory_order_acquire);
+				published = head.load(std::memory_order_acquire);
+			}
+
+			emit(buffers[writing % BufferCount].data(), sizes[writing % BufferCount]);
+			writing++;
+			tail.store(writing, std::memory_order_release);
+			tail.notify_one();
+		}
+	}
+
+	void Writer::emit(const char* data, const size_t size)
+	{
+		if (sink)
+		{
+			sink(std::span<const char>(data, size));
+		}
+		else if (file != nullptr)
+		{
+			//like writes with FileWriter elsewhere, failures only show in debug builds
+			[[maybe_unused]] const bool written = file->writeBytes(data, size);
+			//nothing is held back in the stream, so that what flush() waited for is in the file, e.g. for checkpoints
+			file->flush();
+		}
+		else
+		{
+			std::fwrite(data, 1, size, stdout);
+			//the user may be waiting for it
+			std::fflush(stdout);
+		}
+	}
+
+	void Writer::finish()
+	{
+		if (file != nullptr)
+		{
+			file->flush();
+		}
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Cell.h"
+#include "Dependencies/Files.h"
+
+//where output instructions write to. Values are formatted into large buffers on the interpreter's thread,
+//which hands full buffers to a writer thread of their own, so that slow output does not hold up the tick loop
+namespace Output
+{
+	enum class Format
+	{
+		//every value followed by a space, parens as ( and )
+		Text,
+		//every value as a little-endian int32, opening parens as INT32_MIN and closing parens as INT32_MIN + 1
+		Int32
+	};
+
+	//a ring of buffers between the interpreter's thread, which fills them, and the writer thread, which empties them.
+	//Each side only ever moves its own end of the ring, so they only synchronize on the head and the tail.
+	//Every interpreter writes through a writer of its own, so runs on several threads do not share one
+	class Writer
+	{
+	public:
+		//starts writing to the file at the path, or to stdout if the path is empty. A run resumed from a checkpoint, which
+		//had written the given number of bytes, keeps those in the file and writes after them; anything the run wrote
+		//later is dropped. Returns nullptr if the file could not be opened, or was shorter than that
+		static std::unique_ptr<Writer> open(const std::string& path, Format format, uint64_t written = 0);
+
+		//what a writer can hand its buffers to instead of a file, called on the writer thread
+		using Sink = std::function<void(std::span<const char>)>;
+		//starts writing to the sink, e.g. a client's socket
+		static std::unique_ptr<Writer> toSink(Sink sink, Format format);
+
+		Writer(std::unique_ptr<FileWriter> file, Format format, uint64_t written_before, Sink sink = {});
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+		~Writer();
+
+		void write(const Cell& cell);
+
+		//the bytes written so far, counting those before a resume
+		uint64_t written() const;
+
+		//waits until everything written so far is out, e.g. before reading input the user may have been prompted for
+		void flush();
+
+		//flushes and stops the writer thread
+		void close();
+
+	private:
+		static constexpr size_t BufferCount = 8;
+		static constexpr size_t BufferSize = size_t{ 1 } << 18;
+		//the longest a single value gets, as an int followed by a space
+		static constexpr size_t MaxValueSize = 16;
+		//set in the head once the interpreter is done writing
+		static constexpr size_t StopBit = size_t{ 1 } << (sizeof(size_t) * 8 - 1);
+
+		//hands the buffer being filled to the writer thread, and waits for the next one to be free
+		void publish();
+		//the writer thread
+		void drain();
+		void emit(const char* data, size_t size);
+		void finish();
+
+		std::unique_ptr<FileWriter> file;
+		Sink sink;
+		Format format;
+
+		std::array<std::vector<char>, BufferCount> buffers;
+		std::array<size_t, BufferCount> sizes{};
+		//how many buffers were handed to the writer thread, and how many it wrote
+		std::atomic<size_t> head = 0;
+		std::atomic<size_t> tail = 0;
+
+		//only touched by the interpreter's thread: the count of buffers handed over, and how full the next one is
+		size_t filling = 0;
+		size_t used = 0;
+		//the bytes in the buffers handed over, and those written by the run this one was resumed from
+		uint64_t handed_over = 0;
+		uint64_t written_before = 0;
+
+		std::thread writer;
+	};
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <optional>
+#include <unordered_map>
+#include "Coordinates.h"
+#include "Tensor.h"
+
+//the outcome of pairing parens from a start cell: the closing parens, if they were found before
+//coming back to the start cell, and the numbers found at depth 1 on the way
+struct PairedParens
+{
+	std::optional<Coordinates> closing_parens_index;
+	Coordinates numbers;
+};
+
+//remembers parens pairings by instruction tensor, start cell and movement. A pairing is only valid
+//for the version of the tensor it was made with, so any write to that tensor invalidates it.
+//Stale pairings are overwritten in place, so self-modifying programs do not churn the allocator
+class ParensCache
+{
+public:
+	const PairedParens* find(const Coordinates& tensor_index, const TensorVersion& version, const Coordinates& start, const Coordinates& movement)
+	{
+		TensorEntry& entry = entryFor(tensor_index);
+		const auto it = entry.pairings.find(KeyView{ start, movement });
+		if (it == entry.pairings.end() || it->second.version != version)
+		{
+			return nullptr;
+		}
+		return &it->second.paired;
+	}
+
+	const PairedParens& store(const Coordinates& tensor_index, const TensorVersion& version, const Coordinates& start, const Coordinates& movement, PairedParens&& paired)
+	{
+		TensorEntry& entry = entryFor(tensor_index);
+		auto it = entry.pairings.find(KeyView{ start, movement });
+		if (it == entry.pairings.end())
+		{
+			it = entry.pairings.emplace(Key{ start.canonical(), movement.canonical() }, Pairing{}).first;
+		}
+		it->second.version = version;
+		it->second.paired = std::move(paired);
+		return it->second.paired;
+	}
+
+	void clear()
+	{
+		tensors.clear();
+		last_entry = nullptr;
+	}
+
+private:
+	struct Key
+	{
+		Coordinates start;
+		Coordinates movement;
+	};
+
+	//looks keys up without copying the coordinates into a Key
+	struct KeyView
+	{
+		const Coordinates& start;
+		const Coordinates& movement;
+	};
+
+	struct KeyHash
+	{
+		using is_transparent = void;
+
+		template<typename Key_t>
+		size_t operator()(const Key_t& key) const
+		{
+			const CoordinatesHash hash;
+			return hash(key.start) * 31 + hash(key.movement);
+		}
+	};
+
+	struct KeyEqual
+	{
+		using is_transparent = void;
+
+		template<typename Lhs_t, typename Rhs_t>
+		bool operator()(const Lhs_t& lhs, const Rhs_t& rhs) const
+		{
+			return Coordinates::equal(lhs.start, rhs.start) && Coordinates::equal(lhs.movement, rhs.movement);
+		}
+	};
+
+	struct Pairing
+	{
+		TensorVersion version;
+		PairedParens paired;
+	};
+
+	struct TensorEntry
+	{
+		Coordinates tensor_index;
+		std::unordered_map<Key, Pairing, KeyHash, KeyEqual> pairings;
+	};
+
+	TensorEntry& entryFor(const Coordinates& tensor_index)
+	{
+		//programs mostly stay in one instruction tensor
+		TensorEntry* entry = last_entry;
+		if (entry == nullptr || !Coordinates::equal(entry->tensor_index, tensor_index))
+		{
+			auto it = tensors.find(tensor_index);
+			if (it == tensors.end())
+			{
+				it = tensors.emplace(tensor_index.canonical(), TensorEntry{ tensor_index.canonical(), {} }).first;
+			}
+			entry = &it->second;
+			last_entry = entry;
+		}
+		return *entry;
+	}
+
+	std::unordered_map<Coordinates, TensorEntry, CoordinatesHash, CoordinatesEqual> tensors;
+	TensorEntry* last_entry = nullptr;
+};
@@ -0,0 +1,285 @@
+#include "ParensScan.h"
+#include <array>
+#include <bit>
+#include <cstdint>
+
+//the vector kernels are compiled for their instruction sets function by function, so the rest of the
+//program still runs on CPUs without them. Other targets only have the plain kernel
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DODECAMORPH_SIMD 1
+#else
+#define DODECAMORPH_SIMD 0
+#endif
+
+#if DODECAMORPH_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define DODECAMORPH_TARGET(features) __attribute__((target(features)))
+#else
+#define DODECAMORPH_TARGET(features)
+#endif
+#endif
+
+namespace
+{
+	using ParensScan::RowEnd;
+
+	using Kernel = RowEnd(*)(std::span<const Cell>, int, Coordinates&);
+
+	RowEnd scan_scalar(const std::span<const Cell> cells, int depth, Coordinates& numbers)
+	{
+		for (size_t i = 0; i < cells.size(); i++)
+		{
+			const Cell& cell = cells[i];
+			if (cell.isClosing())
+			{
+				if (--depth == 0)
+				{
+					return RowEnd{ i, 0 };
+				}
+			}
+			else if (cell.isOpening())
+			{
+				depth++;
+			}
+			else if (depth == 1)
+			{
+				numbers.push_back(cell.value());
+			}
+		}
+		return RowEnd{ ParensScan::npos, depth };
+	}
+
+	//the cells after the last whole block are scanned one by one
+	RowEnd scan_rest(const std::span<const Cell> cells, const size_t scanned, const int depth, Coordinates& numbers)
+	{
+		const RowEnd end = scan_scalar(cells.subspan(scanned), depth, numbers);
+		return end.position == ParensScan::npos ? end : RowEnd{ scanned + end.position, 0 };
+	}
+
+#if DODECAMORPH_SIMD
+	//the vector kernels work on blocks of cells. Per block, they compare every cell with both parens words, take
+	//+1 for opening and -1 for closing parens and sum these up across the lanes, which gives the depth after every
+	//cell at once. The first lane at depth 0 holds the closing parens, and the ints in lanes at depth 1 are moved
+	//to the front of a register and stored to the numbers in one go. Blocks without parens only need the compares
+
+	//for every mask of 8 lanes, the indices of the set lanes, lowest first
+	constexpr std::array<std::array<uint8_t, 8>, 256> avx2_pack = []
+	{
+		std::array<std::array<uint8_t, 8>, 256> table{};
+		for (size_t mask = 0; mask < table.size(); mask++)
+		{
+			size_t packed = 0;
+			for (uint8_t lane = 0; lane < 8; lane++)
+			{
+				if ((mask >> lane & 1) != 0)
+				{
+					table[mask][packed++] = lane;
+				}
+			}
+		}
+		return table;
+	}();
+
+	//the same for 4 lanes, as pshufb byte indices. Bytes past the set lanes have the top bit set, which zeroes them
+	constexpr std::array<std::array<uint8_t, 16>, 16> sse_pack = []
+	{
+		std::array<std::array<uint8_t, 16>, 16> table{};
+		for (size_t mask = 0; mask < table.size(); mask++)
+		{
+			table[mask].fill(0x80);
+			size_t packed = 0;
+			for (uint8_t lane = 0; lane < 4; lane++)
+			{
+				if ((mask >> lane & 1) == 0)
+				{
+					continue;
+				}
+				for (uint8_t byte = 0; byte < 4; byte++)
+				{
+					table[mask][packed * 4 + byte] = static_cast<uint8_t>(lane * 4 + byte);
+				}
+				packed++;
+			}
+		}
+		return table;
+	}();
+
+	//makes room for a whole block behind the numbers and returns where it goes. Callers which only keep some
+	//of its lanes resize the numbers down again
+	int* append_block(Coordinates& numbers, const size_t lanes)
+	{
+		const size_t count = numbers.size();
+		numbers.resize(count + lanes);
+		return numbers.data() + count;
+	}
+
+	DODECAMORPH_TARGET("avx2,popcnt")
+	RowEnd scan_avx2(const std::span<const Cell> cells, int depth, Coordinates& numbers)
+	{
+		const __m256i opening = _mm256_set1_epi32(Cell::OpeningWord);
+		const __m256i closing = _mm256_set1_epi32(Cell::ClosingWord);
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i one = _mm256_set1_epi32(1);
+
+		size_t i = 0;
+		for (; i + 8 <= cells.size(); i += 8)
+		{
+			const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells.data() + i));
+			const __m256i opens = _mm256_cmpeq_epi32(block, opening);
+			const __m256i closes = _mm256_cmpeq_epi32(block, closing);
+			const __m256i parens = _mm256_or_si256(opens, closes);
+			if (_mm256_testz_si256(parens, parens))
+			{
+				if (depth == 1)
+				{
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(append_block(numbers, 8)), block);
+				}
+				continue;
+			}
+
+			//compares give -1 for true, so this is +1 for opening and -1 for closing parens
+			__m256i depths = _mm256_sub_epi32(closes, opens);
+			depths = _mm256_add_epi32(depths, _mm256_slli_si256(depths, 4));
+			depths = _mm256_add_epi32(depths, _mm256_slli_si256(depths, 8));
+			//the shifts stay within 128-bit halves, so the upper half still lacks the sum of the lower one
+			const __m256i lower_sum = _mm256_shuffle_epi32(depths, 0xFF);
+			depths = _mm256_add_epi32(depths, _mm256_permute2x128_si256(lower_sum, lower_sum, 0x08));
+			depths = _mm256_add_epi32(depths, _mm256_set1_epi32(depth));
+
+			const unsigned ended = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(depths, zero))));
+			const unsigned parens_lanes = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(parens)));
+			unsigned gathered = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(depths, one)))) & ~parens_lanes;
+			//depth only changes by one per cell, so it first reaches 0 on closing parens
+			const unsigned end = ended != 0 ? static_cast<unsigned>(std::countr_zero(ended)) : 8;
+			gathered &= (1u << end) - 1;
+
+			if (gathered != 0)
+			{
+				const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(avx2_pack[gathered].data())));
+				const size_t count = numbers.size();
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(append_block(numbers, 8)), _mm256_permutevar8x32_epi32(block, indices));
+				numbers.resize(count + static_cast<size_t>(std::popcount(gathered)));
+			}
+			if (ended != 0)
+			{
+				return RowEnd{ i + end, 0 };
+			}
+			depth = _mm256_extract_epi32(depths, 7);
+		}
+
+		return scan_rest(cells, i, depth, numbers);
+	}
+
+	DODECAMORPH_TARGET("sse4.2,popcnt")
+	RowEnd scan_sse42(const std::span<const Cell> cells, int depth, Coordinates& numbers)
+	{
+		const __m128i opening = _mm_set1_epi32(Cell::OpeningWord);
+		const __m128i closing = _mm_set1_epi32(Cell::ClosingWord);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi32(1);
+
+		size_t i = 0;
+		for (; i + 4 <= cells.size(); i += 4)
+		{
+			const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells.data() + i));
+			const __m128i opens = _mm_cmpeq_epi32(block, opening);
+			const __m128i closes = _mm_cmpeq_epi32(block, closing);
+			const __m128i parens = _mm_or_si128(opens, closes);
+			if (_mm_testz_si128(parens, parens))
+			{
+				if (depth == 1)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(append_block(numbers, 4)), block);
+				}
+				continue;
+			}
+
+			__m128i depths = _mm_sub_epi32(closes, opens);
+			depths = _mm_add_epi32(depths, _mm_slli_si128(depths, 4));
+			depths = _mm_add_epi32(depths, _mm_slli_si128(depths, 8));
+			depths = _mm_add_epi32(depths, _mm_set1_epi32(depth));
+
+			const unsigned ended = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(depths, zero))));
+			const unsigned parens_lanes = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(parens)));
+			unsigned gathered = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(depths, one)))) & ~parens_lanes;
+			const unsigned end = ended != 0 ? static_cast<unsigned>(std::countr_zero(ended)) : 4;
+			gathered &= (1u << end) - 1;
+
+			if (gathered != 0)
+			{
+				const __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sse_pack[gathered].data()));
+				const size_t count = numbers.size();
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(append_block(numbers, 4)), _mm_shuffle_epi8(block, indices));
+				numbers.resize(count + static_cast<size_t>(std::popcount(gathered)));
+			}
+			if (ended != 0)
+			{
+				return RowEnd{ i + end, 0 };
+			}
+			depth = _mm_extract_epi32(depths, 3);
+		}
+
+		return scan_rest(cells, i, depth, numbers);
+	}
+
+	struct CpuFeatures
+	{
+		bool sse42 = false;
+		bool avx2 = false;
+	};
+
+	CpuFeatures detect_cpu_features()
+	{
+		CpuFeatures features;
+#if defined(_MSC_VER)
+		int info[4] = {};
+		__cpuid(info, 0);
+		const int highest_leaf = info[0];
+		__cpuid(info, 1);
+		features.sse42 = (info[2] & (1 << 20)) != 0 && (info[2] & (1 << 23)) != 0;
+		//AVX registers are only usable if the OS saves them on context switches
+		const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+		if (highest_leaf >= 7 && os_saves_ymm)
+		{
+			__cpuidex(info, 7, 0);
+			features.avx2 = (info[1] & (1 << 5)) != 0 && features.sse42;
+		}
+#elif defined(__GNUC__)
+		__builtin_cpu_init();
+		features.sse42 = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+		features.avx2 = __builtin_cpu_supports("avx2") && features.sse42;
+#endif
+		return features;
+	}
+#endif
+
+	Kernel choose_kernel()
+	{
+#if DODECAMORPH_SIMD
+		const CpuFeatures features = detect_cpu_features();
+		if (features.avx2)
+		{
+			return scan_avx2;
+		}
+		if (features.sse42)
+		{
+			return scan_sse42;
+		}
+#endif
+		return scan_scalar;
+	}
+}
+
+namespace ParensScan
+{
+	RowEnd scan(const std::span<const Cell> cells, const int depth, Coordinates& numbers)
+	{
+		static const Kernel kernel = choose_kernel();
+		return kernel(cells, depth, numbers);
+	}
+}
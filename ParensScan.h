@@ -0,0 +1,23 @@
+#pragma once
+#include <span>
+#include "Cell.h"
+#include "Coordinates.h"
+
+//pairing parens along a contiguous row of cells, several cells at a time where the CPU allows it.
+//Which kernel is used (AVX2, SSE4.2 or plain C++) is decided once, on first use
+namespace ParensScan
+{
+	constexpr size_t npos = static_cast<size_t>(-1);
+
+	struct RowEnd
+	{
+		//where the depth first came down to 0, i.e. the closing parens, or npos if it did not in this row
+		size_t position;
+		//the depth after the scanned cells, if the closing parens were not found
+		int depth;
+	};
+
+	//scans the cells in order from the given depth (at least 1), as pairing does cell by cell: closing parens take one
+	//off the depth, opening parens add one, and ints found at depth 1 are appended to the numbers
+	RowEnd scan(std::span<const Cell> cells, int depth, Coordinates& numbers);
+}
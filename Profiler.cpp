@@ -0,0 +1,252 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <string_view>
+#include <vector>
+#include "Arena.h"
+#include "Dependencies/Files.h"
+#include "Dependencies/Logger/Logger.h"
+
+namespace
+{
+#ifdef DODECAMORPH_CYCLE_COUNTER
+	constexpr std::string_view TimeUnit = "cycles";
+#else
+	constexpr std::string_view TimeUnit = "ns";
+#endif
+
+	constexpr std::array<std::string_view, Profiler::KindCount> KindNames =
+	{
+		"OutputCurrentData",
+		"IncrementDataCursorCellIndex",
+		"SetDataCursorTensorIndex",
+		"IncrementDataCell",
+		"DecrementDataCell",
+		"SetInstructionCursorDirection",
+		"SetDataCellUserInput",
+		"ConditionalSetInstructionCursorCellIndex",
+		"SetDataCellOpeningParens",
+		"SetDataCellClosingParens",
+		"SetInstructionCursorTensorIndex",
+		"ShrinkTensor",
+		"( skipping its group",
+		"anything else, doing nothing"
+	};
+
+	//the hottest cells the report lists
+	constexpr size_t HotCellCount = 20;
+
+	//heatmaps of larger tensors put several cells into each pixel, so that they stay within this many pixels a side
+	constexpr size_t MaxHeatmapSide = 4096;
+
+	std::string percent(const uint64_t part, const uint64_t whole)
+	{
+		const uint64_t tenths = whole != 0 ? static_cast<uint64_t>(std::llround(1000.0 * static_cast<double>(part) / static_cast<double>(whole))) : 0;
+		return std::to_string(tenths / 10) + "." + std::to_string(tenths % 10) + "%";
+	}
+
+	std::string text_of(const Coordinates& coordinates)
+	{
+		std::string text = "(";
+		for (size_t i = 0; i < std::max<size_t>(coordinates.rank(), 1); i++)
+		{
+			text += (i == 0 ? "" : " ") + std::to_string(i < coordinates.rank() ? coordinates[i] : 0);
+		}
+		return text + ")";
+	}
+
+	//pads the text to the width with spaces, on the left for numbers
+	std::string column(std::string text, const size_t width, const bool right_aligned = true)
+	{
+		if (text.size() < width)
+		{
+			text.insert(right_aligned ? text.begin() : text.end(), width - text.size(), ' ');
+		}
+		return text;
+	}
+
+	//the executions of every cell of one instruction tensor, dimension 0 across and dimension 1 down, on a logarithmic
+	//scale from black for none to white for the hottest. Cells of higher dimensions are added to the pixel of their
+	//first two coordinates
+	template<typename CellCounts_t>
+	bool write_heatmap(const std::string& path, const CellCounts_t& cells)
+	{
+		size_t width = 1;
+		size_t height = 1;
+		for (const auto& [cell_index, counts] : cells)
+		{
+			width = std::max(width, static_cast<size_t>(std::max(cell_index.size() > 0 ? cell_index[0] : 0, 0)) + 1);
+			height = std::max(height, static_cast<size_t>(std::max(cell_index.size() > 1 ? cell_index[1] : 0, 0)) + 1);
+		}
+		const size_t scale = (std::max(width, height) + MaxHeatmapSide - 1) / MaxHeatmapSide;
+		width = (width + scale - 1) / scale;
+		height = (height + scale - 1) / scale;
+
+		std::vector<uint64_t> executions(width * height);
+		for (const auto& [cell_index, counts] : cells)
+		{
+			const size_t x = static_cast<size_t>(std::max(cell_index.size() > 0 ? cell_index[0] : 0, 0)) / scale;
+			const size_t y = static_cast<size_t>(std::max(cell_index.size() > 1 ? cell_index[1] : 0, 0)) / scale;
+			executions[y * width + x] += counts.executions;
+		}
+
+		const double hottest = std::log1p(static_cast<double>(*std::max_element(executions.begin(), executions.end())));
+		std::vector<unsigned char> pixels(executions.size());
+		std::transform(executions.begin(), executions.end(), pixels.begin(), [hottest](const uint64_t count)
+		{
+			return static_cast<unsigned char>(hottest > 0 ? std::lround(255 * std::log1p(static_cast<double>(count)) / hottest) : 0);
+		});
+
+		FileWriter writer(path);
+		const std::string header = "P5\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+		const bool written = writer.isOpen() && writer.writeBytes(header.data(), header.size()) && writer.writeVector(pixels);
+		writer.flush();
+		return written;
+	}
+}
+
+Profiler::Counts& Profiler::countsOf(const Coordinates& tensor_index, const Coordinates& cell_index)
+{
+	if (last_tensor_cells == nullptr || !Coordinates::equal(last_tensor_index, tensor_index))
+	{
+		last_tensor_index = tensor_index;
+		last_tensor_cells = &by_cell[tensor_index.canonical()];
+	}
+	return (*last_tensor_cells)[cell_index.canonical()];
+}
+
+void Profiler::countTick(const Coordinates& tensor_index, const Coordinates& cell_index, const size_t kind, const uint64_t elapsed)
+{
+	by_kind[kind].add(elapsed);
+	countsOf(tensor_index, cell_index).add(elapsed);
+}
+
+void Profiler::countSkippedTicks(const Coordinates& tensor_index, const Coordinates& cell_index, const size_t kind, const uint64_t executions)
+{
+	by_kind[kind].add(0, executions);
+	countsOf(tensor_index, cell_index).add(0, executions);
+}
+
+void Profiler::countPairing(const uint64_t elapsed, const std::optional<size_t> scanned)
+{
+	if (scanned.has_value())
+	{
+		scanned_pairings[static_cast<size_t>(std::bit_width(scanned.value()))].add(elapsed);
+	}
+	else
+	{
+		cached_pairings.add(elapsed);
+	}
+}
+
+bool Profiler::write(const std::string& path) const
+{
+	Counts total;
+	for (const Counts& counts : by_kind)
+	{
+		total.executions += counts.executions;
+		total.elapsed += counts.elapsed;
+	}
+	Counts pairing = cached_pairings;
+	for (const Counts& counts : scanned_pairings)
+	{
+		pairing.executions += counts.executions;
+		pairing.elapsed += counts.elapsed;
+	}
+	const std::string unit(TimeUnit);
+
+	std::string report = std::to_string(total.executions) + " ticks, taking " + std::to_string(total.elapsed) + " " + unit + ", "
+		+ std::to_string(total.executions != 0 ? total.elapsed / total.executions : 0) + " a tick\n";
+	report += "pairing parens: " + std::to_string(pairing.elapsed) + " " + unit + " (" + percent(pairing.elapsed, total.elapsed) + ") over "
+		+ std::to_string(pairing.executions) + " pairings, " + std::to_string(pairing.executions - cached_pairings.executions) + " of them scanned\n";
+	report += "everything else: " + std::to_string(total.elapsed - std::min(pairing.elapsed, total.elapsed)) + " " + unit
+		+ " (" + percent(total.elapsed - std::min(pairing.elapsed, total.elapsed), total.elapsed) + ")\n";
+	const Arena::Usage memory = Arena::usage();
+	report += "tensor memory: " + std::to_string(memory.high_water_mark) + " bytes at most, " + std::to_string(memory.in_use) + " at the end, "
+		+ std::to_string(memory.huge_pages) + " mapped in huge pages. " + std::to_string(memory.reused) + " blocks reused, "
+		+ std::to_string(memory.allocated) + " allocated\n";
+
+	report += "\n" + column("instruction", 42, false) + column("executions", 16) + column(unit, 18) + column("share", 8) + "\n";
+	for (size_t kind = 0; kind < KindCount; kind++)
+	{
+		const Counts& counts = by_kind[kind];
+		if (counts.executions != 0)
+		{
+			report += column(std::string(KindNames[kind]), 42, false) + column(std::to_string(counts.executions), 16)
+				+ column(std::to_string(counts.elapsed), 18) + column(percent(counts.elapsed, total.elapsed), 8) + "\n";
+		}
+	}
+
+	struct HotCell
+	{
+		const Coordinates* tensor_index;
+		const Coordinates* cell_index;
+		Counts counts;
+	};
+	std::vector<HotCell> hot_cells;
+	for (const auto& [tensor_index, cells] : by_cell)
+	{
+		for (const auto& [cell_index, counts] : cells)
+		{
+			hot_cells.push_back(HotCell{ &tensor_index, &cell_index, counts });
+		}
+	}
+	const size_t listed = std::min(hot_cells.size(), HotCellCount);
+	std::partial_sort(hot_cells.begin(), hot_cells.begin() + listed, hot_cells.end(), [](const HotCell& lhs, const HotCell& rhs)
+	{
+		return lhs.counts.elapsed > rhs.counts.elapsed;
+	});
+	report += "\n" + column("tensor", 16, false) + column("cell", 26, false) + column("executions", 16) + column(unit, 18) + column("share", 8) + "\n";
+	for (size_t i = 0; i < listed; i++)
+	{
+		const HotCell& cell = hot_cells[i];
+		report += column(text_of(*cell.tensor_index), 16, false) + column(text_of(*cell.cell_index), 26, false) + column(std::to_string(cell.counts.executions), 16)
+			+ column(std::to_string(cell.counts.elapsed), 18) + column(percent(cell.counts.elapsed, total.elapsed), 8) + "\n";
+	}
+
+	report += "\n" + column("cells scanned to pair", 42, false) + column("pairings", 16) + column(unit, 18) + column("share", 8) + "\n";
+	if (cached_pairings.executions != 0)
+	{
+		report += column("none, found in the parens cache", 42, false) + column(std::to_string(cached_pairings.executions), 16)
+			+ column(std::to_string(cached_pairings.elapsed), 18) + column(percent(cached_pairings.elapsed, total.elapsed), 8) + "\n";
+	}
+	for (size_t width = 0; width < scanned_pairings.size(); width++)
+	{
+		const Counts& counts = scanned_pairings[width];
+		if (counts.executions != 0)
+		{
+			const uint64_t least = width == 0 ? 0 : uint64_t{ 1 } << (width - 1);
+			const uint64_t most = width == 0 ? 0 : least * 2 - 1;
+			report += column(std::to_string(least) + (most != least ? " to " + std::to_string(most) : ""), 42, false) + column(std::to_string(counts.executions), 16)
+				+ column(std::to_string(counts.elapsed), 18) + column(percent(counts.elapsed, total.elapsed), 8) + "\n";
+		}
+	}
+
+	bool written = true;
+	report += "\nheatmaps of the cells executed\n";
+	for (const auto& [tensor_index, cells] : by_cell)
+	{
+		//e.g. profile.txt.2_1.pgm for the tensor at (2 1)
+		std::string tensor_name = text_of(tensor_index);
+		std::replace(tensor_name.begin(), tensor_name.end(), ' ', '_');
+		const std::string heatmap_path = path + "." + tensor_name.substr(1, tensor_name.size() - 2) + ".pgm";
+		if (!write_heatmap(heatmap_path, cells))
+		{
+			const std::string message = "Could not write the heatmap " + heatmap_path;
+			Logger::LogError(message.c_str());
+			written = false;
+		}
+		report += "tensor " + text_of(tensor_index) + ": " + heatmap_path + "\n";
+	}
+
+	FileWriter writer(path);
+	if (!writer.isOpen() || !writer.writeBytes(report.data(), report.size()))
+	{
+		const std::string message = "Could not write the profile " + path;
+		Logger::LogError(message.c_str());
+		return false;
+	}
+	writer.flush();
+	return written;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "Coordinates.h"
+#include "Cell.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define DODECAMORPH_CYCLE_COUNTER 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define DODECAMORPH_CYCLE_COUNTER 1
+#endif
+
+//what --profile finds out about a run on the decoding path: how often and for how long each kind of instruction and
+//each instruction cell executed, and how much of that went into pairing parens. The decoding path only counts into
+//it when it runs its profiled instantiation, so runs without --profile pay nothing for it
+class Profiler
+{
+public:
+	//the kinds of instruction cells: the instructions, then opening parens, which skip their group, then every
+	//other cell, which does nothing
+	static constexpr size_t OpeningParensKind = InstructionCount;
+	static constexpr size_t NothingKind = InstructionCount + 1;
+	static constexpr size_t KindCount = InstructionCount + 2;
+
+	static size_t kindOf(const Cell& cell)
+	{
+		if (cell.isOpening())
+		{
+			return OpeningParensKind;
+		}
+		if (cell.isInt() && cell.value() >= 0)
+		{
+			return static_cast<size_t>(cell.value() % InstructionCount);
+		}
+		return NothingKind;
+	}
+
+	//the time stamp counter where the processor has one, the steady clock's nanoseconds otherwise
+	static uint64_t now()
+	{
+#ifdef DODECAMORPH_CYCLE_COUNTER
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	//a tick which executed the cell at the indices, of the given kind, and took the given time, pairing included
+	void countTick(const Coordinates& tensor_index, const Coordinates& cell_index, size_t kind, uint64_t elapsed);
+
+	//ticks which fast-forwarding a loop skipped: as many as given of the cell at the indices, of the given kind. They
+	//take no time of their own
+	void countSkippedTicks(const Coordinates& tensor_index, const Coordinates& cell_index, size_t kind, uint64_t executions);
+
+	//a pairing which took the given time, and stepped over the given number of cells, if it was not in the parens cache
+	void countPairing(uint64_t elapsed, std::optional<size_t> scanned);
+
+	//writes the report to the file at the path, and a heatmap of each instruction tensor that ran to a PGM image next
+	//to it, named after the path and the tensor's index. Returns whether everything could be written
+	bool write(const std::string& path) const;
+
+private:
+	struct Counts
+	{
+		uint64_t executions = 0;
+		uint64_t elapsed = 0;
+
+		void add(const uint64_t time, const uint64_t times = 1)
+		{
+			executions += times;
+			elapsed += time;
+		}
+	};
+
+	using CellCounts = std::unordered_map<Coordinates, Counts, CoordinatesHash, CoordinatesEqual>;
+
+	Counts& countsOf(const Coordinates& tensor_index, const Coordinates& cell_index);
+
+	std::array<Counts, KindCount> by_kind;
+	//by instruction tensor, then by cell
+	std::unordered_map<Coordinates, CellCounts, CoordinatesHash, CoordinatesEqual> by_cell;
+	//the tensor ticks last counted in, which they mostly stay in
+	Coordinates last_tensor_index;
+	CellCounts* last_tensor_cells = nullptr;
+
+	Counts cached_pairings;
+	//scanned pairings by the bit width of the number of cells they stepped over, i.e. in buckets of powers of two
+	std::array<Counts, 65> scanned_pairings;
+};
@@ -0,0 +1,296 @@
+#include "ProgramImage.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+#include "Checksum.h"
+#include "Dependencies/Files.h"
+#include "Dependencies/Logger/Logger.h"
+
+namespace
+{
+	//the first bytes of every image. The non-ASCII byte and the line ends make images which went through a text
+	//transfer, or were never images, fail right away, much like the PNG signature does
+	constexpr std::array<char, 8> Magic = { '\x89', 'D', 'C', 'M', 'I', '\r', '\n', '\x1a' };
+
+	//goes up with every change to the layout, as images of other versions are not read
+	constexpr uint32_t Version = 1;
+
+	//how the cells follow the header
+	enum class Layout : uint32_t
+	{
+		//the dense box as it lies in memory: the values, dimension 0 first, then one presence bit per value
+		Dense,
+		//every stored cell as its coordinates, one per dimension, and its word
+		Cells
+	};
+
+	//images are written in the byte order of the machine, which is little-endian everywhere the project builds.
+	//On others, the version does not match and the image is refused
+	struct Header
+	{
+		std::array<char, 8> magic;
+		uint32_t version;
+		Layout layout;
+		uint32_t rank;
+		uint32_t unused;
+		//cells stored, i.e. set presence bits or cell entries
+		uint64_t count;
+		uint64_t payload_size;
+		uint64_t payload_checksum;
+		//covers the header, with this field as 0, and the dimension lists after it
+		uint64_t header_checksum;
+	};
+
+	//the payload starts at a multiple of this, so that values and presence words are aligned in the mapping
+	constexpr size_t PayloadAlignment = 64;
+
+	constexpr size_t aligned(const size_t offset, const size_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	uint64_t header_checksum(Header header, const std::span<const char> lists)
+	{
+		header.header_checksum = 0;
+		std::array<char, sizeof(Header)> bytes;
+		std::memcpy(bytes.data(), &header, sizeof(Header));
+		return checksum(bytes) ^ std::rotl(checksum(lists), 1);
+	}
+
+	template<typename T>
+	std::span<const char> bytes_of(const std::span<const T> items)
+	{
+		return std::span<const char>(reinterpret_cast<const char*>(items.data()), items.size_bytes());
+	}
+
+	template<typename T>
+	void append(std::vector<char>& bytes, const std::span<const T> items)
+	{
+		const std::span<const char> added = bytes_of(items);
+		bytes.insert(bytes.end(), added.begin(), added.end());
+	}
+
+	//the header, the dimension lists and the payload, each of which is padded as the layout asks
+	std::vector<char> image_of(Header header, const std::vector<int>& lists, const std::vector<std::span<const char>>& payload)
+	{
+		const size_t lists_end = sizeof(Header) + lists.size() * sizeof(int);
+		const size_t payload_offset = aligned(lists_end, PayloadAlignment);
+
+		std::vector<char> bytes(payload_offset);
+		for (const std::span<const char> part : payload)
+		{
+			append(bytes, part);
+			bytes.resize(aligned(bytes.size(), sizeof(uint64_t)));
+		}
+		const std::span<const char> payload_bytes = std::span<const char>(bytes).subspan(payload_offset);
+		header.payload_size = payload_bytes.size();
+		header.payload_checksum = checksum(payload_bytes);
+		header.header_checksum = header_checksum(header, bytes_of(std::span<const int>(lists)));
+
+		std::memcpy(bytes.data(), &header, sizeof(Header));
+		std::memcpy(bytes.data() + sizeof(Header), lists.data(), lists.size() * sizeof(int));
+		return bytes;
+	}
+
+	//reads the image in the bytes, which are those of the mapping if it is given. Dense storage is then lent from the
+	//mapping, and copied out of the bytes otherwise. Sets the reason if the image is refused
+	std::optional<Tensor<Cell>> read_image(const std::span<const char> bytes, const std::shared_ptr<MappedFile>& mapping, const char*& reason)
+	{
+		Header header;
+		if (bytes.size() < sizeof(Header) || !ProgramImage::isImage(std::string_view(bytes.data(), bytes.size())))
+		{
+			reason = "it is not a program image";
+			return std::nullopt;
+		}
+		std::memcpy(&header, bytes.data(), sizeof(Header));
+		if (header.version != Version)
+		{
+			reason = "it was written by another version";
+			return std::nullopt;
+		}
+
+		const size_t list_count = header.layout == Layout::Dense ? size_t{ 2 } : size_t{ 1 };
+		if ((header.layout != Layout::Dense && header.layout != Layout::Cells) || header.rank == 0 || header.rank > bytes.size() / sizeof(int))
+		{
+			reason = "its header is damaged";
+			return std::nullopt;
+		}
+		const size_t lists_end = sizeof(Header) + header.rank * list_count * sizeof(int);
+		const size_t payload_offset = aligned(lists_end, PayloadAlignment);
+		if (bytes.size() < payload_offset || bytes.size() - payload_offset != header.payload_size)
+		{
+			reason = "it is truncated";
+			return std::nullopt;
+		}
+
+		std::vector<int> lists(header.rank * list_count);
+		std::memcpy(lists.data(), bytes.data() + sizeof(Header), lists.size() * sizeof(int));
+		if (header_checksum(header, bytes_of(std::span<const int>(lists))) != header.header_checksum)
+		{
+			reason = "its header is damaged";
+			return std::nullopt;
+		}
+		const std::span<const char> payload = bytes.subspan(payload_offset);
+		if (checksum(payload) != header.payload_checksum)
+		{
+			reason = "its contents are damaged";
+			return std::nullopt;
+		}
+
+		std::vector<int> dimensions(lists.begin(), lists.begin() + header.rank);
+		if (std::any_of(dimensions.begin(), dimensions.end(), [](const int dimension) { return dimension < 1; }))
+		{
+			reason = "its dimensions are invalid";
+			return std::nullopt;
+		}
+
+		if (header.layout == Layout::Cells)
+		{
+			const size_t entry_size = header.rank + 1;
+			if (header.payload_size / sizeof(int) < header.count * entry_size)
+			{
+				reason = "it is truncated";
+				return std::nullopt;
+			}
+
+			Tensor<Cell> result;
+			result.reserve(dimensions, header.count);
+			std::vector<int> entry(entry_size);
+			for (size_t i = 0; i < header.count; i++)
+			{
+				std::memcpy(entry.data(), payload.data() + i * entry_size * sizeof(int), entry_size * sizeof(int));
+				result.set(Coordinates(std::span<const int>(entry.data(), header.rank)), Cell::fromBits(entry.back()));
+			}
+			return result;
+		}
+
+		using Dense = TensorStorage::Dense<Cell>;
+		std::vector<int> extents(lists.begin() + header.rank, lists.end());
+		for (size_t i = 0; i < extents.size(); i++)
+		{
+			if (extents[i] < dimensions[i])
+			{
+				reason = "its dimensions are invalid";
+				return std::nullopt;
+			}
+		}
+		const size_t volume = TensorStorage::volume_of(extents);
+		const size_t values_size = aligned(volume * sizeof(Cell), sizeof(uint64_t));
+		const size_t present_words = Dense::presenceWords(volume);
+		if (volume == TensorStorage::npos || volume > header.payload_size / sizeof(Cell)
+			|| header.payload_size != values_size + present_words * sizeof(uint64_t) || header.count > volume)
+		{
+			reason = "its dimensions are invalid";
+			return std::nullopt;
+		}
+
+		TensorStorage::Block<Cell> values;
+		TensorStorage::Block<uint64_t> present;
+		if (mapping != nullptr)
+		{
+			//the values and presence bits are used where they lie in the mapping, which the blocks keep alive
+			char* const writable = mapping->writableContents().data() + (payload.data() - mapping->contents().data());
+			values = TensorStorage::Block<Cell>(std::span<Cell>(reinterpret_cast<Cell*>(writable), volume), mapping);
+			present = TensorStorage::Block<uint64_t>(std::span<uint64_t>(reinterpret_cast<uint64_t*>(writable + values_size), present_words), mapping);
+		}
+		else
+		{
+			values = TensorStorage::Block<Cell>(volume);
+			present = TensorStorage::Block<uint64_t>(present_words);
+			std::memcpy(static_cast<void*>(values.data()), payload.data(), volume * sizeof(Cell));
+			std::memcpy(present.data(), payload.data() + values_size, present_words * sizeof(uint64_t));
+		}
+		return Tensor<Cell>(std::move(dimensions), Dense(std::move(extents), std::move(values), std::move(present), header.count));
+	}
+}
+
+namespace ProgramImage
+{
+	bool isImage(const std::string_view contents)
+	{
+		return contents.size() >= Magic.size() && std::equal(Magic.begin(), Magic.end(), contents.begin());
+	}
+
+	std::vector<char> encode(Tensor<Cell>& tensor)
+	{
+		const std::vector<int>& dimensions = tensor.getDimensions();
+
+		Header header{};
+		header.magic = Magic;
+		header.version = Version;
+		header.rank = static_cast<uint32_t>(dimensions.size());
+
+		using Dense = TensorStorage::Dense<Cell>;
+		const Dense* dense = tensor.denseStorage();
+		if (dense != nullptr && dense->layout().outside == 0)
+		{
+			//the box may have more dimensions than the tensor, which then have an extent of 1
+			const Dense::Layout layout = dense->layout();
+			std::vector<int> lists(dimensions);
+			lists.resize(std::max(dimensions.size(), layout.extents.size()), 1);
+			header.rank = static_cast<uint32_t>(lists.size());
+			lists.insert(lists.end(), layout.extents.begin(), layout.extents.end());
+			lists.resize(header.rank * 2, 1);
+
+			header.layout = Layout::Dense;
+			header.count = layout.count;
+			return image_of(header, lists, { bytes_of(layout.values), bytes_of(layout.present) });
+		}
+
+		std::vector<int> entries;
+		tensor.forEachCell([&](const Coordinates& coordinates, const Cell& cell)
+		{
+			for (size_t i = 0; i < dimensions.size(); i++)
+			{
+				entries.push_back(i < coordinates.size() ? coordinates[i] : 0);
+			}
+			entries.push_back(cell.bits());
+		});
+
+		header.layout = Layout::Cells;
+		header.count = entries.size() / (dimensions.size() + 1);
+		return image_of(header, dimensions, { bytes_of(std::span<const int>(entries)) });
+	}
+
+	std::optional<Tensor<Cell>> decode(const std::span<const char> bytes)
+	{
+		const char* reason = nullptr;
+		return read_image(bytes, nullptr, reason);
+	}
+
+	bool write(const std::string& path, Tensor<Cell>& tensor)
+	{
+		const std::vector<char> bytes = encode(tensor);
+		FileWriter writer(path);
+		if (!writer.isOpen())
+		{
+			return false;
+		}
+		const bool written = writer.writeVector(bytes);
+		writer.flush();
+		return written;
+	}
+
+	std::optional<Tensor<Cell>> load(const std::string& path)
+	{
+		const auto file = std::make_shared<MappedFile>(path, MappedFile::Access::CopyOnWrite);
+		if (!file->isOpen())
+		{
+			Logger::LogError("Could not load the program image: the file could not be opened");
+			return std::nullopt;
+		}
+
+		const char* reason = nullptr;
+		std::optional<Tensor<Cell>> loaded = read_image(file->contents(), file, reason);
+		if (!loaded.has_value())
+		{
+			Logger::LogErrorFormatted("Could not load the program image: %s", reason);
+		}
+		return loaded;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Tensor.h"
+#include "Cell.h"
+
+//programs compiled to a binary image of their instruction tensor, so that running them again skips parsing.
+//Dense tensors are stored as they lie in memory and run straight out of a copy-on-write mapping of the image,
+//so only the pages the program touches are read in, and only the ones it writes to are copied
+namespace ProgramImage
+{
+	//whether the contents of a file start like an image, rather than a program's text
+	bool isImage(std::string_view contents);
+
+	//the image of the tensor, as write() puts it in a file
+	std::vector<char> encode(Tensor<Cell>& tensor);
+
+	//the tensor in an image held in memory, e.g. as part of a larger file. Its cells are copied out of the bytes
+	std::optional<Tensor<Cell>> decode(std::span<const char> bytes);
+
+	//writes the tensor to an image at the path. Returns whether it could be written
+	bool write(const std::string& path, Tensor<Cell>& tensor);
+
+	//the tensor in the image at the path, if it could be read and is a valid image of this version
+	std::optional<Tensor<Cell>> load(const std::string& path);
+}
@@ -0,0 +1,512 @@
+#include "Server.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Interpreter.h"
+#include "InputFileParser.h"
+#include "Dependencies/Logger/Logger.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SERVER_SOCKETS
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef SERVER_SOCKETS
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	//how many programs stay parsed once they were run
+	constexpr size_t MaxCachedPrograms = 64;
+	//the most user input a request may send, and the longest its line may be
+	constexpr size_t MaxInputBytes = size_t{ 64 } << 20;
+	constexpr size_t MaxRequestLine = 4096;
+	//how many of the latest runs the latency percentiles are taken over
+	constexpr size_t LatencySamples = 1024;
+
+	uint64_t microseconds_between(const Clock::time_point start, const Clock::time_point end)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+	}
+
+	std::optional<uint64_t> parse_number(const std::string_view text)
+	{
+		uint64_t value = 0;
+		const auto [last, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+		if (error != std::errc() || last != text.data() + text.size())
+		{
+			return std::nullopt;
+		}
+		return value;
+	}
+
+	//a client's socket, read through a buffer of its own. Closed once done with
+	class Connection
+	{
+	public:
+		explicit Connection(const int given_socket) : socket(given_socket) {}
+
+		Connection(const Connection&) = delete;
+		Connection& operator=(const Connection&) = delete;
+
+		~Connection()
+		{
+			::close(socket);
+		}
+
+		//the next line, without its newline. Gives nullopt if the client hung up or the line got too long
+		std::optional<std::string> readLine()
+		{
+			std::string line;
+			while (true)
+			{
+				const auto newline = std::find(buffered.begin() + static_cast<std::ptrdiff_t>(taken), buffered.end(), '\n');
+				line.append(buffered.begin() + static_cast<std::ptrdiff_t>(taken), newline);
+				if (newline != buffered.end())
+				{
+					taken = static_cast<size_t>(newline - buffered.begin()) + 1;
+					return line;
+				}
+				taken = buffered.size();
+				if (line.size() > MaxRequestLine || !fill())
+				{
+					return std::nullopt;
+				}
+			}
+		}
+
+		std::optional<std::vector<char>> readBytes(const size_t count)
+		{
+			std::vector<char> bytes;
+			bytes.reserve(count);
+			while (bytes.size() < count)
+			{
+				if (taken == buffered.size() && !fill())
+				{
+					return std::nullopt;
+				}
+				const size_t taking = std::min(count - bytes.size(), buffered.size() - taken);
+				bytes.insert(bytes.end(), buffered.begin() + static_cast<std::ptrdiff_t>(taken), buffered.begin() + static_cast<std::ptrdiff_t>(taken + taking));
+				taken += taking;
+			}
+			return bytes;
+		}
+
+		//once sending failed, e.g. because the client hung up, nothing more is sent
+		void send(const std::string_view text)
+		{
+			size_t sent = 0;
+			while (!failed && sent < text.size())
+			{
+				const ssize_t count = ::send(socket, text.data() + sent, text.size() - sent, 0);
+				if (count < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				failed = count <= 0;
+				sent += count > 0 ? static_cast<size_t>(count) : 0;
+			}
+		}
+
+	private:
+		bool fill()
+		{
+			buffered.resize(4096);
+			taken = 0;
+			ssize_t count = 0;
+			do
+			{
+				count = ::recv(socket, buffered.data(), buffered.size(), 0);
+			} while (count < 0 && errno == EINTR);
+			buffered.resize(count > 0 ? static_cast<size_t>(count) : 0);
+			return count > 0;
+		}
+
+		int socket;
+		std::vector<char> buffered;
+		size_t taken = 0;
+		bool failed = false;
+	};
+
+	//totals over every request so far, for stats
+	class Metrics
+	{
+	public:
+		void countError()
+		{
+			std::lock_guard lock(mutex);
+			errors++;
+		}
+
+		void countRun(const TickOutcome outcome, const bool cached, const uint64_t total_us)
+		{
+			std::lock_guard lock(mutex);
+			runs++;
+			(outcome == TickOutcome::Halted ? halted : outcome == TickOutcome::Failed ? failed : out_of_budget)++;
+			(cached ? cache_hits : cache_misses)++;
+			total_latency_us += total_us;
+			max_latency_us = std::max(max_latency_us, total_us);
+			if (latencies.size() < LatencySamples)
+			{
+				latencies.push_back(total_us);
+			}
+			else
+			{
+				latencies[runs % LatencySamples] = total_us;
+			}
+		}
+
+		void countEviction()
+		{
+			std::lock_guard lock(mutex);
+			evictions++;
+		}
+
+		std::string report(const size_t cached_programs)
+		{
+			std::lock_guard lock(mutex);
+			std::vector<uint64_t> sorted = latencies;
+			std::sort(sorted.begin(), sorted.end());
+			const auto percentile = [&sorted](const size_t percent) { return sorted.empty() ? 0 : sorted[(sorted.size() - 1) * percent / 100]; };
+
+			std::string text;
+			const auto line = [&text](const char* name, const uint64_t value) { text += std::string(name) + " " + std::to_string(value) + "\n"; };
+			line("runs", runs);
+			line("halted", halted);
+			line("failed", failed);
+			line("budget", out_of_budget);
+			line("errors", errors);
+			line("cache_hits", cache_hits);
+			line("cache_misses", cache_misses);
+			line("cache_evictions", evictions);
+			line("cached_programs", cached_programs);
+			line("latency_mean_us", runs != 0 ? total_latency_us / runs : 0);
+			line("latency_p50_us", percentile(50));
+			line("latency_p99_us", percentile(99));
+			line("latency_max_us", max_latency_us);
+			return text;
+		}
+
+	private:
+		std::mutex mutex;
+		uint64_t runs = 0;
+		uint64_t halted = 0;
+		uint64_t failed = 0;
+		uint64_t out_of_budget = 0;
+		uint64_t errors = 0;
+		uint64_t cache_hits = 0;
+		uint64_t cache_misses = 0;
+		uint64_t evictions = 0;
+		uint64_t total_latency_us = 0;
+		uint64_t max_latency_us = 0;
+		//of the latest runs, overwritten round the ring
+		std::vector<uint64_t> latencies;
+	};
+
+	//the parsed programs by their paths, the least recently run evicted first. A program is parsed again if its file
+	//was written to since. Runs share the cells of a program until they write to them
+	class ProgramCache
+	{
+	public:
+		using Program = std::shared_ptr<const Tensor<Cell>>;
+
+		struct Found
+		{
+			Program program;
+			//whether it was parsed already
+			bool cached;
+		};
+
+		ProgramCache(std::string given_words_path, Metrics& given_metrics) : words_path(std::move(given_words_path)), metrics(given_metrics) {}
+
+		//the program at the path, or nullopt if it could not be loaded
+		std::optional<Found> get(const std::string& path)
+		{
+			std::error_code error;
+			const auto written = std::filesystem::last_write_time(path, error);
+			if (error)
+			{
+				return std::nullopt;
+			}
+			{
+				std::lock_guard lock(mutex);
+				const auto found = entries.find(path);
+				if (found != entries.end() && found->second->written == written)
+				{
+					order.splice(order.begin(), order, found->second);
+					return Found{ found->second->program, true };
+				}
+			}
+
+			//parsed without holding the lock, so that other runs go on meanwhile
+			std::optional<Tensor<Cell>> loaded = InputFile::load(path, words_path);
+			if (!loaded.has_value())
+			{
+				return std::nullopt;
+			}
+			Program program = std::make_shared<const Tensor<Cell>>(std::move(loaded).value());
+
+			std::lock_guard lock(mutex);
+			if (const auto found = entries.find(path); found != entries.end())
+			{
+				order.erase(found->second);
+				entries.erase(found);
+			}
+			order.push_front(Entry{ path, program, written });
+			entries.emplace(path, order.begin());
+			while (order.size() > MaxCachedPrograms)
+			{
+				entries.erase(order.back().path);
+				order.pop_back();
+				metrics.countEviction();
+			}
+			return Found{ std::move(program), false };
+		}
+
+		size_t size()
+		{
+			std::lock_guard lock(mutex);
+			return order.size();
+		}
+
+	private:
+		struct Entry
+		{
+			std::string path;
+			Program program;
+			std::filesystem::file_time_type written;
+		};
+
+		std::string words_path;
+		Metrics& metrics;
+		std::mutex mutex;
+		//the most recently run first
+		std::list<Entry> order;
+		std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+	};
+
+	//the clients accepted and not yet served, which the worker threads take in turn
+	class ConnectionQueue
+	{
+	public:
+		void push(const int socket)
+		{
+			{
+				std::lock_guard lock(mutex);
+				sockets.push_back(socket);
+			}
+			waiting.notify_one();
+		}
+
+		//a negative socket tells the worker taking it to stop
+		int pop()
+		{
+			std::unique_lock lock(mutex);
+			waiting.wait(lock, [this] { return !sockets.empty(); });
+			const int socket = sockets.front();
+			sockets.pop_front();
+			return socket;
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable waiting;
+		std::deque<int> sockets;
+	};
+
+	struct Context
+	{
+		const Arguments::ParseResult& arguments;
+		ProgramCache& programs;
+		Metrics& metrics;
+	};
+
+	void fail(Connection& connection, Metrics& metrics, const std::string& reason)
+	{
+		metrics.countError();
+		connection.send("error " + reason + "\n");
+	}
+
+	void run(Connection& connection, const Context& context, const std::string_view request)
+	{
+		//the program's path comes last, as it may hold spaces
+		const size_t budget_end = request.find(' ');
+		const size_t size_end = budget_end != std::string_view::npos ? request.find(' ', budget_end + 1) : std::string_view::npos;
+		if (size_end == std::string_view::npos)
+		{
+			fail(connection, context.metrics, "a run takes a tick budget, an input size and a program path");
+			return;
+		}
+		const std::optional<uint64_t> budget = parse_number(request.substr(0, budget_end));
+		const std::optional<uint64_t> input_size = parse_number(request.substr(budget_end + 1, size_end - budget_end - 1));
+		const std::string path(request.substr(size_end + 1));
+		if (!budget.has_value() || budget.value() == 0 || !input_size.has_value() || path.empty())
+		{
+			fail(connection, context.metrics, "the tick budget must be a positive number and the input size a number");
+			return;
+		}
+		if (input_size.value() > MaxInputBytes)
+		{
+			fail(connection, context.metrics, "the input is larger than " + std::to_string(MaxInputBytes) + " bytes");
+			return;
+		}
+		std::optional<std::vector<char>> input = connection.readBytes(static_cast<size_t>(input_size.value()));
+		if (!input.has_value())
+		{
+			context.metrics.countError();
+			return;
+		}
+
+		const Clock::time_point start = Clock::now();
+		const std::optional<ProgramCache::Found> found = context.programs.get(path);
+		if (!found.has_value())
+		{
+			fail(connection, context.metrics, "the program could not be loaded");
+			return;
+		}
+		const Clock::time_point loaded = Clock::now();
+
+		Interpreter interpreter(Tensor<Cell>::sharing(found->program));
+		interpreter.output = Output::Writer::toSink([&connection](const std::span<const char> bytes)
+		{
+			connection.send("output " + std::to_string(bytes.size()) + "\n");
+			connection.send(std::string_view(bytes.data(), bytes.size()));
+		}, context.arguments.outputFormat);
+		interpreter.input = Input::Reader::fromBytes(std::move(input).value(), context.arguments.userInputFormat);
+		const TickOutcome outcome = interpreter.run(budget.value());
+		interpreter.output->close();
+		const Clock::time_point end = Clock::now();
+
+		const uint64_t total_us = microseconds_between(start, end);
+		context.metrics.countRun(outcome, found->cached, total_us);
+		const char* ended = outcome == TickOutcome::Halted ? "halted" : outcome == TickOutcome::Failed ? "failed" : "budget";
+		connection.send(std::string("end ") + ended + " ticks=" + std::to_string(interpreter.ticks_run) + " cached=" + (found->cached ? "1" : "0")
+			+ " load_us=" + std::to_string(microseconds_between(start, loaded)) + " run_us=" + std::to_string(microseconds_between(loaded, end))
+			+ " total_us=" + std::to_string(total_us) + "\n");
+	}
+
+	void serve_client(const int socket, const Context& context)
+	{
+		Connection connection(socket);
+		const std::optional<std::string> request = connection.readLine();
+		if (!request.has_value())
+		{
+			context.metrics.countError();
+			return;
+		}
+
+		const std::string_view text = request.value();
+		constexpr std::string_view Run = "run ";
+		if (text.starts_with(Run))
+		{
+			run(connection, context, text.substr(Run.size()));
+		}
+		else if (text == "stats")
+		{
+			connection.send(context.metrics.report(context.programs.size()));
+		}
+		else
+		{
+			fail(connection, context.metrics, "unknown request, expected run or stats");
+		}
+	}
+}
+#endif
+
+namespace Server
+{
+	bool serve(const Arguments::ParseResult& arguments)
+	{
+#ifdef SERVER_SOCKETS
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (arguments.servePath.size() >= sizeof(address.sun_path))
+		{
+			Logger::LogError("The socket path is too long");
+			return false;
+		}
+		std::copy(arguments.servePath.begin(), arguments.servePath.end(), address.sun_path);
+
+		//a client hanging up shows as a failed send, rather than stopping the server
+		std::signal(SIGPIPE, SIG_IGN);
+		const int listening = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		//a socket left behind by an earlier server would keep this one from binding
+		::unlink(arguments.servePath.c_str());
+		if (listening < 0 || ::bind(listening, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listening, SOMAXCONN) != 0)
+		{
+			Logger::LogError("Could not listen on the socket");
+			if (listening >= 0)
+			{
+				::close(listening);
+			}
+			return false;
+		}
+
+		Metrics metrics;
+		ProgramCache programs(arguments.wordsPath, metrics);
+		const Context context{ arguments, programs, metrics };
+		ConnectionQueue queue;
+		const size_t threads = arguments.threads != 0 ? arguments.threads : std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < threads; i++)
+		{
+			workers.emplace_back([&queue, &context]
+			{
+				for (int client = queue.pop(); client >= 0; client = queue.pop())
+				{
+					serve_client(client, context);
+				}
+			});
+		}
+
+		const std::string serving = "Serving at " + arguments.servePath;
+		Logger::LogMessage(serving.c_str());
+		while (true)
+		{
+			const int client = ::accept(listening, nullptr, nullptr);
+			if (client >= 0)
+			{
+				queue.push(client);
+			}
+			else if (errno != EINTR && errno != ECONNABORTED)
+			{
+				break;
+			}
+		}
+
+		Logger::LogError("Stopped accepting clients");
+		::close(listening);
+		//the clients accepted already are served before the workers stop
+		for (size_t i = 0; i < threads; i++)
+		{
+			queue.push(-1);
+		}
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+		return false;
+#else
+		static_cast<void>(arguments);
+		Logger::LogError("--serve needs Unix domain sockets, which are not available here");
+		return false;
+#endif
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "ArgumentParser.h"
+
+//runs programs for clients of a Unix domain socket, keeping the programs parsed between runs, for jobs too short to pay
+//for starting a process and parsing the program every time. A client sends one request per connection:
+//	"run <tick budget> <input size> <program path>\n" and that many bytes of user input runs the program on the decode
+//	engine. The output comes back as it is written, in frames of "output <size>\n" and that many bytes, followed by
+//	"end <halted|failed|budget> ticks=<n> cached=<0|1> load_us=<n> run_us=<n> total_us=<n>\n", or by
+//	"error <reason>\n" if the program could not be run at all
+//	"stats\n" gets a line of "<name> <value>" for every total over the runs so far, latencies among them
+//The most recently run programs stay parsed, and are parsed again if their files changed since
+namespace Server
+{
+	//serves at the arguments' serve path, with the words, formats and threads the arguments give, until the process is
+	//stopped. Returns false if the socket could not be set up or stopped accepting clients
+	bool serve(const Arguments::ParseResult& arguments);
+}
@@ -1,222 +1,578 @@
-#pragma once
-#include <vector>
-#include <utility>
-#include <algorithm>
-#include <span>
-#include <variant>
-
-
-struct Coordinates 
-{
-	Coordinates(std::vector<int>&& v) : value(std::move(v)) {}
-	Coordinates(const std::vector<int>& v) : value(v) {}
-	Coordinates(const int sole) : value({sole}) {}
-	Coordinates(const int first, const int second) : value({first, second}) {}
-	Coordinates() = default;
-
-	int& operator[](size_t index) { return value[index]; }
-	int operator[](size_t index) const { return value[index]; }
-
-	typename std::vector<int>::iterator begin() { return value.begin(); }
-	typename std::vector<int>::iterator end() { return value.end(); }
-	typename std::vector<int>::const_iterator begin() const { return value.begin(); }
-	typename std::vector<int>::const_iterator end() const { return value.end(); }
-
-	size_t size() const { return value.size(); }
-
-	static bool equal(const Coordinates& lhs, const Coordinates& rhs)
-	{
-		const size_t lhs_size = lhs.size();
-		const size_t rhs_size = rhs.size();
-		if (lhs_size < rhs_size)
-		{
-			for (size_t i = 0; i < rhs_size; i++)
-			{
-				const int other_coordinate = i >= lhs_size ? 0 : lhs[i];
-				if (rhs[i] != other_coordinate)
-				{
-					return false;
-				}
-			}
-		}
-		else if (lhs_size > rhs_size)
-		{
-			for (size_t i = 0; i < lhs_size; i++)
-			{
-				const int other_coordinate = i >= rhs_size ? 0 : rhs[i];
-				if (lhs[i] != other_coordinate)
-				{
-					return false;
-				}
-			}
-		}
-		else
-		{
-			return std::equal(lhs.begin(), lhs.end(), rhs.begin());
-		}
-
-		return true;
-	}
-
-	Coordinates& increment(const Coordinates& by, const std::span<const int> dimensions)
-	{
-		const size_t coords_size = size();
-		const size_t by_size = by.size();	
-
-		const auto get_dimension_for_index = [&dimensions](size_t index)
-		{
-			return dimensions.size() > index ? dimensions[index] : 1;
-		};
-
-		if (coords_size < by_size)
-		{
-			for (size_t i = 0; i < by_size; i++)
-			{
-				const int dimension = get_dimension_for_index(i);
-				if (coords_size > i)
-				{
-					value[i] = (value[i] + by[i]) % dimension;
-				}
-				else
-				{
-					value.push_back(by[i] % dimension);
-				}
-			}
-		}
-		else if (coords_size > by_size)
-		{
-			for (size_t i = 0; i < coords_size; i++)
-			{
-				const int by_value = by_size > i ? by[i] : 0;
-				const int dimension = get_dimension_for_index(i);
-				value[i] = (value[i] + by_value) % dimension;
-			}
-		}
-		else 
-		{
-			for (size_t i = 0; i < coords_size; i++)
-			{
-				const int dimension = get_dimension_for_index(i);
-				value[i] = (value[i] + by[i]) % dimension;
-			}
-		}
-
-		return *this;
-	}
-
-private:
-
-	std::vector<int> value;
-};
-
-
-template<typename T>
-class Tensor;
-
-template<typename T>
-class TensorHandle 
-{
-	std::variant<size_t, Coordinates> index_or_coordinate;
-	
-	bool invalid() const
-	{
-		return !std::holds_alternative<size_t>(index_or_coordinate);
-	}
-	
-	TensorHandle(size_t givenIndex) : index_or_coordinate(givenIndex) {}
-	TensorHandle(const Coordinates& coords) : index_or_coordinate(coords) {}
-	TensorHandle(Coordinates&& coords) : index_or_coordinate(std::move(coords)) {}
-
-	friend class Tensor<T>;
-};
-
-
-template<typename T>
-class Tensor
-{
-private:
-	struct Element
-	{
-		T value;
-		Coordinates coordinates;
-	};
-
-	std::vector<int> dimensions;
-	std::vector<Element> elements;
-
-	size_t indexAt(const Coordinates& coordinates)
-	{
-		if (dimensions.size() < coordinates.size())
-		{
-			dimensions.resize(coordinates.size());
-		}
-
-		for (size_t i = 0; i < coordinates.size(); i++)
-		{
-			dimensions[i] = std::max(dimensions[i], coordinates[i]+1);
-		}
-
-		auto all_coordinates_equal = [&coordinates](const Tensor<T>::Element &element)
-		{
-			return Coordinates::equal(element.coordinates, coordinates);
-		};
-
-		const auto pos = std::find_if(elements.begin(), elements.end(), all_coordinates_equal);
-
-		return std::distance(elements.begin(), pos);
-	}
-	
-public:
-
-	const std::vector<int>& getDimensions() { return dimensions; }
-
-	TensorHandle<T> handleAtCoordinates(const Coordinates& coordinates)
-	{
-		const size_t index = indexAt(coordinates);
-		if (index == elements.size()) 
-		{
-			return TensorHandle<T>(coordinates);
-		}
-		else 
-		{
-			return TensorHandle<T>(index);
-		}
-	}
-
-	T& at(TensorHandle<T>& handle) 
-	{
-		if (handle.invalid()) 
-		{
-			const size_t new_index = elements.size();
-			elements.emplace_back(T(), std::get<1>(handle.index_or_coordinate)); //todo: what happens if we call at with an invalid handle on a tensor which has shrunk?
-			handle = TensorHandle<T>(new_index);
-			return elements.back().value;
-		}
-		else 
-		{
-			return elements[std::get<0>(handle.index_or_coordinate)].value;
-		}
-	}
-
-	T& at(const Coordinates& coordinates) 
-	{
-		TensorHandle<T> temp_handle = handleAtCoordinates(coordinates);
-		return at(temp_handle);
-	}
-
-	void setAtCoordinates(const Coordinates& coordinates, const T& t)
-	{
-		TensorHandle<T> handle = handleAtCoordinates(coordinates);
-		at(handle) = t;
-	}
-
-	void shrink() 
-	{
-		dimensions.clear();
-		dimensions.push_back(1u);
-		elements.clear();
-	}
-
-	Tensor() : elements({ Element{ T(), Coordinates(0) } }), dimensions(1u) {}
-};
-
+#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <span>
+#include <variant>
+#include <atomic>
+#include <unordered_set>
+#include <concepts>
+#include <memory>
+#include "Coordinates.h"
+#include "TensorStorage.h"
+
+
+//which contents a tensor holds. The identity follows a tensor's cells through moves,
+//the write count goes up whenever a cell or the dimensions may have changed
+struct TensorVersion
+{
+	size_t identity = 0;
+	size_t writes = 0;
+
+	bool operator==(const TensorVersion&) const = default;
+};
+
+template<typename T>
+class Tensor;
+
+template<typename T>
+class TensorHandle 
+{
+public:
+	TensorHandle() = default;
+	//a handle which is yet to find its cell, on first use
+	explicit TensorHandle(const Coordinates& coords) : coordinates(coords) {}
+
+	//whether the handle was made for exactly these coordinates, trailing zeros included, as they decide how far reads grow the tensor
+	bool pointsAt(const Coordinates& other) const
+	{
+		return coordinates.size() == other.size() && std::equal(coordinates.begin(), coordinates.end(), other.begin());
+	}
+
+	//points the handle at other coordinates, to find the cell there on next use
+	void retarget(const Coordinates& other)
+	{
+		coordinates.assign(std::span<const int>(other.begin(), other.size()));
+		cell = nullptr;
+	}
+
+private:
+	Coordinates coordinates;
+	T* cell = nullptr;
+	size_t identity = 0;
+	size_t layout = 0;
+	
+	bool invalid(const size_t current_identity, const size_t current_layout) const
+	{
+		return cell == nullptr || identity != current_identity || layout != current_layout;
+	}
+	
+	TensorHandle(const Coordinates& coords, T* givenCell, size_t givenIdentity, size_t givenLayout) 
+		: coordinates(coords), cell(givenCell), identity(givenIdentity), layout(givenLayout) {}
+
+	friend class Tensor<T>;
+};
+
+
+template<typename T>
+class Tensor
+{
+private:
+	using Dense = TensorStorage::Dense<T>;
+	using Sparse = TensorStorage::Sparse<T>;
+	using Paged = TensorStorage::Paged<T>;
+
+	//dense storage is always used while it takes no more than a page of memory
+	static constexpr size_t dense_free_volume = std::max<size_t>(1, 4096 / sizeof(T));
+	static constexpr size_t dense_max_volume = size_t{ 1 } << 24;
+	//fill ratios (as 1/n) needed to switch to a layout, and under which it is left again
+	static constexpr size_t dense_enter_ratio = 4;
+	static constexpr size_t dense_leave_ratio = 8;
+	static constexpr size_t paged_enter_ratio = 4;
+	static constexpr size_t paged_leave_ratio = 16;
+	static constexpr size_t first_review = 64;
+
+	std::vector<int> dimensions;
+	std::variant<Dense, Sparse, Paged> storage;
+	size_t next_review = first_review;
+	//see TensorVersion. Copies and moved-from tensors get a fresh identity
+	size_t identity = nextIdentity();
+	size_t writes = 0;
+	//changes whenever references into the storage may dangle
+	size_t layout = 0;
+	//whether the storage is lent by a tensor which others read as well, see sharing()
+	bool shared = false;
+
+	static size_t nextIdentity()
+	{
+		static std::atomic<size_t> counter = 0;
+		return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+	//gives the tensor storage of its own, before anything in it is written to or moved
+	void unshare()
+	{
+		if (shared)
+		{
+			Dense copied = std::get<Dense>(storage);
+			storage = std::move(copied);
+			shared = false;
+			layout++;
+		}
+	}
+
+	void extendDimensions(const Coordinates& coordinates)
+	{
+		bool grown = false;
+		if (dimensions.size() < coordinates.size())
+		{
+			dimensions.resize(coordinates.size(), 1);
+			grown = true;
+		}
+
+		for (size_t i = 0; i < coordinates.size(); i++)
+		{
+			if (coordinates[i] >= dimensions[i])
+			{
+				dimensions[i] = coordinates[i] + 1;
+				grown = true;
+			}
+		}
+
+		if (grown)
+		{
+			unshare();
+			writes++;
+			onDimensionsGrown();
+		}
+	}
+
+	void onDimensionsGrown()
+	{
+		if (Dense* dense = std::get_if<Dense>(&storage))
+		{
+			const TensorStorage::Kind kind = chooseKind(size() + 1);
+			if (kind != TensorStorage::Kind::Dense)
+			{
+				migrate(kind);
+			}
+			else if (dense->reserve(dimensions, dense_max_volume))
+			{
+				layout++;
+			}
+		}
+	}
+
+	size_t countPages(const typename Paged::Shifts& shifts)
+	{
+		std::unordered_set<Coordinates, CoordinatesHash, CoordinatesEqual> pages;
+		forEachCell([&](const Coordinates& coordinates, T&)
+		{
+			pages.insert(Paged::pageOf(coordinates, shifts));
+		});
+		return pages.size();
+	}
+
+	TensorStorage::Kind chooseKind(const size_t count)
+	{
+		const size_t volume = TensorStorage::volume_of(dimensions);
+		const TensorStorage::Kind current = storageKind();
+		if (volume <= dense_free_volume)
+		{
+			return TensorStorage::Kind::Dense;
+		}
+
+		if (volume <= dense_max_volume)
+		{
+			const size_t ratio = current == TensorStorage::Kind::Dense ? dense_leave_ratio : dense_enter_ratio;
+			if (count * ratio >= volume)
+			{
+				return TensorStorage::Kind::Dense;
+			}
+		}
+
+		const size_t pages = current == TensorStorage::Kind::Paged
+			? std::get<Paged>(storage).pageCount()
+			: countPages(Paged::shiftsFor(dimensions.size()));
+		const size_t ratio = current == TensorStorage::Kind::Paged ? paged_leave_ratio : paged_enter_ratio;
+		return count * ratio >= pages * Paged::PageCells ? TensorStorage::Kind::Paged : TensorStorage::Kind::Sparse;
+	}
+
+	void migrate(const TensorStorage::Kind kind)
+	{
+		std::variant<Dense, Sparse, Paged> migrated;
+		switch (kind)
+		{
+		case TensorStorage::Kind::Dense:
+			migrated.template emplace<Dense>().reserve(dimensions, dense_max_volume);
+			break;
+		case TensorStorage::Kind::Sparse:
+			migrated.template emplace<Sparse>();
+			break;
+		case TensorStorage::Kind::Paged:
+			migrated.template emplace<Paged>(dimensions.size());
+			break;
+		}
+
+		forEachCell([&migrated](const Coordinates& coordinates, T& value)
+		{
+			std::visit([&](auto& target) { target.materialize(coordinates) = std::move(value); }, migrated);
+		});
+
+		storage = std::move(migrated);
+		layout++;
+	}
+
+	//cells equal to T() are what absent cells read as, so storing them is optional
+	static bool isImplicit(const T& value)
+	{
+		if constexpr (std::equality_comparable<T>)
+		{
+			return value == T();
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	static const T& implicitValue()
+	{
+		static const T implicit{};
+		return implicit;
+	}
+
+	T* findStored(const Coordinates& coordinates)
+	{
+		return std::visit([&](auto& backend) { return const_cast<T*>(backend.find(coordinates)); }, storage);
+	}
+
+	T& materialize(const Coordinates& coordinates)
+	{
+		T* result = &std::visit([&](auto& backend) -> T& { return backend.materialize(coordinates); }, storage);
+
+		const size_t count = size();
+		if (count >= next_review)
+		{
+			next_review = count * 2;
+			const TensorStorage::Kind kind = chooseKind(count);
+			if (kind != storageKind())
+			{
+				migrate(kind);
+				result = findStored(coordinates);
+			}
+		}
+
+		return *result;
+	}
+	
+public:
+
+	const std::vector<int>& getDimensions() const { return dimensions; }
+
+	TensorStorage::Kind storageKind() const
+	{
+		return static_cast<TensorStorage::Kind>(storage.index());
+	}
+
+	//the dense storage, to write it out as it lies in memory, or nullptr if the tensor is laid out otherwise
+	const Dense* denseStorage() const
+	{
+		return std::get_if<Dense>(&storage);
+	}
+
+	//number of cells currently stored, as opposed to implied by the dimensions
+	size_t size() const
+	{
+		return std::visit([](const auto& backend) { return backend.size(); }, storage);
+	}
+
+	template<typename Visitor_t>
+	void forEachCell(Visitor_t&& visitor)
+	{
+		std::visit([&](auto& backend) { backend.forEach(visitor); }, storage);
+	}
+
+	TensorHandle<T> handleAtCoordinates(const Coordinates& coordinates)
+	{
+		extendDimensions(coordinates);
+		if (T* found = findStored(coordinates))
+		{
+			return TensorHandle<T>(coordinates, found, identity, layout);
+		}
+		else 
+		{
+			return TensorHandle<T>(coordinates);
+		}
+	}
+
+	T& at(TensorHandle<T>& handle) 
+	{
+		unshare();
+		writes++;
+		if (handle.invalid(identity, layout)) 
+		{
+			//the tensor may have shrunk or been laid out anew since the handle was made
+			extendDimensions(handle.coordinates);
+			T& result = materialize(handle.coordinates);
+			handle.cell = &result;
+			handle.identity = identity;
+			handle.layout = layout;
+			return result;
+		}
+		else 
+		{
+			return *handle.cell;
+		}
+	}
+
+	//reads like read() would, keeping the cell in the handle so that reading it again takes no lookup
+	const T& read(TensorHandle<T>& handle)
+	{
+		if (handle.invalid(identity, layout))
+		{
+			extendDimensions(handle.coordinates);
+			T* found = findStored(handle.coordinates);
+			if (found == nullptr)
+			{
+				return implicitValue();
+			}
+			handle.cell = found;
+			handle.identity = identity;
+			handle.layout = layout;
+		}
+		return *handle.cell;
+	}
+
+	//writes like set() would, through the handle
+	void set(TensorHandle<T>& handle, const T& t)
+	{
+		if (isImplicit(t))
+		{
+			extendDimensions(handle.coordinates);
+			erase(handle.coordinates);
+		}
+		else
+		{
+			at(handle) = t;
+		}
+	}
+
+	T& at(const Coordinates& coordinates) 
+	{
+		unshare();
+		extendDimensions(coordinates);
+		writes++;
+		return materialize(coordinates);
+	}
+
+	void setAtCoordinates(const Coordinates& coordinates, const T& t)
+	{
+		at(coordinates) = t;
+	}
+
+	//the stored cell at the coordinates, or nullptr if there is none. Neither allocates nor grows the tensor
+	const T* find(const Coordinates& coordinates) const
+	{
+		return std::visit([&](const auto& backend) { return backend.find(coordinates); }, storage);
+	}
+
+	//the cells along dimension 0 through the coordinates, from 0 up to the dimension's extent, if the tensor is dense
+	//and covers them all. Empty otherwise. Neither allocates nor grows the tensor, and any write may move the cells
+	std::span<const T> row(const Coordinates& coordinates) const
+	{
+		const Dense* dense = std::get_if<Dense>(&storage);
+		if (dense == nullptr || coordinates.empty() || dimensions.empty())
+		{
+			return {};
+		}
+		Coordinates start = coordinates;
+		start[0] = 0;
+		return dense->row(start, static_cast<size_t>(dimensions[0]));
+	}
+
+	//the value at the coordinates, absent cells reading as T(). Neither allocates nor grows the tensor
+	const T& get(const Coordinates& coordinates) const
+	{
+		const T* found = find(coordinates);
+		return found != nullptr ? *found : implicitValue();
+	}
+
+	//reads like at() would, growing the dimensions to cover the coordinates, but without storing a cell for them
+	const T& read(const Coordinates& coordinates)
+	{
+		extendDimensions(coordinates);
+		return get(coordinates);
+	}
+
+	//writes like setAtCoordinates, except that writing T() drops the stored cell instead
+	void set(const Coordinates& coordinates, const T& t)
+	{
+		if (isImplicit(t))
+		{
+			extendDimensions(coordinates);
+			erase(coordinates);
+		}
+		else
+		{
+			at(coordinates) = t;
+		}
+	}
+
+	//sets the cells along dimension 0 from the coordinates on, like set() would one by one
+	void setRow(const Coordinates& start, std::span<const T> cells)
+	{
+		if (cells.empty())
+		{
+			return;
+		}
+
+		unshare();
+		Coordinates coordinates = start.empty() ? Coordinates(0) : start;
+		const int first = coordinates[0];
+		coordinates[0] = first + static_cast<int>(cells.size() - 1);
+		extendDimensions(coordinates);
+		writes++;
+		if (Dense* dense = std::get_if<Dense>(&storage))
+		{
+			if (dense->setRow(start, cells, isImplicit))
+			{
+				//handles to cells which were stored before may point at absent ones now
+				layout++;
+				return;
+			}
+		}
+
+		for (size_t i = 0; i < cells.size(); i++)
+		{
+			coordinates[0] = first + static_cast<int>(i);
+			set(coordinates, cells[i]);
+		}
+	}
+
+	//grows the dimensions to the given ones up front, for about count cells to be set. If they would fill enough of
+	//them, the tensor is laid out densely right away, rather than migrating there as the cells come in
+	void reserve(std::span<const int> new_dimensions, const size_t count)
+	{
+		unshare();
+		std::vector<int> grown = dimensions;
+		grown.resize(std::max(grown.size(), new_dimensions.size()), 1);
+		for (size_t i = 0; i < new_dimensions.size(); i++)
+		{
+			grown[i] = std::max(grown[i], new_dimensions[i]);
+		}
+
+		const size_t volume = TensorStorage::volume_of(grown);
+		const bool fills = volume <= dense_free_volume || (volume <= dense_max_volume && (size() + count) * dense_enter_ratio >= volume);
+		Dense* dense = std::get_if<Dense>(&storage);
+		if (dense == nullptr || !fills)
+		{
+			Coordinates corner(grown);
+			for (int& coordinate : corner)
+			{
+				coordinate--;
+			}
+			extendDimensions(corner);
+			return;
+		}
+
+		dimensions = std::move(grown);
+		writes++;
+		if (dense->reserve(dimensions, dense_max_volume))
+		{
+			layout++;
+		}
+	}
+
+	void erase(const Coordinates& coordinates)
+	{
+		unshare();
+		const bool erased = std::visit([&](auto& backend) { return backend.erase(coordinates); }, storage);
+		if (erased)
+		{
+			//handles to the erased cell (or to the cells of a freed page) must not be used anymore
+			writes++;
+			layout++;
+		}
+	}
+
+	//drops every cell and goes back to dimensions {1}. A dense box of its own is kept for the cells to come, as
+	//programs often shrink a tensor only to fill it again, and cleared as far as it was written. Handles to its cells
+	//go stale through the layout, without anything having to find them
+	void shrink() 
+	{
+		dimensions.clear();
+		dimensions.push_back(1);
+		Dense* dense = std::get_if<Dense>(&storage);
+		if (dense != nullptr && !shared)
+		{
+			dense->clear();
+		}
+		else
+		{
+			storage.template emplace<Dense>().reserve(dimensions, dense_max_volume);
+		}
+		shared = false;
+		writes++;
+		layout++;
+		next_review = first_review;
+	}
+
+	//every write through at(), set(), erase() or shrink() counts, whether or not it changed a value
+	TensorVersion version() const
+	{
+		return TensorVersion{ identity, writes };
+	}
+
+	Tensor() : dimensions({ 1 })
+	{
+		std::get<Dense>(storage).reserve(dimensions, dense_max_volume);
+	}
+
+	//a tensor of the given dimensions over dense storage made elsewhere, e.g. loaded from a program image
+	Tensor(std::vector<int> given_dimensions, Dense&& dense) : dimensions(std::move(given_dimensions)), storage(std::move(dense))
+	{
+		next_review = std::max(first_review, size() * 2);
+	}
+
+	//a tensor with the cells of the source, which read from its storage until the first write copies them. The source
+	//is never written through it, so that interpreters on several threads can run one program without a copy each.
+	//Only a dense box can be lent, tensors laid out otherwise are copied right away
+	static Tensor sharing(const std::shared_ptr<const Tensor>& source)
+	{
+		const Dense* dense = source->denseStorage();
+		if (dense == nullptr || dense->layout().outside != 0)
+		{
+			return Tensor(*source);
+		}
+		Tensor result(source->dimensions, dense->share(source));
+		result.shared = true;
+		return result;
+	}
+
+	Tensor(const Tensor& other) : dimensions(other.dimensions), storage(other.storage), next_review(other.next_review) {}
+
+	Tensor(Tensor&& other) noexcept 
+		: dimensions(std::move(other.dimensions)), storage(std::move(other.storage)), next_review(other.next_review),
+		identity(std::exchange(other.identity, nextIdentity())), writes(other.writes), layout(other.layout), shared(std::exchange(other.shared, false)) {}
+
+	Tensor& operator=(const Tensor& other)
+	{
+		if (this != &other)
+		{
+			dimensions = other.dimensions;
+			storage = other.storage;
+			next_review = other.next_review;
+			identity = nextIdentity();
+			writes = 0;
+			layout = 0;
+			shared = false;
+		}
+		return *this;
+	}
+
+	Tensor& operator=(Tensor&& other) noexcept
+	{
+		if (this != &other)
+		{
+			dimensions = std::move(other.dimensions);
+			storage = std::move(other.storage);
+			next_review = other.next_review;
+			identity = std::exchange(other.identity, nextIdentity());
+			writes = other.writes;
+			layout = other.layout;
+			shared = std::exchange(other.shared, false);
+		}
+		return *this;
+	}
+};
@@ -0,0 +1,631 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <bitset>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <limits>
+#include <climits>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <unordered_map>
+#include "Coordinates.h"
+#include "Arena.h"
+
+//the ways a Tensor can lay out its cells. Every backend stores values by coordinates,
+//treats absent cells as T() and leaves the tensor's dimensions to the Tensor itself
+namespace TensorStorage
+{
+	enum class Kind : unsigned char
+	{
+		Dense,
+		Sparse,
+		Paged
+	};
+
+	constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+	//product of the given dimensions, saturating instead of overflowing
+	inline size_t volume_of(std::span<const int> dimensions)
+	{
+		size_t result = 1;
+		for (const int dimension : dimensions)
+		{
+			const size_t extent = static_cast<size_t>(std::max(dimension, 1));
+			if (result > npos / extent)
+			{
+				return npos;
+			}
+			result *= extent;
+		}
+		return result;
+	}
+
+
+	//the memory of a dense box: allocated from the arena, or lent by whatever outlives it, such as the copy-on-write
+	//mapping of a program image, whose pages are only read in once touched and only copied once written to. Copies
+	//are allocated
+	template<typename T>
+	class Block
+	{
+	public:
+		Block() = default;
+		explicit Block(const size_t size) : items(static_cast<T*>(Arena::allocate(size * sizeof(T)))), count(size), owned(true)
+		{
+			std::uninitialized_value_construct_n(items, count);
+		}
+		Block(const std::span<T> lent, std::shared_ptr<const void> given_lender)
+			: items(lent.data()), count(lent.size()), lender(std::move(given_lender)) {}
+
+		Block(const Block& other) : Block(other.count)
+		{
+			std::copy(other.items, other.items + other.count, items);
+		}
+
+		Block(Block&& other) noexcept
+			: items(std::exchange(other.items, nullptr)), count(std::exchange(other.count, 0)), owned(std::exchange(other.owned, false)), lender(std::move(other.lender)) {}
+
+		Block& operator=(Block other) noexcept
+		{
+			std::swap(items, other.items);
+			std::swap(count, other.count);
+			std::swap(owned, other.owned);
+			std::swap(lender, other.lender);
+			return *this;
+		}
+
+		~Block()
+		{
+			if (owned)
+			{
+				std::destroy_n(items, count);
+				Arena::release(items, count * sizeof(T));
+			}
+		}
+
+		T& operator[](const size_t index) { return items[index]; }
+		const T& operator[](const size_t index) const { return items[index]; }
+
+		T* data() { return items; }
+		const T* data() const { return items; }
+		size_t size() const { return count; }
+
+	private:
+		T* items = nullptr;
+		size_t count = 0;
+		bool owned = false;
+		std::shared_ptr<const void> lender;
+	};
+
+
+	//hash map keyed by canonical coordinates, for tensors whose cells are few and far apart
+	template<typename T>
+	class Sparse
+	{
+	public:
+		const T* find(const Coordinates& coordinates) const
+		{
+			const auto it = cells.find(coordinates);
+			return it == cells.end() ? nullptr : &it->second;
+		}
+
+		T& materialize(const Coordinates& coordinates)
+		{
+			auto it = cells.find(coordinates);
+			if (it == cells.end())
+			{
+				it = cells.emplace(coordinates.canonical(), T()).first;
+			}
+			return it->second;
+		}
+
+		bool erase(const Coordinates& coordinates)
+		{
+			return cells.erase(coordinates) != 0;
+		}
+
+		size_t size() const { return cells.size(); }
+
+		template<typename Visitor_t>
+		void forEach(Visitor_t&& visitor)
+		{
+			for (auto& [coordinates, value] : cells)
+			{
+				visitor(coordinates, value);
+			}
+		}
+
+	private:
+		std::unordered_map<Coordinates, T, CoordinatesHash, CoordinatesEqual> cells;
+	};
+
+
+	//strided array over a box starting at the origin. Coordinates the box does not cover
+	//(in practice, negative ones) are kept in a small sparse overflow
+	template<typename T>
+	class Dense
+	{
+	public:
+		static constexpr size_t WordBits = 64;
+
+		//the number of words holding presence bits for the given number of values
+		static size_t presenceWords(const size_t volume)
+		{
+			return (volume + WordBits - 1) / WordBits;
+		}
+
+		Dense() = default;
+
+		//a box over the given extents with values and presence bits from elsewhere, e.g. a program image. The values
+		//run along dimension 0 first, the bits are one per value, lowest first, and count of them are set
+		Dense(std::vector<int> given_extents, Block<T> given_values, Block<uint64_t> given_present, const size_t given_count)
+			: extents(std::move(given_extents)), values(std::move(given_values)), present(std::move(given_present)), count(given_count), touched(values.size())
+		{
+			size_t stride = 1;
+			for (const int extent : extents)
+			{
+				strides.push_back(stride);
+				stride *= static_cast<size_t>(extent);
+			}
+		}
+
+		//the box as it lies in memory, for writing it out as is
+		struct Layout
+		{
+			std::span<const int> extents;
+			std::span<const T> values;
+			std::span<const uint64_t> present;
+			size_t count;
+			//cells outside of the box, which the layout does not hold
+			size_t outside;
+		};
+
+		Layout layout() const
+		{
+			return Layout{ extents, std::span<const T>(values.data(), values.size()), std::span<const uint64_t>(present.data(), present.size()), count, outside.size() };
+		}
+
+		//a box over the same memory as this one, which the owner keeps alive. Nothing may be written to it,
+		//as this box reads the memory too
+		Dense share(std::shared_ptr<const void> owner) const
+		{
+			Block<T> shared_values(std::span<T>(const_cast<T*>(values.data()), values.size()), owner);
+			Block<uint64_t> shared_present(std::span<uint64_t>(const_cast<uint64_t*>(present.data()), present.size()), std::move(owner));
+			return Dense(extents, std::move(shared_values), std::move(shared_present), count);
+		}
+
+		size_t offsetOf(const Coordinates& coordinates) const
+		{
+			size_t offset = 0;
+			for (size_t i = 0; i < coordinates.size(); i++)
+			{
+				const int coordinate = coordinates[i];
+				if (coordinate == 0)
+				{
+					continue;
+				}
+				if (coordinate < 0 || i >= extents.size() || coordinate >= extents[i])
+				{
+					return npos;
+				}
+				offset += static_cast<size_t>(coordinate) * strides[i];
+			}
+			return offset;
+		}
+
+		const T* find(const Coordinates& coordinates) const
+		{
+			const size_t offset = offsetOf(coordinates);
+			if (offset == npos)
+			{
+				return outside.find(coordinates);
+			}
+			return isPresent(offset) ? &values[offset] : nullptr;
+		}
+
+		T& materialize(const Coordinates& coordinates)
+		{
+			const size_t offset = offsetOf(coordinates);
+			if (offset == npos)
+			{
+				return outside.materialize(coordinates);
+			}
+			if (!isPresent(offset))
+			{
+				setPresent(offset, true);
+				count++;
+				touched = std::max(touched, offset + 1);
+			}
+			return values[offset];
+		}
+
+		bool erase(const Coordinates& coordinates)
+		{
+			const size_t offset = offsetOf(coordinates);
+			if (offset == npos)
+			{
+				return outside.erase(coordinates);
+			}
+			if (!isPresent(offset))
+			{
+				return false;
+			}
+			setPresent(offset, false);
+			values[offset] = T();
+			count--;
+			return true;
+		}
+
+		size_t size() const { return count + outside.size(); }
+
+		//the length cells along dimension 0 from the coordinates on, absent ones holding T(). They are contiguous,
+		//dimension 0 having stride 1. Empty if the box does not cover all of them
+		std::span<const T> row(const Coordinates& start, const size_t length) const
+		{
+			const size_t offset = rowOffset(start, length);
+			if (offset == npos)
+			{
+				return {};
+			}
+			return std::span<const T>(values.data() + offset, length);
+		}
+
+		//stores the cells along dimension 0 from the coordinates on, leaving out the ones isImplicit holds for.
+		//Returns false, storing nothing, if the box does not cover all of them
+		template<typename IsImplicit_t>
+		bool setRow(const Coordinates& start, std::span<const T> cells, IsImplicit_t&& isImplicit)
+		{
+			const size_t offset = rowOffset(start, cells.size());
+			if (offset == npos)
+			{
+				return false;
+			}
+			for (size_t i = 0; i < cells.size(); i++)
+			{
+				const bool stored = !isImplicit(cells[i]);
+				count = count + stored - isPresent(offset + i);
+				setPresent(offset + i, stored);
+				values[offset + i] = cells[i];
+			}
+			touched = std::max(touched, offset + cells.size());
+			return true;
+		}
+
+		//forgets every cell, keeping the box and its memory for the ones to come. Only the part written since it was
+		//last cleared is cleared again, so that clearing costs no more than filling it did
+		void clear()
+		{
+			std::fill_n(values.data(), touched, T());
+			std::fill_n(present.data(), presenceWords(touched), uint64_t{ 0 });
+			touched = 0;
+			count = 0;
+			outside = Sparse<T>();
+		}
+
+		template<typename Visitor_t>
+		void forEach(Visitor_t&& visitor)
+		{
+			std::vector<int> position(extents.size(), 0);
+			for (size_t offset = 0; offset < values.size(); offset++)
+			{
+				if (isPresent(offset))
+				{
+					visitor(Coordinates(position).canonical(), values[offset]);
+				}
+				advance(position);
+			}
+			outside.forEach(visitor);
+		}
+
+		//grows the box to cover the given dimensions. Extents that need to grow are doubled so that
+		//repeated growth (e.g. while parsing) stays amortized, unless that would exceed max_volume.
+		//Returns whether values moved, invalidating references into the storage
+		bool reserve(std::span<const int> dimensions, const size_t max_volume)
+		{
+			const size_t rank = std::max(extents.size(), dimensions.size());
+			bool grows = false;
+			for (size_t i = 0; i < dimensions.size(); i++)
+			{
+				grows = grows || dimensions[i] > (i < extents.size() ? extents[i] : 1);
+			}
+			if (!grows)
+			{
+				//only new trailing dimensions of extent 1, which do not move anything. Most calls end here, e.g. every
+				//one after a box which was kept through shrinking grows back into it, so they allocate nothing
+				for (size_t i = extents.size(); i < rank; i++)
+				{
+					strides.push_back(values.size());
+					extents.push_back(1);
+				}
+				return false;
+			}
+
+			std::vector<int> doubled(rank, 1);
+			std::vector<int> exact(rank, 1);
+			for (size_t i = 0; i < rank; i++)
+			{
+				const int current = i < extents.size() ? extents[i] : 1;
+				const int needed = i < dimensions.size() ? dimensions[i] : 1;
+				exact[i] = std::max(current, needed);
+				doubled[i] = needed > current && current <= INT_MAX / 2 ? std::max(needed, current * 2) : exact[i];
+			}
+
+			relayout(volume_of(doubled) <= max_volume ? std::move(doubled) : std::move(exact));
+			return true;
+		}
+
+	private:
+		bool isPresent(const size_t offset) const
+		{
+			return (present[offset / WordBits] >> offset % WordBits & 1) != 0;
+		}
+
+		void setPresent(const size_t offset, const bool stored)
+		{
+			const uint64_t bit = uint64_t{ 1 } << offset % WordBits;
+			present[offset / WordBits] = stored ? present[offset / WordBits] | bit : present[offset / WordBits] & ~bit;
+		}
+
+		//the offset of the coordinates, if the box covers length cells along dimension 0 from them on, npos otherwise
+		size_t rowOffset(const Coordinates& start, const size_t length) const
+		{
+			const size_t offset = offsetOf(start);
+			const int first = start.empty() ? 0 : start[0];
+			if (offset == npos || extents.empty() || static_cast<size_t>(extents[0] - first) < length)
+			{
+				return npos;
+			}
+			return offset;
+		}
+
+		void advance(std::vector<int>& position) const
+		{
+			for (size_t i = 0; i < position.size(); i++)
+			{
+				if (++position[i] < extents[i])
+				{
+					return;
+				}
+				position[i] = 0;
+			}
+		}
+
+		void relayout(std::vector<int>&& new_extents)
+		{
+			std::vector<size_t> new_strides(new_extents.size());
+			size_t new_volume = 1;
+			for (size_t i = 0; i < new_extents.size(); i++)
+			{
+				new_strides[i] = new_volume;
+				new_volume *= static_cast<size_t>(new_extents[i]);
+			}
+
+			Block<T> new_values(new_volume);
+			Block<uint64_t> new_present(presenceWords(new_volume));
+			size_t new_touched = 0;
+			std::vector<int> position(extents.size(), 0);
+			for (size_t offset = 0; offset < values.size(); offset++)
+			{
+				if (isPresent(offset))
+				{
+					size_t new_offset = 0;
+					for (size_t i = 0; i < position.size(); i++)
+					{
+						new_offset += static_cast<size_t>(position[i]) * new_strides[i];
+					}
+					new_values[new_offset] = std::move(values[offset]);
+					new_present[new_offset / WordBits] |= uint64_t{ 1 } << new_offset % WordBits;
+					new_touched = std::max(new_touched, new_offset + 1);
+				}
+				advance(position);
+			}
+
+			extents = std::move(new_extents);
+			strides = std::move(new_strides);
+			values = std::move(new_values);
+			present = std::move(new_present);
+			touched = new_touched;
+
+			//pull in overflow cells the box now covers
+			std::vector<Coordinates> covered;
+			outside.forEach([&](const Coordinates& coordinates, T&)
+			{
+				if (offsetOf(coordinates) != npos)
+				{
+					covered.push_back(coordinates);
+				}
+			});
+			for (const Coordinates& coordinates : covered)
+			{
+				T value = std::move(outside.materialize(coordinates));
+				outside.erase(coordinates);
+				materialize(coordinates) = std::move(value);
+			}
+		}
+
+		std::vector<int> extents;
+		std::vector<size_t> strides;
+		Block<T> values = Block<T>(1);
+		Block<uint64_t> present = Block<uint64_t>(1);
+		size_t count = 0;
+		//one past the last value written since the box was last cleared, beyond which every value is T()
+		size_t touched = 0;
+		Sparse<T> outside;
+	};
+
+
+	//fixed-size pages of cells, allocated on first touch, for large tensors which are only partly filled.
+	//A page spans 4096 cells of dimension 0 in 1-d tensors and 64x64 cells of dimensions 0 and 1 otherwise
+	template<typename T>
+	class Paged
+	{
+	public:
+		static constexpr size_t PageCells = 4096;
+		using Shifts = std::array<int, 2>;
+
+		static Shifts shiftsFor(const size_t rank)
+		{
+			return rank < 2 ? Shifts{ 12, 0 } : Shifts{ 6, 6 };
+		}
+
+		static Coordinates pageOf(const Coordinates& coordinates, const Shifts& shifts)
+		{
+			Coordinates key = coordinates;
+			for (size_t i = 0; i < shifts.size() && i < key.size(); i++)
+			{
+				key[i] >>= shifts[i];
+			}
+			key.resize(key.rank());
+			return key;
+		}
+
+		explicit Paged(const size_t rank) : shifts(shiftsFor(rank)) {}
+		Paged() : Paged(1) {}
+
+		Paged(const Paged& other) : shifts(other.shifts), count(other.count)
+		{
+			for (const auto& [key, page] : other.pages)
+			{
+				pages.emplace(key, newPage(*page));
+			}
+		}
+
+		Paged(Paged&&) noexcept = default;
+
+		Paged& operator=(Paged other) noexcept
+		{
+			std::swap(shifts, other.shifts);
+			std::swap(pages, other.pages);
+			std::swap(count, other.count);
+			return *this;
+		}
+
+		const T* find(const Coordinates& coordinates) const
+		{
+			const auto it = pages.find(pageOf(coordinates, shifts));
+			if (it == pages.end())
+			{
+				return nullptr;
+			}
+			const size_t offset = offsetOf(coordinates);
+			return it->second->present[offset] ? &it->second->values[offset] : nullptr;
+		}
+
+		T& materialize(const Coordinates& coordinates)
+		{
+			PagePointer& page = pages[pageOf(coordinates, shifts)];
+			if (!page)
+			{
+				page = newPage();
+			}
+			const size_t offset = offsetOf(coordinates);
+			if (!page->present[offset])
+			{
+				page->present[offset] = true;
+				page->count++;
+				count++;
+			}
+			return page->values[offset];
+		}
+
+		bool erase(const Coordinates& coordinates)
+		{
+			const auto it = pages.find(pageOf(coordinates, shifts));
+			const size_t offset = offsetOf(coordinates);
+			if (it == pages.end() || !it->second->present[offset])
+			{
+				return false;
+			}
+			Page& page = *it->second;
+			page.present[offset] = false;
+			page.values[offset] = T();
+			count--;
+			if (--page.count == 0)
+			{
+				pages.erase(it);
+			}
+			return true;
+		}
+
+		size_t size() const { return count; }
+		size_t pageCount() const { return pages.size(); }
+
+		template<typename Visitor_t>
+		void forEach(Visitor_t&& visitor)
+		{
+			for (auto& [key, page] : pages)
+			{
+				for (size_t offset = 0; offset < PageCells; offset++)
+				{
+					if (page->present[offset])
+					{
+						visitor(coordinatesOf(key, offset), page->values[offset]);
+					}
+				}
+			}
+		}
+
+	private:
+		struct Page
+		{
+			std::array<T, PageCells> values{};
+			std::bitset<PageCells> present;
+			size_t count = 0;
+		};
+
+		//pages come from the arena, so that the pages of a tensor which is shrunk are there for the next one
+		struct PageDeleter
+		{
+			void operator()(Page* const page) const noexcept
+			{
+				page->~Page();
+				Arena::release(page, sizeof(Page));
+			}
+		};
+		using PagePointer = std::unique_ptr<Page, PageDeleter>;
+
+		template<typename... Args_t>
+		static PagePointer newPage(Args_t&&... args)
+		{
+			void* const memory = Arena::allocate(sizeof(Page));
+			return PagePointer(new (memory) Page(std::forward<Args_t>(args)...));
+		}
+
+		size_t offsetOf(const Coordinates& coordinates) const
+		{
+			size_t offset = 0;
+			int shift = 0;
+			for (size_t i = 0; i < shifts.size(); i++)
+			{
+				const int coordinate = i < coordinates.size() ? coordinates[i] : 0;
+				offset |= static_cast<size_t>(coordinate & ((1 << shifts[i]) - 1)) << shift;
+				shift += shifts[i];
+			}
+			return offset;
+		}
+
+		Coordinates coordinatesOf(const Coordinates& key, const size_t offset) const
+		{
+			Coordinates result = key;
+			if (result.size() < shifts.size())
+			{
+				result.resize(shifts.size(), 0);
+			}
+			int shift = 0;
+			for (size_t i = 0; i < shifts.size(); i++)
+			{
+				const int local = static_cast<int>((offset >> shift) & ((size_t{ 1 } << shifts[i]) - 1));
+				result[i] = static_cast<int>(static_cast<unsigned>(result[i]) << shifts[i]) | local;
+				shift += shifts[i];
+			}
+			result.resize(result.rank());
+			return result;
+		}
+
+		Shifts shifts;
+		std::unordered_map<Coordinates, PagePointer, CoordinatesHash, CoordinatesEqual> pages;
+		size_t count = 0;
+	};
+}
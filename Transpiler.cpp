@@ -0,0 +1,699 @@
+#include "Transpiler.h"
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Interpreter.h"
+#include "InstructionKey.h"
+#include "ProgramImage.h"
+#include "Dependencies/Files.h"
+#include "Dependencies/Logger/Logger.h"
+
+namespace
+{
+	//programs reaching more ticks than this are refused, rather than written out as a file too large to build
+	constexpr size_t MaxTicks = size_t{ 1 } << 16;
+	//and so are those whose data cursor can be in more places than this while it is on an instruction tensor
+	constexpr size_t MaxDataStates = size_t{ 1 } << 20;
+
+	std::string text_of(const Coordinates& coordinates)
+	{
+		std::string text = "(";
+		for (size_t i = 0; i < std::max<size_t>(coordinates.rank(), 1); i++)
+		{
+			text += (i == 0 ? "" : " ") + std::to_string(i < coordinates.rank() ? coordinates[i] : 0);
+		}
+		return text + ")";
+	}
+
+	std::string text_of(const InstructionKey& key)
+	{
+		return text_of(key.cell_index) + " of tensor " + text_of(key.tensor_index);
+	}
+
+	//whether reading the coordinates would grow a tensor of the dimensions, which negative ones never do
+	bool within(const Coordinates& coordinates, const std::vector<int>& dimensions)
+	{
+		for (size_t i = 0; i < coordinates.size(); i++)
+		{
+			const int dimension = i < dimensions.size() ? dimensions[i] : 1;
+			if (coordinates[i] >= dimension)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//the instruction a cell executes, if any. Negative ints execute nothing, except for multiples of the instruction
+	//count, which output
+	std::optional<Instruction> instruction_of(const Cell& cell)
+	{
+		if (!cell.isInt() || cell.value() % InstructionCount < 0)
+		{
+			return std::nullopt;
+		}
+		return static_cast<Instruction>(cell.value() % InstructionCount);
+	}
+
+	//a data instruction a tick executes, with its paired numbers if it takes them
+	struct Effect
+	{
+		Instruction instruction;
+		Coordinates operand;
+		//where it is, to explain why the program is refused
+		InstructionKey key;
+	};
+
+	//one way a tick can go: the data instruction it executes, if any, and where the instruction cursor goes next
+	struct Path
+	{
+		enum class End
+		{
+			Tick,
+			Halted,
+			Failed
+		};
+
+		std::optional<Effect> effect;
+		End end = End::Tick;
+		InstructionKey next;
+		size_t next_tick = 0;
+	};
+
+	//a tick the program can reach
+	struct Tick
+	{
+		InstructionKey key;
+		//what the tick does, or if it executes a conditional jump, what it does when the data cell is not 0
+		Path path;
+		//what a tick on a conditional jump does when it jumps
+		std::optional<Path> jumped;
+	};
+
+	//where the data cursor can be at the start of a tick. Its cell index is only followed while it is on a tensor the
+	//program runs in, where reading past the dimensions would change where the instruction cursor goes
+	struct DataState
+	{
+		size_t tick;
+		Coordinates tensor_index;
+		std::optional<Coordinates> cell_index;
+	};
+
+	struct DataStateHash
+	{
+		size_t operator()(const DataState& state) const
+		{
+			const CoordinatesHash hash;
+			return (state.tick * 31 + hash(state.tensor_index)) * 31 + (state.cell_index.has_value() ? hash(state.cell_index.value()) + 1 : 0);
+		}
+	};
+
+	struct DataStateEqual
+	{
+		bool operator()(const DataState& lhs, const DataState& rhs) const
+		{
+			return lhs.tick == rhs.tick && Coordinates::equal(lhs.tensor_index, rhs.tensor_index)
+				&& lhs.cell_index.has_value() == rhs.cell_index.has_value()
+				&& (!lhs.cell_index.has_value() || Coordinates::equal(lhs.cell_index.value(), rhs.cell_index.value()));
+		}
+	};
+
+	//follows the program on an interpreter of its own, which pairs parens and steps the instruction cursor exactly the
+	//way running it does. Nothing is executed on it, so its instruction tensors stay as the program starts out
+	class Analysis
+	{
+	public:
+		explicit Analysis(Tensor<Cell>& program) : interpreter(Tensor<Cell>(program)) {}
+
+		//every tick the program can reach, the first one being where it starts. Returns why the program can not be
+		//written out, if it can not
+		std::optional<std::string> followTicks()
+		{
+			std::vector<InstructionKey> pending = { InstructionKey{ Coordinates(0), Coordinates(0), Coordinates(1) } };
+			while (!pending.empty())
+			{
+				const InstructionKey key = std::move(pending.back());
+				pending.pop_back();
+				if (tick_of.contains(key))
+				{
+					continue;
+				}
+				if (ticks.size() >= MaxTicks)
+				{
+					return "it reaches more than " + std::to_string(MaxTicks) + " ticks";
+				}
+
+				tick_of.emplace(key, ticks.size());
+				Tick tick;
+				tick.key = key;
+				if (std::optional<std::string> reason = follow(tick))
+				{
+					return reason;
+				}
+				//the way on from a tick without a jump is followed first, so that the generated code falls through to it
+				if (tick.jumped.has_value() && tick.jumped->end == Path::End::Tick)
+				{
+					pending.push_back(tick.jumped->next);
+				}
+				if (tick.path.end == Path::End::Tick)
+				{
+					pending.push_back(tick.path.next);
+				}
+				ticks.push_back(std::move(tick));
+			}
+
+			for (Tick& tick : ticks)
+			{
+				for (Path* path : { &tick.path, tick.jumped.has_value() ? &tick.jumped.value() : nullptr })
+				{
+					if (path != nullptr && path->end == Path::End::Tick)
+					{
+						path->next_tick = tick_of.at(path->next);
+					}
+				}
+			}
+			return std::nullopt;
+		}
+
+		//follows the data cursor through the ticks, checking that no data instruction changes a tensor the program
+		//runs in. Returns why the program can not be written out, if it can not
+		std::optional<std::string> followData()
+		{
+			std::unordered_set<DataState, DataStateHash, DataStateEqual> seen;
+			std::vector<DataState> pending = { DataState{ 0, Coordinates(1), Coordinates(0) } };
+			while (!pending.empty())
+			{
+				DataState state = std::move(pending.back());
+				pending.pop_back();
+				if (!seen.insert(state).second)
+				{
+					continue;
+				}
+				if (seen.size() > MaxDataStates)
+				{
+					return "its data cursor can be in more than " + std::to_string(MaxDataStates) + " places within the tensors it runs in";
+				}
+
+				const Tick& tick = ticks[state.tick];
+				if (tick.jumped.has_value())
+				{
+					if (std::optional<std::string> reason = checkRead(state, "conditional jump at " + text_of(tick.key)))
+					{
+						return reason;
+					}
+				}
+				for (const Path* path : { &tick.path, tick.jumped.has_value() ? &tick.jumped.value() : nullptr })
+				{
+					if (path == nullptr)
+					{
+						continue;
+					}
+					DataState next = state;
+					if (path->effect.has_value())
+					{
+						if (std::optional<std::string> reason = apply(path->effect.value(), next))
+						{
+							return reason;
+						}
+					}
+					if (path->end == Path::End::Tick)
+					{
+						next.tick = path->next_tick;
+						pending.push_back(std::move(next));
+					}
+				}
+			}
+			return std::nullopt;
+		}
+
+		std::vector<Tick> ticks;
+		//whether data instructions read the tensor the program starts in, or move the data cursor by its dimensions,
+		//which the generated code then gets a copy of it for
+		bool uses_program = false;
+
+	private:
+		Interpreter interpreter;
+		std::unordered_map<InstructionKey, size_t, InstructionKeyHash, InstructionKeyEqual> tick_of;
+		//the tensors the ticks run in
+		std::vector<Coordinates> instruction_tensors;
+
+		//puts the interpreter's instruction cursor where the key says, moving the way it says
+		void place(const InstructionKey& key)
+		{
+			interpreter.instruction_cursor.tensor_index = key.tensor_index;
+			interpreter.instruction_cursor.cell_index = key.cell_index;
+			interpreter.instruction_cursor_direction.resize(key.movement.size());
+			for (size_t i = 0; i < key.movement.size(); i++)
+			{
+				const int step = key.movement[i];
+				interpreter.instruction_cursor_direction[i] = step > 0 ? Incremental : step < 0 ? Decremental : Neutral;
+			}
+		}
+
+		//the numbers paired after the instruction at the key, the way executing it pairs them
+		Coordinates numbersAfter(const InstructionKey& key)
+		{
+			place(key);
+			Coordinates next = key.cell_index;
+			interpreter.advanceIndex(next);
+			const PairedParens& paired_parens = interpreter.pairParens(next);
+			return paired_parens.closing_parens_index.has_value() ? paired_parens.numbers : Coordinates();
+		}
+
+		//where the instruction cursor goes from the key at the end of the tick started at start
+		Path end(const InstructionKey& start, const InstructionKey& key)
+		{
+			place(key);
+			Coordinates next = key.cell_index;
+			interpreter.advanceIndex(next);
+			Path path;
+			if (Coordinates::equal(next, start.cell_index) && Coordinates::equal(key.tensor_index, start.tensor_index))
+			{
+				path.end = Path::End::Halted;
+				return path;
+			}
+			path.next = InstructionKey{ key.tensor_index.canonical(), next.canonical(), key.movement.canonical() };
+			return path;
+		}
+
+		//the instruction cell at the key, or nullopt if reading it would grow the tensor
+		std::optional<Cell> cellAt(const InstructionKey& key)
+		{
+			place(key);
+			const Tensor<Cell>& tensor = interpreter.instructionTensor();
+			if (!within(key.cell_index, tensor.getDimensions()))
+			{
+				return std::nullopt;
+			}
+			return tensor.get(key.cell_index);
+		}
+
+		std::optional<std::string> follow(Tick& tick)
+		{
+			const InstructionKey& start = tick.key;
+			if (std::find_if(instruction_tensors.begin(), instruction_tensors.end(), [&](const Coordinates& tensor_index)
+			{
+				return Coordinates::equal(tensor_index, start.tensor_index);
+			}) == instruction_tensors.end())
+			{
+				instruction_tensors.push_back(start.tensor_index);
+			}
+
+			const std::optional<Cell> cell = cellAt(start);
+			if (!cell.has_value())
+			{
+				return "the instruction cursor reaches " + text_of(start) + ", outside of the tensor, which reading it grows";
+			}
+			if (instruction_of(cell.value()) != ConditionalSetInstructionCursorCellIndex)
+			{
+				tick.path = execute(start, start, false);
+				return std::nullopt;
+			}
+
+			tick.path = end(start, start);
+			//a jump to a conditional jump executes it as well, on the same data cell, so it jumps too
+			std::vector<Coordinates> chain = { start.cell_index };
+			InstructionKey jumped_to{ start.tensor_index, numbersAfter(start), start.movement };
+			while (true)
+			{
+				const std::optional<Cell> jumped_cell = cellAt(jumped_to);
+				if (!jumped_cell.has_value())
+				{
+					return "the conditional jump at " + text_of(start) + " can jump to " + text_of(jumped_to.cell_index) + ", outside of the tensor, which reading it grows";
+				}
+				if (instruction_of(jumped_cell.value()) != ConditionalSetInstructionCursorCellIndex)
+				{
+					break;
+				}
+				if (std::find_if(chain.begin(), chain.end(), [&](const Coordinates& cell_index) { return Coordinates::equal(cell_index, jumped_to.cell_index); }) != chain.end())
+				{
+					return "the conditional jump at " + text_of(start) + " can lead to jumping from conditional jump to conditional jump without end";
+				}
+				chain.push_back(jumped_to.cell_index);
+				jumped_to.cell_index = numbersAfter(jumped_to);
+			}
+			tick.jumped = execute(start, jumped_to, true);
+			return std::nullopt;
+		}
+
+		//executes the instruction at the key, which is not a conditional jump, as part of the tick started at start.
+		//Unpaired parens only fail the tick if it started on them
+		Path execute(const InstructionKey& start, InstructionKey key, const bool jumped)
+		{
+			const Cell cell = cellAt(key).value();
+			if (cell.isOpening())
+			{
+				place(key);
+				const std::optional<Coordinates> closing_parens_index = interpreter.pairParens(key.cell_index).closing_parens_index;
+				if (closing_parens_index.has_value())
+				{
+					key.cell_index = closing_parens_index.value();
+				}
+				else if (!jumped)
+				{
+					Path failed;
+					failed.end = Path::End::Failed;
+					return failed;
+				}
+				return end(start, key);
+			}
+			const std::optional<Instruction> instruction = instruction_of(cell);
+			if (!instruction.has_value())
+			{
+				return end(start, key);
+			}
+
+			std::optional<Effect> effect;
+			switch (instruction.value())
+			{
+			case SetInstructionCursorDirection:
+			{
+				const Coordinates numbers = numbersAfter(key);
+				interpreter.instruction_cursor_direction.resize(numbers.size());
+				for (size_t i = 0; i < numbers.size(); i++)
+				{
+					interpreter.instruction_cursor_direction[i] = static_cast<Direction>(numbers[i] % Direction::DirectionCount);
+				}
+				key.movement = interpreter.currentMovement();
+			}
+			break;
+			case SetInstructionCursorTensorIndex:
+			{
+				key.tensor_index = numbersAfter(key);
+			}
+			break;
+			case IncrementDataCursorCellIndex:
+			case SetDataCursorTensorIndex:
+			case ShrinkTensor:
+			{
+				effect = Effect{ instruction.value(), numbersAfter(key), key };
+			}
+			break;
+			default:
+			{
+				effect = Effect{ instruction.value(), Coordinates(), key };
+			}
+			break;
+			}
+
+			Path path = end(start, key);
+			path.effect = std::move(effect);
+			return path;
+		}
+
+		bool isInstructionTensor(const Coordinates& tensor_index) const
+		{
+			return std::find_if(instruction_tensors.begin(), instruction_tensors.end(), [&](const Coordinates& instruction_tensor)
+			{
+				return Coordinates::equal(instruction_tensor, tensor_index);
+			}) != instruction_tensors.end();
+		}
+
+		std::optional<std::string> checkRead(const DataState& state, const std::string& reader)
+		{
+			if (!isInstructionTensor(state.tensor_index))
+			{
+				return std::nullopt;
+			}
+			if (!state.cell_index.has_value())
+			{
+				return "the " + reader + " can read tensor " + text_of(state.tensor_index) + ", which it runs in, where the data cursor was moved to on other tensors";
+			}
+			if (!within(state.cell_index.value(), interpreter.meta_tensor.at(state.tensor_index).getDimensions()))
+			{
+				return "the " + reader + " can read " + text_of(state.cell_index.value()) + " of tensor " + text_of(state.tensor_index) + ", outside of the tensor it runs in, which reading it grows";
+			}
+			uses_program = uses_program || Coordinates::equal(state.tensor_index, Coordinates(0));
+			return std::nullopt;
+		}
+
+		std::optional<std::string> checkWrite(const DataState& state, const Effect& effect)
+		{
+			if (isInstructionTensor(state.tensor_index))
+			{
+				return "instruction " + std::to_string(effect.instruction) + " at " + text_of(effect.key) + " can write to tensor " + text_of(state.tensor_index) + ", which the program runs in";
+			}
+			return std::nullopt;
+		}
+
+		std::optional<std::string> apply(const Effect& effect, DataState& state)
+		{
+			switch (effect.instruction)
+			{
+			case OutputCurrentData:
+				return checkRead(state, "output at " + text_of(effect.key));
+			case IncrementDataCursorCellIndex:
+				if (!isInstructionTensor(state.tensor_index))
+				{
+					state.cell_index.reset();
+					return std::nullopt;
+				}
+				uses_program = uses_program || Coordinates::equal(state.tensor_index, Coordinates(0));
+				if (state.cell_index.has_value())
+				{
+					state.cell_index->increment(effect.operand, interpreter.meta_tensor.at(state.tensor_index).getDimensions());
+				}
+				return std::nullopt;
+			case SetDataCursorTensorIndex:
+				state.tensor_index = effect.operand.canonical();
+				return std::nullopt;
+			case ShrinkTensor:
+				if (isInstructionTensor(effect.operand))
+				{
+					return "instruction 11 at " + text_of(effect.key) + " can shrink tensor " + text_of(effect.operand) + ", which the program runs in";
+				}
+				return std::nullopt;
+			default:
+				return checkWrite(state, effect);
+			}
+		}
+	};
+
+	//the C++ the program is written out as
+	class Writer
+	{
+	public:
+		explicit Writer(const Analysis& given_analysis) : analysis(given_analysis)
+		{
+			for (const Tick& tick : analysis.ticks)
+			{
+				for (const Path* path : { &tick.path, tick.jumped.has_value() ? &tick.jumped.value() : nullptr })
+				{
+					if (path != nullptr)
+					{
+						countJump(tick, *path, path == &tick.path);
+					}
+				}
+			}
+		}
+
+		std::string write(Tensor<Cell>& program)
+		{
+			std::string body;
+			for (size_t i = 0; i < analysis.ticks.size(); i++)
+			{
+				const Tick& tick = analysis.ticks[i];
+				body += "\n\t//" + text_of(tick.key) + ", moving by " + text_of(tick.key.movement) + "\n";
+				if (jumped_to[i])
+				{
+					body += "tick_" + std::to_string(i) + ":\n";
+				}
+				if (tick.jumped.has_value())
+				{
+					body += "\tif (program.dataCellIsZero())\n\t{\n";
+					writePath(body, i, tick.jumped.value(), "\t\t", false);
+					body += "\t}\n";
+				}
+				writePath(body, i, tick.path, "\t", true);
+			}
+			if (halts)
+			{
+				body += "\nhalted:\n\treturn program.finish(true);\n";
+			}
+			if (fails)
+			{
+				body += "\nfailed:\n\treturn program.finish(false);\n";
+			}
+
+			std::string source =
+				"//written by --emit-cpp. It only stands in for the instruction cursor, and executes the data instructions\n"
+				"//with the interpreter's own, so it is built with the interpreter's sources but Source.cpp, e.g.\n"
+				"//g++ -std=c++20 -O2 -I<sources> program.cpp NativeProgram.cpp ArgumentParser.cpp Interpreter.cpp Checkpoint.cpp ProgramImage.cpp\n"
+				"//Profiler.cpp LoopIdiom.cpp ParensScan.cpp Input.cpp Output.cpp Arena.cpp Dependencies/Logger/Logger.cpp -pthread\n"
+				"//It takes -o, -f, -in and -if like the interpreter does\n"
+				"#include <span>\n"
+				"#include <vector>\n"
+				"#include \"NativeProgram.h\"\n";
+
+			std::string image_span = "std::span<const char>()";
+			if (!operands.empty() || analysis.uses_program)
+			{
+				source += "\nnamespace\n{\n";
+				if (!operands.empty())
+				{
+					source += "\t//the numbers paired with the instructions below\n\tconst Coordinates operands[] =\n\t{\n";
+					for (const Coordinates& operand : operands)
+					{
+						source += "\t\tstd::vector<int>{";
+						for (size_t i = 0; i < operand.size(); i++)
+						{
+							source += (i == 0 ? " " : ", ") + std::to_string(operand[i]);
+						}
+						source += operand.empty() ? "},\n" : " },\n";
+					}
+					source += "\t};\n";
+				}
+				if (analysis.uses_program)
+				{
+					source += std::string(operands.empty() ? "" : "\n") + "\t//the tensor the program starts in, which data instructions use, as ProgramImage encodes it\n\tconst unsigned char image[] =\n\t{";
+					const std::vector<char> bytes = ProgramImage::encode(program);
+					for (size_t i = 0; i < bytes.size(); i++)
+					{
+						source += (i % 24 == 0 ? "\n\t\t" : " ") + std::to_string(static_cast<unsigned char>(bytes[i])) + ",";
+					}
+					source += "\n\t};\n";
+					image_span = "std::span<const char>(reinterpret_cast<const char*>(image), sizeof(image))";
+				}
+				source += "}\n";
+			}
+
+			source += "\nint main(const int argc, const char** argv)\n{\n"
+				"\tNativeProgram program(std::span<const char*>(argv, argc), " + image_span + ");\n"
+				"\tif (!program.ready())\n\t{\n\t\treturn 1;\n\t}\n";
+			return source + body + "}\n";
+		}
+
+	private:
+		const Analysis& analysis;
+		//whether each tick is jumped to, rather than only fallen through to, which only ticks without a jump can be
+		std::vector<bool> jumped_to = std::vector<bool>(analysis.ticks.size(), false);
+		bool halts = false;
+		bool fails = false;
+		std::vector<Coordinates> operands;
+
+		static bool fallsThrough(const size_t tick, const Path& path, const bool last)
+		{
+			return last && path.end == Path::End::Tick && path.next_tick == tick + 1;
+		}
+
+		void countJump(const Tick& tick, const Path& path, const bool last)
+		{
+			const size_t index = static_cast<size_t>(&tick - analysis.ticks.data());
+			switch (path.end)
+			{
+			case Path::End::Tick:
+				jumped_to[path.next_tick] = jumped_to[path.next_tick] || !fallsThrough(index, path, last);
+				break;
+			case Path::End::Halted:
+				halts = true;
+				break;
+			case Path::End::Failed:
+				fails = true;
+				break;
+			}
+		}
+
+		std::string operandFor(const Coordinates& operand)
+		{
+			const auto found = std::find_if(operands.begin(), operands.end(), [&](const Coordinates& known)
+			{
+				return std::equal(known.begin(), known.end(), operand.begin(), operand.end());
+			});
+			const size_t index = static_cast<size_t>(found - operands.begin());
+			if (found == operands.end())
+			{
+				operands.push_back(operand);
+			}
+			return "operands[" + std::to_string(index) + "]";
+		}
+
+		void writePath(std::string& body, const size_t tick, const Path& path, const std::string& indent, const bool last)
+		{
+			if (path.effect.has_value())
+			{
+				const Effect& effect = path.effect.value();
+				body += indent;
+				switch (effect.instruction)
+				{
+				case OutputCurrentData:
+					body += "program.output();\n";
+					break;
+				case IncrementDataCursorCellIndex:
+					body += "program.moveDataCursor(" + operandFor(effect.operand) + ");\n";
+					break;
+				case SetDataCursorTensorIndex:
+					body += "program.setDataTensor(" + operandFor(effect.operand) + ");\n";
+					break;
+				case IncrementDataCell:
+					body += "program.increment();\n";
+					break;
+				case DecrementDataCell:
+					body += "program.decrement();\n";
+					break;
+				case SetDataCellUserInput:
+					body += "program.input();\n";
+					break;
+				case SetDataCellOpeningParens:
+					body += "program.setOpeningParens();\n";
+					break;
+				case SetDataCellClosingParens:
+					body += "program.setClosingParens();\n";
+					break;
+				case ShrinkTensor:
+					body += "program.shrink(" + operandFor(effect.operand) + ");\n";
+					break;
+				default:
+					break;
+				}
+			}
+
+			switch (path.end)
+			{
+			case Path::End::Tick:
+				if (!fallsThrough(tick, path, last))
+				{
+					body += indent + "goto tick_" + std::to_string(path.next_tick) + ";\n";
+				}
+				break;
+			case Path::End::Halted:
+				body += indent + "goto halted;\n";
+				break;
+			case Path::End::Failed:
+				body += indent + "goto failed;\n";
+				break;
+			}
+		}
+	};
+}
+
+namespace Transpiler
+{
+	bool emit(const std::string& path, Tensor<Cell>& program)
+	{
+		Analysis analysis(program);
+		std::optional<std::string> reason = analysis.followTicks();
+		if (!reason.has_value())
+		{
+			reason = analysis.followData();
+		}
+		if (reason.has_value())
+		{
+			const std::string message = "The program can not be written out as C++: " + reason.value();
+			Logger::LogError(message.c_str());
+			return false;
+		}
+
+		const std::string source = Writer(analysis).write(program);
+		FileWriter writer(path);
+		if (!writer.isOpen() || !writer.writeBytes(source.data(), source.size()))
+		{
+			const std::string message = "Could not write the C++ to " + path;
+			Logger::LogError(message.c_str());
+			return false;
+		}
+		writer.flush();
+		return true;
+	}
+}
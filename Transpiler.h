@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include "Tensor.h"
+#include "Cell.h"
+
+//writes programs out as C++ which does what interpreting them does, for programs which never change an instruction
+//tensor. Every tick the instruction cursor can reach is followed from the start, both ways at conditional jumps, which
+//gives the instruction tensors the program can run in, and then the data tensors every data instruction can work on.
+//Programs are refused if they could write to or shrink a tensor they run in, grow one by reading past its dimensions,
+//or jump from conditional jump to conditional jump without end
+namespace Transpiler
+{
+	//writes the program to the path as a C++ translation unit, which gets built with NativeProgram. Logs why if the
+	//program can not be written out, and returns whether it was
+	bool emit(const std::string& path, Tensor<Cell>& program);
+}